@@ -0,0 +1,39 @@
+# Run on the linked firmware: fails the build when the RAM the ELF takes,
+# plus RESERVE bytes for what it allocates and puts on the stack at run
+# time, is more than LIMIT.
+#
+#   cmake -DSIZE=arm-none-eabi-size -DELF=spectro.elf -DRESERVE=n -DLIMIT=n -P check_ram.cmake
+#
+# RAM is every section from 0x20000000 up to LIMIT past it: the main banks
+# and the two scratch banks, which on the RP2040 are contiguous.  The core 0
+# stack placeholder is left out, as RESERVE stands for that stack.
+
+execute_process(COMMAND ${SIZE} -A -d ${ELF} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+if (rc)
+    message(FATAL_ERROR "${SIZE} failed on ${ELF}")
+endif()
+
+set(ram_start 536870912)  # 0x20000000
+math(EXPR ram_end "${ram_start} + ${LIMIT}")
+set(static 0)
+string(REPLACE "\n" ";" lines "${out}")
+foreach(line IN LISTS lines)
+    if (line MATCHES "^(\\.[A-Za-z0-9_.]+) +([0-9]+) +([0-9]+)")
+        set(name ${CMAKE_MATCH_1})
+        set(size ${CMAKE_MATCH_2})
+        set(addr ${CMAKE_MATCH_3})
+        if (addr GREATER_EQUAL ram_start AND addr LESS ram_end AND NOT name STREQUAL ".stack_dummy")
+            math(EXPR static "${static} + ${size}")
+        endif()
+    endif()
+endforeach()
+
+math(EXPR total "${static} + ${RESERVE}")
+math(EXPR total_kb "${total} / 1024")
+math(EXPR static_kb "${static} / 1024")
+math(EXPR limit_kb "${LIMIT} / 1024")
+math(EXPR reserve_kb "${RESERVE} / 1024")
+if (total GREATER LIMIT)
+    message(FATAL_ERROR "RAM: ${static_kb} KB static + ${reserve_kb} KB reserved = ${total_kb} KB, over ${limit_kb} KB")
+endif()
+message(STATUS "RAM: ${static_kb} KB static, ${total_kb} KB of ${limit_kb} KB with the run-time reserve")
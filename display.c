@@ -0,0 +1,32 @@
+#include "display.h"
+
+const uint8_t sh1107_init[SH1107_INIT_LEN] = {
+    0xae, // display off
+    0xdc, 0, // start line 0 - default
+    0x81, 0x4f, //contrast
+    0x20, // vertical addressing - default?
+    0xa0,  // down rotation/segment remap=0
+    0xc0, // scan direction - default
+    0xa8, 0x3f, // multiplex=64
+    0xd3, 0x60, // display offset - 0x60 according to featherwing/adafruit sh1107 driver docs?
+    0xd9, 0x22, // pre-charge/dis-charge period mode: 2 DCLKs/2 DCLKs - default
+    0xdb, 0x35, // VCOM deselect level = 0.770 - default
+    0xa4, // normal/disp off - default
+    0xa6 // normal (not reversed) display - default
+};
+
+void pack_sh1107_page(bool frame[WIDTH][HEIGHT], int page, uint8_t * out) {
+    for (int j=0; j < HEIGHT; j++) {
+        uint8_t byte = 0;
+        for (int k=0; k < 8; k++) { byte |= frame[page*8 + k][j] << k; }
+        out[j] = byte;
+    }
+}
+
+void pack_row_page(bool frame[WIDTH][HEIGHT], int page, uint8_t * out) {
+    for (int x=0; x < WIDTH; x++) {
+        uint8_t byte = 0;
+        for (int k=0; k < 8; k++) { byte |= frame[x][HEIGHT-1 - (page*8 + k)] << k; }
+        out[x] = byte;
+    }
+}
@@ -0,0 +1,49 @@
+// Display backends.  Each packs the WIDTH x HEIGHT frame (x from the left,
+// y from the bottom) into its panel's RAM layout and sends it; which one
+// spectro.c drives is chosen at build time:
+//
+//   display_sh1107_i2c.c  the 128x64 OLED FeatherWing: SH1107 over 400 kHz I2C
+//   display_spi.c         SSD1306, SH1106 or SH1107 panels over SPI, the frame
+//                         going out by DMA, with a D/C pin between commands and
+//                         data (DISPLAY_SPI, and DISPLAY_SPI_CONTROLLER for the
+//                         controller)
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spectro.h"
+
+struct display_driver {
+    const char * name;
+    void (*init)(void);
+    // Sends a frame.  Returns the bytes sent, or PICO_ERROR_GENERIC; a
+    // backend may return before the last of them are out, and then waits
+    // for them at the next call.
+    int (*flush)(bool frame[WIDTH][HEIGHT]);
+};
+
+extern const struct display_driver sh1107_i2c_display;
+extern const struct display_driver spi_display;
+
+#ifdef DISPLAY_SPI
+#define DISPLAY_DRIVER spi_display
+#else
+#define DISPLAY_DRIVER sh1107_i2c_display
+#endif
+
+// SH1107 RAM, as the FeatherWing mounts it: WIDTH/8 pages of HEIGHT bytes,
+// page p byte y holding columns 8p to 8p+7 of row y.
+void pack_sh1107_page(bool frame[WIDTH][HEIGHT], int page, uint8_t * out);
+
+// SSD1306/SH1106 RAM: HEIGHT/8 pages of WIDTH bytes, page p byte x holding
+// rows 8p to 8p+7 from the top of column x.
+void pack_row_page(bool frame[WIDTH][HEIGHT], int page, uint8_t * out);
+
+// The SH1107 set-up both backends send for the FeatherWing's panel, less
+// the I2C control byte and the display-on command.
+#define SH1107_INIT_LEN 19
+extern const uint8_t sh1107_init[SH1107_INIT_LEN];
+
+#endif
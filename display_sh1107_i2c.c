@@ -0,0 +1,64 @@
+// The 128x64 OLED FeatherWing: an SH1107 on I2C.  A full frame is 16 page
+// writes of 65 bytes plus their address commands, about 26 ms at 400 kHz.
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+
+#include "display.h"
+
+#define SDA_PIN 2
+#define SCL_PIN 3
+// assuming here that SCL is consistent
+#if ((SDA_PIN/2) % 2)
+#define WHICH_I2C i2c1
+#else
+#define WHICH_I2C i2c0
+#endif
+#define I2C_KHZ 400
+
+#define DISPLAY_ADDR 0x3c
+
+static void sh1107_i2c_init(void) {
+    const uint8_t display_on[2] = {0x0, 0xaf};
+    uint8_t display_init_bytes[SH1107_INIT_LEN + 1] = {0x0};  //control byte - many command follow
+    for (int i=0; i < SH1107_INIT_LEN; i++) { display_init_bytes[i+1] = sh1107_init[i]; }
+
+    bi_decl(bi_2pins_with_func(SDA_PIN, SCL_PIN, GPIO_FUNC_I2C));
+
+    i2c_init(WHICH_I2C, I2C_KHZ * 1000);
+    gpio_set_function(SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(SDA_PIN);
+    gpio_pull_up(SCL_PIN);
+
+    i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, display_init_bytes, SH1107_INIT_LEN + 1, false);
+    i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, display_on, 2, false);
+}
+
+static int sh1107_i2c_flush(bool frame[WIDTH][HEIGHT]) {
+    int thisret, ret = 0;
+
+    uint8_t byte_buffer[HEIGHT+1];
+    byte_buffer[0] = 0x40;  //control byte, all follow data
+
+    uint8_t reset_pointer_cmds[3] = {0x0, 0x10, 0xb0};
+
+    for (int i=0; i < (WIDTH/8); i++) {
+        reset_pointer_cmds[2] = 0xb0 + i;
+        if (i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, reset_pointer_cmds, 3, false) == PICO_ERROR_GENERIC) {return PICO_ERROR_GENERIC;}
+
+        pack_sh1107_page(frame, i, byte_buffer + 1);
+
+        thisret = i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, byte_buffer, HEIGHT+1, false);
+        if (thisret == PICO_ERROR_GENERIC) {
+            return thisret;
+        } else {
+            ret += thisret;
+        }
+    }
+    return ret;
+}
+
+const struct display_driver sh1107_i2c_display = {"SH1107 I2C", sh1107_i2c_init, sh1107_i2c_flush};
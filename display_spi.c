@@ -0,0 +1,165 @@
+// SSD1306, SH1106 or SH1107 panels on SPI (4-wire: D/C low for commands,
+// high for data).  The packed frame goes out by DMA, so a flush only
+// blocks for the address commands between pages: the SSD1306's horizontal
+// addressing takes the whole frame in one transfer and returns at once,
+// while the SH1106 and SH1107 only address a page at a time.  At 8 MHz a
+// frame is about 1 ms of bus time, against 26 ms on the I2C FeatherWing.
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+
+#include "display.h"
+
+#define SPI_SSD1306 0
+#define SPI_SH1106 1
+#define SPI_SH1107 2
+
+#ifndef DISPLAY_SPI_CONTROLLER
+#define DISPLAY_SPI_CONTROLLER SPI_SSD1306
+#endif
+
+// Feather RP2040 SPI header, and two free pins for D/C and chip select
+#define SPI_SCK_PIN 18
+#define SPI_MOSI_PIN 19
+#define SPI_DC_PIN 24
+#define SPI_CS_PIN 25
+#define SPI_RESET_PIN 5
+#define WHICH_SPI spi0
+#define SPI_KHZ 8000  // the SSD1306 takes 10 MHz; slower panels may need less
+
+#if DISPLAY_SPI_CONTROLLER == SPI_SH1107
+#define N_PAGES (WIDTH/8)
+#define PAGE_BYTES HEIGHT
+#else
+#define N_PAGES (HEIGHT/8)
+#define PAGE_BYTES WIDTH
+#endif
+#define SH1106_COLUMN_OFFSET 2  // its RAM is 132 columns wide, the glass centred on it
+
+static uint8_t frame_bytes[N_PAGES * PAGE_BYTES];  // read by the DMA after flush returns
+static int dma_chan = -1;
+
+// Lets the last transfer finish, including the bits still in the FIFO,
+// before D/C changes or the frame is packed again.
+static void wait_idle(void) {
+    dma_channel_wait_for_finish_blocking(dma_chan);
+    while (spi_is_busy(WHICH_SPI)) {}
+}
+
+static void send_commands(const uint8_t * cmds, int n) {
+    wait_idle();
+    gpio_put(SPI_DC_PIN, 0);
+    spi_write_blocking(WHICH_SPI, cmds, n);
+}
+
+static void send_data(const uint8_t * data, int n) {
+    gpio_put(SPI_DC_PIN, 1);
+    dma_channel_set_read_addr(dma_chan, data, false);
+    dma_channel_set_trans_count(dma_chan, n, true);
+}
+
+static void spi_display_init(void) {
+#if DISPLAY_SPI_CONTROLLER == SPI_SSD1306
+    static const uint8_t init_cmds[] = {
+        0xae, // display off
+        0xd5, 0x80, // clock divide, oscillator frequency - default
+        0xa8, 0x3f, // multiplex=64
+        0xd3, 0x00, // display offset 0
+        0x40, // start line 0
+        0x8d, 0x14, // charge pump on
+        0x20, 0x00, // horizontal addressing: the whole frame in one go
+        0xa1, // segment remap: column 0 on the left
+        0xc8, // scan from the last row, so page 0 is at the top
+        0xda, 0x12, // alternative COM pin configuration
+        0x81, 0xcf, // contrast
+        0xd9, 0xf1, // pre-charge period
+        0xdb, 0x40, // VCOM deselect level
+        0xa4, // display from RAM
+        0xa6, // normal (not reversed) display
+        0xaf, // display on
+    };
+#elif DISPLAY_SPI_CONTROLLER == SPI_SH1106
+    static const uint8_t init_cmds[] = {
+        0xae, // display off
+        0xd5, 0x80, // clock divide, oscillator frequency - default
+        0xa8, 0x3f, // multiplex=64
+        0xd3, 0x00, // display offset 0
+        0x40, // start line 0
+        0xad, 0x8b, // DC-DC converter on
+        0xa1, // segment remap: column 0 on the left
+        0xc8, // scan from the last row, so page 0 is at the top
+        0xda, 0x12, // alternative COM pin configuration
+        0x81, 0x80, // contrast
+        0xd9, 0x22, // pre-charge period - default
+        0xdb, 0x35, // VCOM deselect level - default
+        0xa4, // display from RAM
+        0xa6, // normal (not reversed) display
+        0xaf, // display on
+    };
+#else
+    uint8_t init_cmds[SH1107_INIT_LEN + 1];
+    for (int i=0; i < SH1107_INIT_LEN; i++) { init_cmds[i] = sh1107_init[i]; }
+    init_cmds[SH1107_INIT_LEN] = 0xaf;  // display on
+#endif
+
+    bi_decl(bi_2pins_with_func(SPI_SCK_PIN, SPI_MOSI_PIN, GPIO_FUNC_SPI));
+    bi_decl(bi_1pin_with_name(SPI_CS_PIN, "Display chip select"));
+
+    spi_init(WHICH_SPI, SPI_KHZ * 1000);
+    spi_set_format(WHICH_SPI, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    gpio_set_function(SPI_SCK_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(SPI_MOSI_PIN, GPIO_FUNC_SPI);
+    // the only device on the bus, so selected for good
+    gpio_init(SPI_CS_PIN);
+    gpio_set_dir(SPI_CS_PIN, GPIO_OUT);
+    gpio_put(SPI_CS_PIN, 0);
+    gpio_init(SPI_DC_PIN);
+    gpio_set_dir(SPI_DC_PIN, GPIO_OUT);
+    gpio_init(SPI_RESET_PIN);
+    gpio_set_dir(SPI_RESET_PIN, GPIO_OUT);
+    gpio_put(SPI_RESET_PIN, 0);
+    sleep_ms(1);
+    gpio_put(SPI_RESET_PIN, 1);
+    sleep_ms(1);
+
+    if (dma_chan < 0) { dma_chan = dma_claim_unused_channel(true); }
+    dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, spi_get_dreq(WHICH_SPI, true));
+    dma_channel_configure(dma_chan, &cfg, &spi_get_hw(WHICH_SPI)->dr, frame_bytes, 0, false);
+
+    send_commands(init_cmds, sizeof(init_cmds));
+}
+
+static int spi_display_flush(bool frame[WIDTH][HEIGHT]) {
+    wait_idle();
+    for (int p=0; p < N_PAGES; p++) {
+#if DISPLAY_SPI_CONTROLLER == SPI_SH1107
+        pack_sh1107_page(frame, p, frame_bytes + p*PAGE_BYTES);
+#else
+        pack_row_page(frame, p, frame_bytes + p*PAGE_BYTES);
+#endif
+    }
+
+#if DISPLAY_SPI_CONTROLLER == SPI_SSD1306
+    static const uint8_t window[6] = {0x21, 0, WIDTH-1, 0x22, 0, N_PAGES-1};  // columns, pages
+    send_commands(window, sizeof(window));
+    send_data(frame_bytes, sizeof(frame_bytes));
+    return sizeof(window) + sizeof(frame_bytes);
+#else
+    const int col = DISPLAY_SPI_CONTROLLER == SPI_SH1106 ? SH1106_COLUMN_OFFSET : 0;
+    for (int p=0; p < N_PAGES; p++) {
+        const uint8_t address[3] = {0xb0 + p, col & 0xf, 0x10 | (col >> 4)};  // page, column low, high
+        send_commands(address, 3);
+        send_data(frame_bytes + p*PAGE_BYTES, PAGE_BYTES);
+    }
+    return N_PAGES * (3 + PAGE_BYTES);
+#endif
+}
+
+const struct display_driver spi_display = {"SPI", spi_display_init, spi_display_flush};
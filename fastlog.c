@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include "fastlog.h"
+
+#define LOG2_TABLE_BITS 6
+
+// log2(1 + (i + 0.5)/64) in Q16: the middle of each mantissa interval, so the
+// error is at most half an interval either way
+static const uint16_t log2_table[1 << LOG2_TABLE_BITS] = {
+      736,  2190,  3623,  5034,  6425,  7795,  9146, 10477,
+    11791, 13086, 14363, 15624, 16868, 18096, 19308, 20505,
+    21687, 22854, 24007, 25146, 26272, 27384, 28484, 29571,
+    30645, 31707, 32758, 33797, 34825, 35841, 36847, 37842,
+    38827, 39802, 40767, 41722, 42667, 43603, 44530, 45448,
+    46357, 47258, 48150, 49034, 49909, 50776, 51636, 52488,
+    53332, 54169, 54998, 55820, 56635, 57443, 58245, 59039,
+    59827, 60609, 61384, 62152, 62915, 63671, 64421, 65166,
+};
+
+// Splits an IEEE-754 single into its unbiased exponent and the table entry
+// for the top mantissa bits.  Returns 0 for inputs with no useful log.
+static int split_float(float x, int * exponent, uint32_t * frac_q16) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    if ((int32_t)bits <= 0 || (bits >> 23) == 0) { return 0; }
+    *exponent = (int)(bits >> 23) - 127;
+    *frac_q16 = log2_table[(bits >> (23 - LOG2_TABLE_BITS)) & ((1 << LOG2_TABLE_BITS) - 1)];
+    return 1;
+}
+
+int32_t log2_q16(float x) {
+    int e;
+    uint32_t f;
+    if (!split_float(x, &e, &f)) { return FASTLOG_MIN; }
+    return e * 65536 + (int32_t)f;
+}
+
+int32_t db10_q8(float x) {
+    int e;
+    uint32_t f;
+    if (!split_float(x, &e, &f)) { return FASTLOG_MIN; }
+    // 10*log10(2) = 3.0103 dB per octave: 49321/64 in Q8 for the exponent,
+    // 771/65536 for the Q16 fraction, kept apart so neither overflows
+    return (e * 49321) / 64 + (int32_t)((f * 771) >> 16);
+}
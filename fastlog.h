@@ -0,0 +1,17 @@
+// Table-driven log2 / dB approximations for the spectrum display.  On the
+// soft-float M0+ these cost a few integer ops per call, less than the
+// sqrt() and round() of the linear display and far less than log10().
+#ifndef FASTLOG_H
+#define FASTLOG_H
+
+#include <stdint.h>
+
+#define FASTLOG_MIN INT32_MIN  // result for zero, negative or denormal input
+
+// log2(x) in Q16 fixed point, within 0.012 (about 0.034 dB as power)
+int32_t log2_q16(float x);
+
+// 10*log10(x) in Q8 fixed point (1/256 dB), for x a squared magnitude
+int32_t db10_q8(float x);
+
+#endif
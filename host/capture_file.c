@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_file.h"
+
+static const char magic[4] = {'S', 'P', 'C', 'P'};
+
+static void put_le(uint8_t * dst, uint64_t val, int nbytes) {
+    for (int i=0; i < nbytes; i++) { dst[i] = (val >> (8*i)) & 0xff; }
+}
+
+static uint64_t get_le(const uint8_t * src, int nbytes) {
+    uint64_t val = 0;
+    for (int i=0; i < nbytes; i++) { val |= (uint64_t)src[i] << (8*i); }
+    return val;
+}
+
+int capture_write(const char * path, const capture * cap) {
+    uint8_t hdr[CAPTURE_HEADER_SIZE] = {0};
+    uint32_t maxval_bits;
+
+    memcpy(hdr, magic, 4);
+    put_le(hdr + 4, CAPTURE_VERSION, 2);
+    put_le(hdr + 6, CAPTURE_HEADER_SIZE, 2);
+    put_le(hdr + 8, cap->sample_rate, 4);
+    hdr[12] = cap->bit_depth;
+    hdr[13] = cap->bytes_per_sample;
+    hdr[14] = cap->draw_frequency;
+    hdr[15] = cap->continuous_mode;
+    put_le(hdr + 16, cap->n_samples, 4);
+    put_le(hdr + 20, cap->timestamp_us, 8);
+    put_le(hdr + 28, (uint16_t)cap->display_spacing, 2);
+    put_le(hdr + 30, cap->channels, 2);
+    memcpy(&maxval_bits, &cap->maxval_samples, 4);
+    put_le(hdr + 32, maxval_bits, 4);
+    hdr[36] = cap->mode;
+
+    FILE * f = fopen(path, "wb");
+    if (f == NULL) { return -1; }
+    int ret = 0;
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) { ret = -1; }
+
+    // samples are stored little-endian regardless of host byte order
+    const uint8_t * src = cap->data;
+    for (uint32_t i=0; ret == 0 && i < cap->n_samples; i++) {
+        uint8_t le[2];
+        if (cap->bytes_per_sample == 1) {
+            le[0] = src[i];
+        } else {
+            uint16_t v;
+            memcpy(&v, src + 2*i, 2);
+            put_le(le, v, 2);
+        }
+        if (fwrite(le, 1, cap->bytes_per_sample, f) != cap->bytes_per_sample) { ret = -1; }
+    }
+    if (fclose(f) != 0) { ret = -1; }
+    return ret;
+}
+
+int capture_read(const char * path, capture * cap) {
+    uint8_t hdr[CAPTURE_HEADER_SIZE];
+    uint32_t maxval_bits;
+
+    FILE * f = fopen(path, "rb");
+    if (f == NULL) { return -1; }
+    if (fread(hdr, 1, 36, f) != 36 || memcmp(hdr, magic, 4) != 0 || get_le(hdr + 4, 2) != CAPTURE_VERSION) {
+        fclose(f);
+        return -1;
+    }
+
+    cap->sample_rate = get_le(hdr + 8, 4);
+    cap->bit_depth = hdr[12];
+    cap->bytes_per_sample = hdr[13];
+    cap->draw_frequency = hdr[14];
+    cap->continuous_mode = hdr[15];
+    cap->n_samples = get_le(hdr + 16, 4);
+    cap->timestamp_us = get_le(hdr + 20, 8);
+    cap->display_spacing = (int16_t)get_le(hdr + 28, 2);
+    cap->channels = get_le(hdr + 30, 2);
+    if (cap->channels == 0) { cap->channels = 1; }
+    maxval_bits = get_le(hdr + 32, 4);
+    memcpy(&cap->maxval_samples, &maxval_bits, 4);
+
+    unsigned int header_size = get_le(hdr + 6, 2);
+    cap->mode = cap->channels > 1 ? 1 : 0;
+    if (header_size >= 37) {
+        if (fread(hdr + 36, 1, 1, f) != 1) {
+            fclose(f);
+            return -1;
+        }
+        cap->mode = hdr[36];
+    }
+
+    if ((cap->bytes_per_sample != 1 && cap->bytes_per_sample != 2) || cap->n_samples == 0
+        || fseek(f, (long)header_size, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    uint8_t * dst = malloc((size_t)cap->n_samples * cap->bytes_per_sample);
+    if (dst == NULL || fread(dst, cap->bytes_per_sample, cap->n_samples, f) != cap->n_samples) {
+        free(dst);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    if (cap->bytes_per_sample == 2) {
+        for (uint32_t i=0; i < cap->n_samples; i++) {
+            uint16_t v = get_le(dst + 2*i, 2);
+            memcpy(dst + 2*i, &v, 2);
+        }
+    }
+    cap->data = dst;
+    return 0;
+}
+
+int capture_import_dump(const char * path, capture * cap) {
+    char line[256];
+    unsigned long long t;
+    int freq, spacing, continuous, bits, channels = 1, mode = -1;
+    unsigned int rate, n;
+    bool have_meta = false;
+
+    FILE * f = fopen(path, "r");
+    if (f == NULL) { return -1; }
+
+    // the dump is usually mixed in with other serial chatter; skip to the
+    // last metadata line before a results block
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // older firmware stops before the channel count or mode
+        if (sscanf(line, "Capture: rate=%u bits=%d n=%u t=%llu freq=%d spacing=%d maxval=%f continuous=%d channels=%d mode=%d",
+                   &rate, &bits, &n, &t, &freq, &spacing, &cap->maxval_samples, &continuous, &channels, &mode) >= 8) {
+            have_meta = true;
+        } else if (have_meta && strncmp(line, "Results: [", 10) == 0) {
+            break;
+        }
+    }
+    if (!have_meta || feof(f) || n == 0) {
+        fclose(f);
+        return -1;
+    }
+
+    cap->sample_rate = rate;
+    cap->bit_depth = bits;
+    cap->bytes_per_sample = bits > 8 ? 2 : 1;
+    cap->n_samples = n;
+    cap->timestamp_us = t;
+    cap->draw_frequency = freq;
+    cap->display_spacing = spacing;
+    cap->continuous_mode = continuous;
+    cap->channels = channels;
+    cap->mode = mode >= 0 ? mode : (channels > 1);
+
+    uint8_t * dst = malloc((size_t)n * cap->bytes_per_sample);
+    if (dst == NULL) {
+        fclose(f);
+        return -1;
+    }
+    for (unsigned int i=0; i < n; i++) {
+        unsigned int v;
+        if (fscanf(f, " %u ,", &v) != 1) {
+            free(dst);
+            fclose(f);
+            return -1;
+        }
+        if (cap->bytes_per_sample == 1) {
+            dst[i] = v;
+        } else {
+            uint16_t v16 = v;
+            memcpy(dst + 2*i, &v16, 2);
+        }
+    }
+    fclose(f);
+    cap->data = dst;
+    return 0;
+}
+
+void capture_free(capture * cap) {
+    free(cap->data);
+    cap->data = NULL;
+}
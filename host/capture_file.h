@@ -0,0 +1,64 @@
+// Capture files: one block of raw ADC samples plus the metadata needed to
+// reproduce the frame it produced.
+//
+// On-disk layout, all fields little-endian:
+//
+//   offset  size  field
+//        0     4  magic "SPCP"
+//        4     2  version (CAPTURE_VERSION)
+//        6     2  header size in bytes (offset of the first sample)
+//        8     4  sample rate, samples per second
+//       12     1  bit depth of each sample as captured
+//       13     1  bytes per stored sample (1 or 2)
+//       14     1  UI: draw_frequency
+//       15     1  UI: continuous_mode
+//       16     4  number of samples
+//       20     8  capture timestamp, time_us_64() on the device
+//       28     2  UI: display_spacing (signed, -1 is peak-zoom)
+//       30     2  UI: number of interleaved round-robin channels (0 means 1)
+//       32     4  UI: maxval_samples, IEEE-754 single
+//       36     1  UI: mode (enum mode in spectro.h)
+//       37     3  reserved, zero
+//       40   ...  samples
+//
+// Readers go by the header size field, so files with the 36 byte header
+// written before the mode was recorded still load (as scope/multichannel).
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 40
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t bit_depth;
+    uint8_t bytes_per_sample;
+    uint32_t n_samples;
+    uint64_t timestamp_us;
+
+    bool draw_frequency;
+    bool continuous_mode;
+    int16_t display_spacing;
+    float maxval_samples;
+    uint16_t channels;
+    uint8_t mode;
+
+    void * data;  // n_samples * bytes_per_sample, owned by the capture
+} capture;
+
+// Each returns 0 on success and -1 on failure.  On success capture_read and
+// capture_import_dump allocate cap->data, to be released with capture_free.
+int capture_read(const char * path, capture * cap);
+int capture_write(const char * path, const capture * cap);
+
+// Parses the "Capture: ..." metadata line and "Results: [...]" block that the
+// firmware's print_samples() writes to serial.
+int capture_import_dump(const char * path, capture * cap);
+
+void capture_free(capture * cap);
+
+#endif
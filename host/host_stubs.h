@@ -0,0 +1,40 @@
+// Host-side hooks into the stubbed pico-sdk in pico_stubs.c.  These let the
+// replay tool and tests feed the "ADC" and inspect what reached the "display".
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Samples handed out by the stubbed ADC FIFO/DMA, in DMA transfer units.  The
+// feed wraps around if a capture asks for more than was provided.
+void host_adc_feed(const void *data, size_t n_items, size_t item_size);
+
+// Lets each running channel with a write ring (channel_config_set_ring)
+// make up to n more transfers from the ADC feed, as if the ADC had run for
+// n conversions.  Those channels never finish by being waited on.
+void host_dma_run(unsigned int n);
+
+// Low to high transitions written to a GPIO so far.
+uint32_t host_gpio_rises(unsigned int gpio);
+
+// FNV-1a hash of every byte written over I2C since the last reset, the
+// number of those bytes, and the bytes themselves.
+void host_i2c_reset(void);
+uint32_t host_i2c_checksum(void);
+size_t host_i2c_bytes(void);
+const uint8_t *host_i2c_output(size_t *n);
+
+// Every byte written over SPI, by the CPU or by DMA, since the last reset:
+// the byte in bits 0-7 and the level of GPIO dc_gpio (the display's D/C
+// pin) as it went out in bit 8.
+void host_spi_reset(int dc_gpio);
+const uint16_t *host_spi_output(size_t *n);
+
+// Bytes for getchar_timeout_us() to hand out, and everything putchar_raw()
+// has written since the last reset.
+void host_serial_feed(const uint8_t *data, size_t n);
+void host_serial_reset(void);
+const uint8_t *host_serial_output(size_t *n);
+
+#endif
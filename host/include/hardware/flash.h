@@ -0,0 +1,20 @@
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+// The board's flash, here a RAM image that XIP_BASE maps (from pico.h and
+// the board header on the device).  Erased sectors read 0xff and programming
+// only clears bits, as on the NOR flash.
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+extern uint8_t host_flash_image[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)host_flash_image)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
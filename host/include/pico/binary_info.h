@@ -0,0 +1,8 @@
+// Host stand-in for pico/binary_info.h: binary info is only meaningful in a
+// firmware image, so every declaration compiles away.
+#ifndef HOST_PICO_BINARY_INFO_H
+#define HOST_PICO_BINARY_INFO_H
+
+#define bi_decl(...)
+
+#endif
@@ -0,0 +1,42 @@
+// Host stand-in for the pico-sdk's pico/stdlib.h, just enough of the SDK
+// surface for spectro.c to compile and run on Linux.  The implementations
+// live in host/pico_stubs.c.
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/gpio.h"
+
+typedef unsigned int uint;
+
+#define PICO_OK 0
+#define PICO_ERROR_TIMEOUT -1
+#define PICO_ERROR_GENERIC -2
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+bool stdio_init_all(void);
+
+// pico/stdio.h; the "USB serial" is host_serial_feed() in and host_serial_output() out
+int getchar_timeout_us(uint32_t timeout_us);
+int putchar_raw(int c);
+
+// pico/platform.h
+void busy_wait_at_least_cycles(uint32_t minimum_cycles);
+
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+
+#endif
@@ -0,0 +1,337 @@
+// Minimal implementations of the pico-sdk calls used by spectro.c, so the
+// firmware sources can be built and exercised on a Linux host.
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+
+#include "host_stubs.h"
+
+#define N_GPIO 30
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+struct i2c_inst { int unused; };
+i2c_inst_t i2c0_inst, i2c1_inst;
+
+struct spi_inst { spi_hw_t hw; };
+spi_inst_t spi0_inst, spi1_inst;
+
+static adc_hw_t adc_regs;
+adc_hw_t *const adc_hw = &adc_regs;
+
+static bool gpio_state[N_GPIO];
+static uint32_t gpio_rises[N_GPIO];
+
+static const uint8_t *feed_data;
+static size_t feed_items, feed_item_size, feed_pos;
+
+static const uint8_t *serial_in;
+static size_t serial_in_len, serial_in_pos;
+static uint8_t *serial_out;
+static size_t serial_out_len, serial_out_cap;
+
+// A channel's transfer happens all at once when something waits on it, and
+// only then triggers the channel it chains to.  That keeps ping-pong chains
+// in feed order as long as the waits come in the order the hardware would
+// finish them.  Transfers into an SPI data register go to the SPI
+// recorder from src; any other is filled from the ADC feed.  A channel
+// with a write ring instead moves only when host_dma_run() says so.
+static struct {
+    uint8_t *dst;
+    const uint8_t *src;
+    unsigned int count;
+    unsigned int data_size;
+    unsigned int chain_to;
+    unsigned int ring_bits;  // 0 for none
+    unsigned int ring_pos;  // bytes into the ring
+    bool busy;
+} dma[NUM_DMA_CHANNELS];
+static dma_channel_hw_t dma_regs[NUM_DMA_CHANNELS];
+static unsigned int dma_claimed;
+
+static uint32_t i2c_hash = FNV_OFFSET;
+static size_t i2c_nbytes;
+static uint8_t *i2c_out;
+static size_t i2c_out_cap;
+
+uint8_t host_flash_image[PICO_FLASH_SIZE_BYTES];
+
+static uint16_t *spi_out;
+static size_t spi_out_len, spi_out_cap;
+static int spi_dc_gpio = -1;
+
+bool stdio_init_all(void) { return true; }
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    (void)timeout_us;
+    return serial_in_pos < serial_in_len ? serial_in[serial_in_pos++] : PICO_ERROR_TIMEOUT;
+}
+
+int putchar_raw(int c) {
+    if (serial_out_len == serial_out_cap) {
+        serial_out_cap = serial_out_cap ? 2 * serial_out_cap : 4096;
+        serial_out = realloc(serial_out, serial_out_cap);
+    }
+    serial_out[serial_out_len++] = c;
+    return c;
+}
+
+void host_serial_feed(const uint8_t *data, size_t n) {
+    serial_in = data;
+    serial_in_len = n;
+    serial_in_pos = 0;
+}
+
+void host_serial_reset(void) { serial_out_len = 0; }
+
+const uint8_t *host_serial_output(size_t *n) {
+    *n = serial_out_len;
+    return serial_out;
+}
+
+void sleep_ms(uint32_t ms) { (void)ms; }
+void sleep_us(uint64_t us) { (void)us; }
+
+uint64_t time_us_64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+void busy_wait_at_least_cycles(uint32_t minimum_cycles) { (void)minimum_cycles; }
+
+uint32_t save_and_disable_interrupts(void) { return 0; }
+void restore_interrupts(uint32_t status) { (void)status; }
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return clk_index == clk_adc || clk_index == clk_usb ? 48000000 : 125000000;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    (void)ms; (void)callback; (void)user_data; (void)fire_if_past;
+    return 1;
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) { (void)alarm_id; return true; }
+
+void gpio_init(unsigned int gpio) { gpio_state[gpio % N_GPIO] = false; }
+void gpio_set_dir(unsigned int gpio, bool out) { (void)gpio; (void)out; }
+void gpio_put(unsigned int gpio, bool value) {
+    if (value && !gpio_state[gpio % N_GPIO]) { gpio_rises[gpio % N_GPIO]++; }
+    gpio_state[gpio % N_GPIO] = value;
+}
+uint32_t host_gpio_rises(unsigned int gpio) { return gpio_rises[gpio % N_GPIO]; }
+bool gpio_get(unsigned int gpio) { return gpio_state[gpio % N_GPIO]; }
+void gpio_pull_up(unsigned int gpio) { (void)gpio; }
+void gpio_set_function(unsigned int gpio, enum gpio_function fn) { (void)gpio; (void)fn; }
+void gpio_set_irq_enabled_with_callback(unsigned int gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback) {
+    (void)gpio; (void)events; (void)enabled; (void)callback;
+}
+
+void adc_init(void) {}
+void adc_gpio_init(unsigned int gpio) { (void)gpio; }
+void adc_select_input(unsigned int input) { (void)input; }
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+    (void)en; (void)dreq_en; (void)dreq_thresh; (void)err_in_fifo; (void)byte_shift;
+}
+void adc_set_clkdiv(float clkdiv) { (void)clkdiv; }
+void adc_set_round_robin(unsigned int input_mask) { (void)input_mask; }
+uint16_t adc_read(void) { return 0; }
+void adc_run(bool run) { (void)run; }
+void adc_fifo_drain(void) {}
+
+void host_adc_feed(const void *data, size_t n_items, size_t item_size) {
+    feed_data = data;
+    feed_items = n_items;
+    feed_item_size = item_size;
+    feed_pos = 0;
+}
+
+// ctrl packs the transfer size in bits 0-1, chain_to in bits 2-5 and the
+// write ring's size bits in 6-10
+int dma_claim_unused_channel(bool required) {
+    (void)required;
+    return dma_claimed < NUM_DMA_CHANNELS ? (int)dma_claimed++ : -1;
+}
+
+dma_channel_config dma_channel_get_default_config(unsigned int channel) {
+    dma_channel_config c = {DMA_SIZE_32 | (channel << 2)};
+    return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->ctrl = (c->ctrl & ~3u) | size;
+}
+void channel_config_set_chain_to(dma_channel_config *c, unsigned int chan) {
+    c->ctrl = (c->ctrl & ~0x3cu) | (chan << 2);
+}
+void channel_config_set_ring(dma_channel_config *c, bool write, unsigned int size_bits) {
+    c->ctrl = (c->ctrl & ~0x7c0u) | (write ? size_bits << 6 : 0);
+}
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_dreq(dma_channel_config *c, unsigned int dreq) { (void)c; (void)dreq; }
+
+void dma_channel_configure(unsigned int channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, unsigned int transfer_count, bool trigger) {
+    dma[channel].src = (const uint8_t *)read_addr;
+    dma[channel].dst = (uint8_t *)write_addr;
+    dma[channel].count = transfer_count;
+    dma[channel].data_size = 1u << (config->ctrl & 3u);
+    dma[channel].chain_to = (config->ctrl >> 2) & 0xf;
+    dma[channel].ring_bits = (config->ctrl >> 6) & 0x1f;
+    dma[channel].ring_pos = 0;
+    dma[channel].busy = trigger;
+}
+
+void dma_channel_set_write_addr(unsigned int channel, volatile void *write_addr, bool trigger) {
+    dma[channel].dst = (uint8_t *)write_addr;
+    if (trigger) { dma[channel].busy = true; }
+}
+
+void dma_channel_set_read_addr(unsigned int channel, const volatile void *read_addr, bool trigger) {
+    dma[channel].src = (const uint8_t *)read_addr;
+    if (trigger) { dma[channel].busy = true; }
+}
+
+void dma_channel_set_trans_count(unsigned int channel, uint32_t trans_count, bool trigger) {
+    dma[channel].count = trans_count;
+    if (trigger) { dma[channel].busy = true; }
+}
+
+void dma_channel_start(unsigned int channel) { dma[channel].busy = true; }
+void dma_channel_abort(unsigned int channel) { dma[channel].busy = false; }
+
+bool dma_channel_is_busy(unsigned int channel) {
+    dma_channel_wait_for_finish_blocking(channel);
+    return false;
+}
+
+// n transfers from the ADC feed into dst, each zero-extended or truncated
+// to the DMA transfer size
+static void dma_from_feed(uint8_t *dst, unsigned int n, unsigned int size) {
+    for (unsigned int i = 0; i < n; i++) {
+        uint32_t v = 0;
+        if (feed_items) {
+            const uint8_t *src = feed_data + feed_pos * feed_item_size;
+            memcpy(&v, src, feed_item_size < sizeof(v) ? feed_item_size : sizeof(v));
+            feed_pos = (feed_pos + 1) % feed_items;
+        }
+        memcpy(dst + i * size, &v, size);
+    }
+}
+
+void host_dma_run(unsigned int n) {
+    for (unsigned int c = 0; c < NUM_DMA_CHANNELS; c++) {
+        if (!dma[c].busy || !dma[c].ring_bits) { continue; }
+        const unsigned int size = dma[c].data_size;
+        const unsigned int ring = 1u << dma[c].ring_bits;
+        for (unsigned int i = 0; i < n && dma[c].count; i++, dma[c].count--) {
+            dma_from_feed(dma[c].dst + dma[c].ring_pos, 1, size);
+            dma[c].ring_pos = (dma[c].ring_pos + size) % ring;
+        }
+        if (!dma[c].count) { dma[c].busy = false; }
+    }
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(unsigned int channel) {
+    dma_regs[channel].transfer_count = dma[channel].count;
+    dma_regs[channel].write_addr = (uint32_t)(uintptr_t)(dma[channel].dst + dma[channel].ring_pos);
+    return &dma_regs[channel];
+}
+
+void dma_channel_wait_for_finish_blocking(unsigned int channel) {
+    if (!dma[channel].busy || dma[channel].ring_bits) { return; }
+    uint8_t *dst = dma[channel].dst;
+    unsigned int size = dma[channel].data_size;
+    if (dst == (uint8_t *)&spi0_inst.hw.dr || dst == (uint8_t *)&spi1_inst.hw.dr) {
+        spi_write_blocking(NULL, dma[channel].src, dma[channel].count);
+        dma[channel].src += dma[channel].count;
+        dma[channel].busy = false;
+        return;
+    }
+    dma_from_feed(dst, dma[channel].count, size);
+    // like the hardware, the write address is left just past the block
+    dma[channel].dst = dst + dma[channel].count * size;
+    dma[channel].busy = false;
+    if (dma[channel].chain_to != channel) { dma[dma[channel].chain_to].busy = true; }
+}
+
+unsigned int i2c_init(i2c_inst_t *i2c, unsigned int baudrate) { (void)i2c; return baudrate; }
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    (void)i2c; (void)addr; (void)nostop;
+    for (size_t i = 0; i < len; i++) {
+        i2c_hash = (i2c_hash ^ src[i]) * FNV_PRIME;
+    }
+    if (i2c_nbytes + len > i2c_out_cap) {
+        i2c_out_cap = 2 * (i2c_nbytes + len);
+        i2c_out = realloc(i2c_out, i2c_out_cap);
+    }
+    memcpy(i2c_out + i2c_nbytes, src, len);
+    i2c_nbytes += len;
+    return (int)len;
+}
+
+void host_i2c_reset(void) {
+    i2c_hash = FNV_OFFSET;
+    i2c_nbytes = 0;
+}
+
+const uint8_t *host_i2c_output(size_t *n) {
+    *n = i2c_nbytes;
+    return i2c_out;
+}
+
+unsigned int spi_init(spi_inst_t *spi, unsigned int baudrate) { (void)spi; return baudrate; }
+void spi_set_format(spi_inst_t *spi, unsigned int data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+    (void)spi; (void)data_bits; (void)cpol; (void)cpha; (void)order;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    (void)spi;
+    if (spi_out_len + len > spi_out_cap) {
+        spi_out_cap = 2 * (spi_out_len + len);
+        spi_out = realloc(spi_out, spi_out_cap * sizeof(uint16_t));
+    }
+    const uint16_t dc = spi_dc_gpio >= 0 && gpio_get(spi_dc_gpio) ? 0x100 : 0;
+    for (size_t i = 0; i < len; i++) { spi_out[spi_out_len++] = dc | src[i]; }
+    return (int)len;
+}
+
+bool spi_is_busy(const spi_inst_t *spi) { (void)spi; return false; }
+spi_hw_t *spi_get_hw(spi_inst_t *spi) { return &spi->hw; }
+unsigned int spi_get_dreq(spi_inst_t *spi, bool is_tx) { return (spi == spi1 ? 18 : 16) + !is_tx; }
+
+void host_spi_reset(int dc_gpio) {
+    spi_dc_gpio = dc_gpio;
+    spi_out_len = 0;
+}
+
+const uint16_t *host_spi_output(size_t *n) {
+    *n = spi_out_len;
+    return spi_out;
+}
+
+uint32_t host_i2c_checksum(void) { return i2c_hash; }
+size_t host_i2c_bytes(void) { return i2c_nbytes; }
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    memset(host_flash_image + flash_offs, 0xff, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    for (size_t i = 0; i < count; i++) { host_flash_image[flash_offs + i] &= data[i]; }
+}
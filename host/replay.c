@@ -0,0 +1,309 @@
+// Host replay benchmark: pushes a corpus of capture files through the whole
+// spectro pipeline (stubbed DMA capture, FFT, plot, label, display write) and
+// reports per-stage timing, frames per second and a checksum of the bytes
+// sent to the display for each capture.
+//
+//   spectro_replay [-r repeats] [-v] [capture.cap ...]
+//       replay the given captures, or the built-in synthetic corpus if none
+//   spectro_replay -g outdir
+//       write the synthetic corpus to outdir as capture files
+//   spectro_replay -i serial_dump.txt out.cap
+//       convert a print_samples() dump from the device into a capture file
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+
+#include "capture_file.h"
+#include "host_stubs.h"
+#include "spectro.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define N_SYNTH 30
+
+static FILE * report;
+
+static uint8_t clamp_sample(double v) {
+    if (v < 0) { return 0; }
+    if (v > 255) { return 255; }
+    return (uint8_t)lround(v);
+}
+
+// Builds synthetic capture `which` into cap, returning its name.
+static const char * synth_capture(int which, capture * cap) {
+    static const char * names[N_SYNTH / 2] = {"tone_1k", "tone_37k", "two_tone", "noise", "chirp", "square_5k", "4ch_tones",
+                                              "rlc_step", "tone_12bit", "distorted_1k",
+                                              "noisy_7k", "harmonic_440", "multitone",
+                                              "chirp_bands", "spur_mask"};
+    uint8_t * data = malloc(N_SAMPLES);
+    uint16_t * data16 = malloc(N_SAMPLES * sizeof(uint16_t));
+    uint32_t rng = 12345;
+    int kind = which / 2;
+
+    for (int i=0; i < N_SAMPLES; i++) {
+        double t = (double)i / SAMPLE_RATE;
+        double v = 0;
+        switch (kind) {
+            case 0: v = 100 * sin(2*M_PI*1000*t); break;
+            case 1: v = 100 * sin(2*M_PI*37000*t); break;
+            case 2: v = 70 * sin(2*M_PI*12000*t) + 30 * sin(2*M_PI*45000*t); break;
+            case 3:
+                rng = rng * 1664525u + 1013904223u;
+                v = ((rng >> 24) - 128) * 0.8;
+                break;
+            case 4:
+            case 13: {
+                // linear sweep from 0 to 100 kHz across the capture
+                double tmax = (double)N_SAMPLES / SAMPLE_RATE;
+                v = 100 * sin(2*M_PI * (100000/(2*tmax)) * t*t);
+                break;
+            }
+            case 5: v = (fmod(t*5000, 1.) < 0.5) ? 100 : -100; break;
+            case 6:
+                // round-robin interleaved: channel i%4 carries a (i%4 + 1) kHz tone
+                t = (double)(i / 4) / (SAMPLE_RATE / 4);
+                v = 100 * sin(2*M_PI*1000*(i % 4 + 1)*t);
+                break;
+            case 7:
+                // noisy ringing step response of a 20 kHz resonance, as seen in transfer mode
+                rng = rng * 1664525u + 1013904223u;
+                v = -100 + 100 * (1 - exp(-t/200e-6) * cos(2*M_PI*20000*t)) + ((int)(rng >> 30) - 2);
+                break;
+            case 8:
+                // 12 bit: a tone only a couple of 8 bit steps high, on top of a larger one
+                v = 1.5 * sin(2*M_PI*3000*t) + 60 * sin(2*M_PI*40000*t);
+                break;
+            case 9:
+                // 1% second and 0.5% third harmonic, for THD mode
+                v = 120 * sin(2*M_PI*1234.5*t) + 1.2 * sin(2*M_PI*2469*t) + 0.6 * sin(2*M_PI*3703.5*t);
+                break;
+            case 10:
+                // off-bin tone with a few counts of noise, for the counter
+                rng = rng * 1664525u + 1013904223u;
+                v = 90 * sin(2*M_PI*7012.3*t) + ((int)(rng >> 29) - 4);
+                break;
+            case 11:
+                // weak fundamental under strong 2nd and 3rd harmonics, for the pitch estimator
+                v = 15 * sin(2*M_PI*440*t) + 60 * sin(2*M_PI*880*t + 1) + 45 * sin(2*M_PI*1320*t + 2);
+                break;
+            case 12:
+                // tones 6 dB apart, more than the peak list holds
+                for (int j=0; j < 7; j++) { v += (64 >> j) * sin(2*M_PI*(3100.5 + 17777*j)*t + j); }
+                break;
+            case 14:
+                // a spur over the default mask, which trips every frame
+                v = 100 * sin(2*M_PI*5000*t) + 4 * sin(2*M_PI*21000*t);
+                break;
+        }
+        data[i] = clamp_sample(128 + v);
+        data16[i] = lround(16 * (128 + v));
+    }
+
+    memset(cap, 0, sizeof(*cap));
+    cap->sample_rate = SAMPLE_RATE;
+    cap->bit_depth = kind == 8 ? 12 : 8;
+    cap->bytes_per_sample = kind == 8 ? 2 : 1;
+    cap->n_samples = N_SAMPLES;
+    cap->draw_frequency = which % 2;
+    cap->display_spacing = 1;
+    cap->maxval_samples = 255.;
+    cap->channels = kind == 6 ? 4 : 1;
+    cap->mode = kind == 6 ? MODE_MULTICHANNEL : kind == 7 ? MODE_TRANSFER : kind == 8 ? MODE_WIDE
+                : kind == 9 ? MODE_THD : kind == 10 ? MODE_COUNTER
+                : kind == 11 ? MODE_PITCH : kind == 12 ? MODE_PEAKS
+                : kind == 13 ? MODE_BANDS : kind == 14 ? MODE_MASK : MODE_SCOPE;
+    if (kind == 8) {
+        cap->data = data16;
+        free(data);
+    } else {
+        cap->data = data;
+        free(data16);
+    }
+    return names[kind];
+}
+
+// Replays one capture `repeats` times and reports the mean stage timings.
+static void replay_capture(const char * name, const capture * cap, int repeats, uint64_t * total_us, long * frames) {
+    uint64_t stage_sum[N_STAGES] = {0};
+    uint32_t checksum = 0;
+    const void * feed = cap->data;
+    size_t nfeed = cap->n_samples;
+    uint16_t * raw = NULL;
+    uint8_t * phase_major = NULL;
+    int phases = 1;
+
+    // Wide captures are stored after decimation; repeating each sample,
+    // cut back to 12 bits, `oversample` times reproduces it exactly.
+    int os = 1;
+    if (cap->bytes_per_sample == 2) {
+        os = cap->sample_rate && cap->sample_rate < SAMPLE_RATE ? SAMPLE_RATE / cap->sample_rate : 1;
+        os = os >= 16 ? 16 : os >= 4 ? 4 : 1;
+        int shift = cap->bit_depth > 12 ? cap->bit_depth - 12 : 0;
+        const uint16_t * vals = cap->data;
+        raw = malloc(nfeed * os * sizeof(uint16_t));
+        for (size_t i=0; i < nfeed * os; i++) { raw[i] = vals[i / os] >> shift; }
+        feed = raw;
+        nfeed *= os;
+    } else if (cap->mode == MODE_ETS && cap->n_samples == N_SAMPLES) {
+        // equivalent-time records are stored interleaved; the ADC delivers
+        // them one phase after another
+        phases = cap->sample_rate > SAMPLE_RATE ? cap->sample_rate / SAMPLE_RATE : 1;
+        while (N_SAMPLES % phases) { phases--; }
+        const uint8_t * vals = cap->data;
+        phase_major = malloc(N_SAMPLES);
+        for (int i=0; i < N_SAMPLES; i++) { phase_major[(i % phases) * (N_SAMPLES / phases) + i / phases] = vals[i]; }
+        feed = phase_major;
+    } else if (cap->sample_rate != SAMPLE_RATE || cap->bit_depth != SAMPLE_BITS) {
+        fprintf(report, "%-24s note: captured at %u S/s, %d bits; replayed as %d S/s, %d bits\n",
+                name, cap->sample_rate, cap->bit_depth, SAMPLE_RATE, SAMPLE_BITS);
+    }
+
+    for (int r=0; r < repeats; r++) {
+        draw_frequency = cap->draw_frequency;
+        continuous_mode = cap->continuous_mode;
+        display_spacing = cap->display_spacing;
+        maxval_samples = cap->maxval_samples;
+        mode = cap->mode < N_MODES ? cap->mode : MODE_SCOPE;
+        n_channels = cap->channels > 1 ? cap->channels : n_channels;
+        oversample = os;
+        ets_phases = phases;
+        if (cap->bytes_per_sample == 2) { mode = MODE_WIDE; }
+        // each repeat is the first spectrum checked against the mask
+        mask_tripped = false;
+        mask_frames = mask_hits = 0;
+
+        host_adc_feed(feed, nfeed, cap->bytes_per_sample);
+        host_i2c_reset();
+        host_serial_reset();  // drops unasked frames such as mask hits
+
+        uint64_t t0 = time_us_64();
+        update_maxval();
+        do_capture();
+        stage_time_us[STAGE_CAPTURE] = time_us_64() - t0;
+        stage_time_us[STAGE_PRINT] = 0;
+        render_frame();
+        *total_us += time_us_64() - t0;
+
+        for (int s=0; s < N_STAGES; s++) { stage_sum[s] += stage_time_us[s]; }
+        // every repeat has to produce the same frame
+        if (r > 0 && host_i2c_checksum() != checksum) {
+            fprintf(report, "%-24s WARNING: frame differs on repeat %d\n", name, r);
+        }
+        checksum = host_i2c_checksum();
+        (*frames)++;
+    }
+
+    free(raw);
+    free(phase_major);
+
+    fprintf(report, "%-24s", name);
+    uint64_t frame_sum = 0;
+    for (int s=0; s < N_STAGES; s++) {
+        fprintf(report, " %9.1f", (double)stage_sum[s] / repeats);
+        frame_sum += stage_sum[s];
+    }
+    fprintf(report, " %9.1f  %08x\n", (double)frame_sum / repeats, checksum);
+}
+
+static int generate_corpus(const char * outdir) {
+    char path[1024];
+    for (int i=0; i < N_SYNTH; i++) {
+        capture cap;
+        const char * name = synth_capture(i, &cap);
+        snprintf(path, sizeof(path), "%s/%s_%s.cap", outdir, name, cap.draw_frequency ? "freq" : "time");
+        int ret = capture_write(path, &cap);
+        capture_free(&cap);
+        if (ret != 0) {
+            fprintf(stderr, "could not write %s\n", path);
+            return 1;
+        }
+        printf("wrote %s\n", path);
+    }
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: spectro_replay [-r repeats] [-v] [capture.cap ...]\n"
+            "       spectro_replay -g outdir\n"
+            "       spectro_replay -i serial_dump.txt out.cap\n");
+}
+
+int main(int argc, char ** argv) {
+    int repeats = 20;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:vg:i:h")) != -1) {
+        switch (opt) {
+            case 'r': repeats = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            case 'g': return generate_corpus(optarg);
+            case 'i': {
+                capture cap;
+                if (optind >= argc || capture_import_dump(optarg, &cap) != 0) {
+                    fprintf(stderr, "could not import %s\n", optarg);
+                    return 1;
+                }
+                int ret = capture_write(argv[optind], &cap);
+                capture_free(&cap);
+                return ret != 0;
+            }
+            default:
+                usage();
+                return opt != 'h';
+        }
+    }
+    if (repeats < 1) { repeats = 1; }
+
+    // the firmware chats on stdout; keep the report readable unless asked
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose) { freopen("/dev/null", "w", stdout); }
+
+    setup_display();
+    setup_adc();
+    setup_dma();
+    setup_fft();
+
+    fprintf(report, "%-24s", "capture (mean us)");
+    for (int s=0; s < N_STAGES; s++) { fprintf(report, " %9s", stage_names[s]); }
+    fprintf(report, " %9s  %8s\n", "frame", "checksum");
+
+    uint64_t total_us = 0;
+    long frames = 0;
+    int failures = 0;
+    if (optind < argc) {
+        for (int i=optind; i < argc; i++) {
+            capture cap;
+            if (capture_read(argv[i], &cap) != 0) {
+                fprintf(report, "%-24s could not read capture\n", argv[i]);
+                failures++;
+                continue;
+            }
+            const char * name = strrchr(argv[i], '/');
+            replay_capture(name ? name + 1 : argv[i], &cap, repeats, &total_us, &frames);
+            capture_free(&cap);
+        }
+    } else {
+        for (int i=0; i < N_SYNTH; i++) {
+            capture cap;
+            char name[64];
+            const char * base = synth_capture(i, &cap);
+            snprintf(name, sizeof(name), "%s_%s", base, cap.draw_frequency ? "freq" : "time");
+            replay_capture(name, &cap, repeats, &total_us, &frames);
+            capture_free(&cap);
+        }
+    }
+
+    if (frames > 0) {
+        fprintf(report, "%ld frames in %.3f s: %.1f frames/s\n", frames, total_us / 1e6, frames / (total_us / 1e6));
+    }
+    fclose(report);
+    return failures != 0;
+}
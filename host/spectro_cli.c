@@ -0,0 +1,435 @@
+// Remote control for the device over its USB serial port, using the binary
+// protocol in protocol.h.  Commands run in the order given:
+//
+//   spectro_cli [-d /dev/ttyACM0] [-t timeout_ms] command [args] ...
+//     ping                 protocol version, modes, FFT size, ADC rate
+//     mode N               switch to mode N (see enum mode in spectro.h)
+//     fft N                FFT size; the device only accepts its build's
+//     rate HZ              ADC rate, prints the rate achieved
+//     view time|freq       time or frequency plot
+//     continuous 0|1
+//     trigger              capture and draw one frame
+//     samples FILE         last capture, one sample per line
+//     spectrum FILE        last spectrum, "channel bin value" per line
+//     stats                readings of the last frame
+//     timing               frames drawn and the per-stage times of the last
+//     bench N              N triggers back to back: request latency and fps
+//     mask FIRST:LAST:DB   limit bins FIRST to LAST to DB dBFS ("inf" for none)
+//     arm                  clear a mask hit and resume continuous captures
+//     maskstat             mask hits and the worst violation of the last
+//     watch FILE           wait for a mask hit and write its spectrum as for
+//                          spectrum; use with continuous 1 and a long -t
+//     period US            time between continuous captures, 0 for back to back
+//     tasks                runs, overruns and deferrals of the main loop's tasks
+//     columns max|mean|rms how a display column sums up its bins
+//     oversample 1|4|16    raw conversions averaged per sample in 12 bit mode;
+//                          4 and 16 need a build without PACKED_SAMPLES
+//     hold off|peak|max|min[:DECAY]
+//                          spectrum hold trace; peak and min move by DECAY a frame (0.9)
+//     db linear|TOP:RANGE  linear spectrum, or dB from TOP dBFS down RANGE dB
+//     record 0|1           start (switching to record mode) or stop streaming to flash
+//     recstat              length, size and losses of the current or last recording
+//     readrec FILE         the newest recording from flash, one sample per line
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "recorder.h"
+#include "spectro.h"
+
+#define MAX_REPLY 65535
+
+static int timeout_ms = 2000;
+static uint8_t reply_buf[MAX_REPLY];
+
+static const char * stage_labels[N_STAGES] = {"capture", "print", "fft", "plot", "label", "display"};
+static const char * task_labels[N_TASKS] = {"record", "capture", "analyse", "draw", "flush", "print", "ui"};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int open_port(const char * path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        // CDC ignores the baud rate, but the line discipline must not touch the bytes
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+// Waits for a frame for cmd, skipping the device's text output and any
+// other frames.  Returns its status, or -1 on timeout.
+static int wait_for(int fd, uint8_t cmd, uint16_t * reply_len) {
+    struct proto_parser parser;
+    proto_parser_init(&parser, PROTO_SYNC_REPLY, reply_buf, MAX_REPLY);
+    double deadline = now_s() + timeout_ms / 1e3;
+    uint8_t buf[4096];
+    while (true) {
+        int left_ms = (int)((deadline - now_s()) * 1e3);
+        if (left_ms <= 0) { break; }
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, left_ms) <= 0) { continue; }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) { break; }
+        for (ssize_t i=0; i < n; i++) {
+            if (proto_feed(&parser, buf[i]) == 1 && parser.cmd == cmd) {
+                *reply_len = parser.len;
+                return parser.status;
+            }
+        }
+    }
+    fprintf(stderr, "no reply to command 0x%02x\n", cmd);
+    return -1;
+}
+
+// Sends one request and waits for its reply.  Returns the reply's status,
+// or -1 on timeout or a write error.
+static int request(int fd, uint8_t cmd, const uint8_t * payload, uint16_t len, uint16_t * reply_len) {
+    uint8_t frame[PROTO_HEADER + PROTO_MAX_REQUEST + 1];
+    uint8_t crc = proto_header(frame, PROTO_SYNC_REQUEST, cmd, 0, len);
+    memcpy(frame + PROTO_HEADER, payload, len);
+    frame[PROTO_HEADER + len] = proto_crc8(crc, payload, len);
+    if (write(fd, frame, PROTO_HEADER + len + 1) != PROTO_HEADER + len + 1) {
+        fprintf(stderr, "write failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return wait_for(fd, cmd, reply_len);
+}
+
+static int check_status(const char * what, int status) {
+    static const char * names[] = {"ok", "bad command", "bad length", "bad value", "unsupported"};
+    if (status == STATUS_OK) { return 0; }
+    if (status > 0) {
+        fprintf(stderr, "%s: %s\n", what, status <= STATUS_UNSUPPORTED ? names[status] : "unknown status");
+    }
+    return 1;
+}
+
+static int write_samples(const char * path, uint16_t len) {
+    FILE * f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "could not write %s\n", path);
+        return 1;
+    }
+    int width = reply_buf[0] > 8 ? 2 : 1;
+    for (int i=1; i + width <= len; i += width) {
+        fprintf(f, "%d\n", width == 2 ? proto_get_u16(reply_buf + i) : reply_buf[i]);
+    }
+    fclose(f);
+    printf("%d samples of %d bits to %s\n", (len - 1) / width, reply_buf[0], path);
+    return 0;
+}
+
+// Bins of nch channels starting at bins, as "channel bin value" lines.
+static int write_spectrum(const char * path, const uint8_t * bins, int nch, uint16_t len) {
+    FILE * f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "could not write %s\n", path);
+        return 1;
+    }
+    int nbins = len / nch;
+    for (int c=0; c < nch; c++) {
+        for (int i=0; i < nbins; i++) { fprintf(f, "%d %d %d\n", c, i, bins[c*nbins + i]); }
+    }
+    fclose(f);
+    printf("%d channel(s) of %d bins to %s\n", nch, nbins, path);
+    return 0;
+}
+
+static void print_stats(void) {
+    const uint8_t * s = reply_buf;
+    printf("rate %u S/s, %d bits, mode %d, %d channel(s)\n", proto_get_u32(s), s[4], s[5], s[6]);
+    printf("peak bin %u, %g Hz\n", proto_get_u32(s + 8), proto_get_f32(s + 12));
+    printf("counter %g Hz, fundamental %g Hz\n", proto_get_f32(s + 16), proto_get_f32(s + 20));
+    printf("THD %g%%, THD+N %g%%, SINAD %g dB\n", 100 * proto_get_f32(s + 24), 100 * proto_get_f32(s + 28),
+           proto_get_f32(s + 32));
+    printf("mean %.4f V, RMS %.4f V, %.4f Vpp, crest factor %.3f\n", proto_get_f32(s + 36), proto_get_f32(s + 40),
+           proto_get_f32(s + 44), proto_get_f32(s + 48));
+}
+
+static void print_mask(void) {
+    const uint8_t * s = reply_buf;
+    printf("%s; %u of %u spectra hit, last checked %u bins over\n", s[0] ? "tripped" : "armed",
+           proto_get_u32(s + 8), proto_get_u32(s + 4), proto_get_u32(s + 12));
+    if (proto_get_u32(s + 8)) { printf("worst %.1f dB over at bin %u\n", proto_get_f32(s + 16), proto_get_u16(s + 2)); }
+}
+
+static void print_tasks(uint16_t len) {
+    printf("%-8s %8s %8s %8s %8s %8s %8s\n", "task", "runs", "overruns", "deferred", "forced", "max us", "last us");
+    for (int t=0; t < reply_buf[0] && 4 + (t+1) * PROTO_TASK_LEN <= len; t++) {
+        const uint8_t * s = reply_buf + 4 + t * PROTO_TASK_LEN;
+        printf("%-8s", t < N_TASKS ? task_labels[t] : "?");
+        for (int v=0; v < PROTO_TASK_LEN/4; v++) { printf(" %8u", proto_get_u32(s + 4*v)); }
+        printf("\n");
+    }
+}
+
+static void print_record(void) {
+    const uint8_t * s = reply_buf;
+    const uint32_t rate = proto_get_u32(s + 4), n = proto_get_u32(s + 8), bytes = proto_get_u32(s + 20);
+    printf("%s at %u S/s: %u samples (%.2f s), %u lost\n", s[0] ? "recording" : "stopped", rate, n,
+           rate ? (double)n / rate : 0., proto_get_u32(s + 12));
+    printf("%u blocks, %u bytes in %u sectors, %.2f bits a sample\n", proto_get_u32(s + 16), bytes,
+           proto_get_u32(s + 24), n ? 8. * bytes / n : 0.);
+}
+
+// Fetches the newest recording's sectors in order, then decodes them as
+// though they were the device's flash.
+static int read_recording(int fd, const char * path) {
+    uint8_t payload[4];
+    uint16_t len;
+    uint8_t * image = NULL;
+    uint32_t n = 0;
+    for (;;) {
+        proto_put_u32(payload, n);
+        int status = request(fd, CMD_READ_RECORD, payload, 4, &len);
+        if (status == STATUS_BAD_VALUE) { break; }
+        if (check_status("readrec", status) || len != RECORD_SECTOR) {
+            free(image);
+            return 1;
+        }
+        image = realloc(image, (n + 1) * RECORD_SECTOR);
+        memcpy(image + n++ * RECORD_SECTOR, reply_buf, RECORD_SECTOR);
+    }
+    if (n == 0) {
+        fprintf(stderr, "readrec: no recording (or one still going)\n");
+        return 1;
+    }
+    const struct flash_ops flash = {n, image, NULL, NULL};  // only read
+
+    FILE * f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "could not write %s\n", path);
+        free(image);
+        return 1;
+    }
+    struct record_reader rd;
+    record_reader_open(&rd, &flash);
+    static uint8_t block[RECORD_MAX_BLOCK];
+    uint32_t skipped, pos = 0, lost = 0;
+    int got;
+    while ((got = record_read(&rd, block, RECORD_MAX_BLOCK, &skipped)) > 0) {
+        if (skipped) { printf("%u samples lost at %u\n", skipped, pos); }
+        pos += skipped;
+        lost += skipped;
+        for (int i=0; i < got; i++) { fprintf(f, "%d\n", block[i]); }
+        pos += got;
+    }
+    fclose(f);
+    free(image);
+    if (got < 0) { fprintf(stderr, "readrec: damaged block after sample %u\n", pos); }
+    printf("recording %u at %u S/s: %u samples, %u lost, from %u sectors to %s\n", rd.extent.recording,
+           rd.extent.rate, pos - lost, lost, n, path);
+    return got < 0;
+}
+
+static int bench(int fd, int n) {
+    uint16_t len;
+    double lat_min = 1e9, lat_max = 0, lat_sum = 0;
+    uint64_t device_us = 0;
+    double t_start = now_s();
+    for (int i=0; i < n; i++) {
+        double t0 = now_s();
+        if (check_status("trigger", request(fd, CMD_TRIGGER, NULL, 0, &len))) { return 1; }
+        double lat = now_s() - t0;
+        lat_sum += lat;
+        if (lat < lat_min) { lat_min = lat; }
+        if (lat > lat_max) { lat_max = lat; }
+        if (len >= 8) { device_us += proto_get_u32(reply_buf + 4); }
+    }
+    double elapsed = now_s() - t_start;
+    printf("%d frames in %.3f s: %.1f frames/s\n", n, elapsed, n / elapsed);
+    printf("request latency ms: min %.2f mean %.2f max %.2f; device frame %.2f ms\n",
+           lat_min * 1e3, lat_sum / n * 1e3, lat_max * 1e3, device_us / 1e3 / n);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: spectro_cli [-d device] [-t timeout_ms] command [args] ...\n"
+                    "  ping | mode N | fft N | rate HZ | view time|freq | continuous 0|1\n"
+                    "  trigger | samples FILE | spectrum FILE | stats | timing | bench N\n"
+                    "  mask FIRST:LAST:DB | arm | maskstat | watch FILE | period US | tasks\n"
+                    "  columns max|mean|rms | oversample 1|4|16 | hold off|peak|max|min[:DECAY]\n"
+                    "  db linear|TOP:RANGE | record 0|1 | recstat | readrec FILE\n");
+}
+
+int main(int argc, char ** argv) {
+    const char * device = "/dev/ttyACM0";
+    int opt;
+    while ((opt = getopt(argc, argv, "d:t:")) != -1) {
+        switch (opt) {
+            case 'd': device = optarg; break;
+            case 't': timeout_ms = atoi(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    int fd = open_port(device);
+    if (fd < 0) { return 1; }
+
+    int ret = 0;
+    for (int i=optind; i < argc && ret == 0; i++) {
+        const char * cmd = argv[i];
+        const char * arg = i + 1 < argc ? argv[i + 1] : NULL;
+        uint8_t payload[PROTO_MAX_REQUEST];
+        uint16_t len = 0;
+
+        if (!strcmp(cmd, "ping")) {
+            ret = check_status(cmd, request(fd, CMD_PING, NULL, 0, &len));
+            if (!ret) {
+                printf("protocol %d, %d modes, %d points, ADC %u S/s\n", reply_buf[0], reply_buf[1],
+                       proto_get_u16(reply_buf + 2), proto_get_u32(reply_buf + 4));
+            }
+        } else if (!strcmp(cmd, "trigger")) {
+            ret = check_status(cmd, request(fd, CMD_TRIGGER, NULL, 0, &len));
+            if (!ret) { printf("frame %u, %u us\n", proto_get_u32(reply_buf), proto_get_u32(reply_buf + 4)); }
+        } else if (!strcmp(cmd, "stats")) {
+            ret = check_status(cmd, request(fd, CMD_GET_STATS, NULL, 0, &len));
+            if (!ret) { print_stats(); }
+        } else if (!strcmp(cmd, "timing")) {
+            ret = check_status(cmd, request(fd, CMD_GET_TIMING, NULL, 0, &len));
+            if (!ret) {
+                printf("%u frames;", proto_get_u32(reply_buf));
+                for (int s=0; s < N_STAGES && 4 + 4*s + 4 <= len; s++) {
+                    printf(" %s %u us", stage_labels[s], proto_get_u32(reply_buf + 4 + 4*s));
+                }
+                printf("\n");
+            }
+        } else if (!strcmp(cmd, "tasks")) {
+            ret = check_status(cmd, request(fd, CMD_GET_TASKS, NULL, 0, &len));
+            if (!ret) { print_tasks(len); }
+        } else if (!strcmp(cmd, "arm")) {
+            ret = check_status(cmd, request(fd, CMD_ARM_MASK, NULL, 0, &len));
+        } else if (!strcmp(cmd, "maskstat")) {
+            ret = check_status(cmd, request(fd, CMD_GET_MASK, NULL, 0, &len));
+            if (!ret) { print_mask(); }
+        } else if (!strcmp(cmd, "recstat")) {
+            ret = check_status(cmd, request(fd, CMD_GET_RECORD, NULL, 0, &len));
+            if (!ret) { print_record(); }
+        } else if (!arg) {
+            fprintf(stderr, "%s needs an argument\n", cmd);
+            ret = 2;
+        } else {
+            i++;
+            if (!strcmp(cmd, "mode")) {
+                payload[0] = atoi(arg);
+                ret = check_status(cmd, request(fd, CMD_SET_MODE, payload, 1, &len));
+            } else if (!strcmp(cmd, "fft")) {
+                proto_put_u16(payload, atoi(arg));
+                int status = request(fd, CMD_SET_FFT_SIZE, payload, 2, &len);
+                if (status == STATUS_UNSUPPORTED) {
+                    fprintf(stderr, "fft: device is built for %d points\n", proto_get_u16(reply_buf));
+                }
+                ret = check_status(cmd, status);
+            } else if (!strcmp(cmd, "rate")) {
+                proto_put_u32(payload, strtoul(arg, NULL, 0));
+                ret = check_status(cmd, request(fd, CMD_SET_RATE, payload, 4, &len));
+                if (!ret) { printf("ADC rate %u S/s\n", proto_get_u32(reply_buf)); }
+            } else if (!strcmp(cmd, "view")) {
+                payload[0] = !strcmp(arg, "freq");
+                ret = check_status(cmd, request(fd, CMD_SET_VIEW, payload, 1, &len));
+            } else if (!strcmp(cmd, "continuous")) {
+                payload[0] = atoi(arg) != 0;
+                ret = check_status(cmd, request(fd, CMD_SET_CONTINUOUS, payload, 1, &len));
+            } else if (!strcmp(cmd, "samples")) {
+                ret = check_status(cmd, request(fd, CMD_GET_SAMPLES, NULL, 0, &len));
+                if (!ret) { ret = write_samples(arg, len); }
+            } else if (!strcmp(cmd, "spectrum")) {
+                ret = check_status(cmd, request(fd, CMD_GET_SPECTRUM, NULL, 0, &len));
+                if (!ret) {
+                    int nch = reply_buf[0] ? reply_buf[0] : 1;
+                    ret = write_spectrum(arg, reply_buf + 1, nch, len - 1);
+                }
+            } else if (!strcmp(cmd, "mask")) {
+                unsigned first, last;
+                float db;
+                if (sscanf(arg, "%u:%u:%f", &first, &last, &db) != 3) {
+                    fprintf(stderr, "mask: expected FIRST:LAST:DB\n");
+                    ret = 2;
+                } else {
+                    proto_put_u16(payload, first);
+                    proto_put_u16(payload + 2, last);
+                    proto_put_f32(payload + 4, db);
+                    ret = check_status(cmd, request(fd, CMD_SET_MASK, payload, 8, &len));
+                }
+            } else if (!strcmp(cmd, "columns")) {
+                static const char * names[N_REDUCE] = {"max", "mean", "rms"};
+                payload[0] = N_REDUCE;
+                for (int r=0; r < N_REDUCE; r++) {
+                    if (!strcmp(arg, names[r])) { payload[0] = r; }
+                }
+                ret = check_status(cmd, request(fd, CMD_SET_COLUMNS, payload, 1, &len));
+            } else if (!strcmp(cmd, "oversample")) {
+                payload[0] = atoi(arg) > 16 ? 0 : atoi(arg);  // the device refuses 0
+                ret = check_status(cmd, request(fd, CMD_SET_OVERSAMPLE, payload, 1, &len));
+            } else if (!strcmp(cmd, "hold")) {
+                static const char * names[N_HOLD_MODES] = {"off", "peak", "max", "min"};
+                const char * colon = strchr(arg, ':');
+                const size_t n = colon ? (size_t)(colon - arg) : strlen(arg);
+                payload[0] = N_HOLD_MODES;
+                for (int h=0; h < N_HOLD_MODES; h++) {
+                    if (strlen(names[h]) == n && !strncmp(arg, names[h], n)) { payload[0] = h; }
+                }
+                proto_put_f32(payload + 1, colon ? atof(colon + 1) : 0.9);
+                ret = check_status(cmd, request(fd, CMD_SET_HOLD, payload, 5, &len));
+            } else if (!strcmp(cmd, "db")) {
+                float top = 0, range = 80;
+                payload[0] = strcmp(arg, "linear") != 0;
+                if (payload[0] && sscanf(arg, "%f:%f", &top, &range) != 2) {
+                    fprintf(stderr, "db: expected linear or TOP:RANGE\n");
+                    ret = 2;
+                } else {
+                    proto_put_f32(payload + 1, top);
+                    proto_put_f32(payload + 5, range);
+                    ret = check_status(cmd, request(fd, CMD_SET_DB, payload, 9, &len));
+                }
+            } else if (!strcmp(cmd, "period")) {
+                proto_put_u32(payload, strtoul(arg, NULL, 0));
+                ret = check_status(cmd, request(fd, CMD_SET_PERIOD, payload, 4, &len));
+            } else if (!strcmp(cmd, "watch")) {
+                ret = check_status(cmd, wait_for(fd, CMD_MASK_HIT, &len));
+                if (!ret) {
+                    printf("frame %u: %u bins over, worst %.1f dB at bin %u\n", proto_get_u32(reply_buf),
+                           proto_get_u32(reply_buf + 4), proto_get_f32(reply_buf + 10), proto_get_u16(reply_buf + 8));
+                    ret = write_spectrum(arg, reply_buf + 14, 1, len - 14);
+                }
+            } else if (!strcmp(cmd, "record")) {
+                payload[0] = atoi(arg) != 0;
+                ret = check_status(cmd, request(fd, CMD_RECORD, payload, 1, &len));
+                if (!ret && proto_get_u32(reply_buf)) { printf("recording at %u S/s\n", proto_get_u32(reply_buf)); }
+            } else if (!strcmp(cmd, "readrec")) {
+                ret = read_recording(fd, arg);
+            } else if (!strcmp(cmd, "bench")) {
+                ret = bench(fd, atoi(arg) > 0 ? atoi(arg) : 1);
+            } else {
+                fprintf(stderr, "unknown command %s\n", cmd);
+                usage();
+                ret = 2;
+            }
+        }
+    }
+
+    close(fd);
+    return ret;
+}
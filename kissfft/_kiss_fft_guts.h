@@ -18,6 +18,24 @@
 #include "kiss_fft_log.h"
 #include <limits.h>
 
+/* x86 builds of the float fft can use SSE2/AVX2 butterflies, if the cpu
+   has them.  Define KISS_FFT_NO_X86 to leave them out. */
+#if !defined(FIXED_POINT) && !defined(USE_SIMD) && !defined(KISS_FFT_NO_X86) \
+    && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define KISS_FFT_X86 1
+#endif
+
+/* OpenMP builds run a transform of more than KISS_FFT_GRAIN points as tasks
+   on the OpenMP threads: its sub-fft's down to that size, and each stage's
+   butterflies in blocks of about that many points; see kf_work.  Tasks
+   need OpenMP 3.0, and older ones split only the first stage. */
+#if defined(_OPENMP) && _OPENMP >= 200805
+# define KISS_FFT_TASKS 1
+#endif
+#ifndef KISS_FFT_GRAIN
+#define KISS_FFT_GRAIN 8192
+#endif
+
 #define MAXFACTORS 32
 /* e.g. an fft of length 128 has 4 factors
  as far as kissfft is concerned
@@ -27,10 +45,44 @@
 struct kiss_fft_state{
     int nfft;
     int inverse;
+    int engine; /* KISS_FFT_RECURSIVE or KISS_FFT_STOCKHAM */
+    int simd; /* the vector butterflies in use, 0 for none; see _kiss_fft_x86.h */
     int factors[2*MAXFACTORS];
+    /* a table per stage, in the order of factors.  A stage of radix p
+       over m-point sub-fft's holds (p-1)*m twiddles, w^(q*u*fstride) for
+       u=0..m-1 and q=1..p-1 in that order, so its butterfly reads them
+       straight through; then the p roots of unity w^(q*m*fstride).
+       w is exp(-2*pi*i/nfft), conjugated for an inverse fft. */
     kiss_fft_cpx twiddles[1];
 };
 
+/* The batched transforms run about this many bytes of transforms at once,
+   interleaved, in kf_batch_work; with the buffer it ping-pongs with, that
+   should stay in the L1 cache. */
+#ifndef KISS_FFT_BATCH_BYTES
+#define KISS_FFT_BATCH_BYTES 16384
+#endif
+
+/* shared between kiss_fft.c and kiss_fftr.c, but kept out of the shared
+   library's exports */
+#if defined(__GNUC__) && !defined(_WIN32)
+# define KISS_FFT_INTERNAL __attribute__ ((visibility ("hidden")))
+#else
+# define KISS_FFT_INTERNAL
+#endif
+
+/* for kiss_fft_batch and kiss_fftr_batch: how many transforms of st make a
+   group, and the group's transform, from buf (nb*nfft points, point k of
+   transform b at [k*nb+b]) using tmp as well; returns buf or tmp, whichever
+   holds the result, in the same layout */
+KISS_FFT_INTERNAL size_t kf_batch_size(const kiss_fft_cfg st);
+KISS_FFT_INTERNAL kiss_fft_cpx * kf_batch_work(const kiss_fft_cfg st,kiss_fft_cpx * buf,kiss_fft_cpx * tmp,size_t nb);
+/* and runs group(arg,buf,k,n) over the groups, transforms k to k+n-1, with
+   buf for their 2*nb*nfft points; in OpenMP builds the groups share out
+   among the threads, each with its own buf */
+KISS_FFT_INTERNAL void kf_batch_groups(const kiss_fft_cfg st,int howmany,
+        void (*group)(void * arg,kiss_fft_cpx * buf,int k,int n),void * arg);
+
 /*
   Explanation of macros dealing with complex math:
 
@@ -152,9 +204,11 @@ struct kiss_fft_state{
 
 #ifdef KISS_FFT_USE_ALLOCA
 // define this to allow use of alloca instead of malloc for temporary buffers
-// Temporary buffers are used in two case:
+// Temporary buffers are used in four cases:
 // 1. FFT sizes that have "bad" factors. i.e. not 2,3 and 5
 // 2. "in-place" FFTs.  Notice the quotes, since kissfft does not really do an in-place transform.
+// 3. the KISS_FFT_STOCKHAM engine, which needs a second nfft buffer.
+// 4. the batched transforms, which gather a group of them into a buffer.
 #include <alloca.h>
 #define  KISS_FFT_TMP_ALLOC(nbytes) alloca(nbytes)
 #define  KISS_FFT_TMP_FREE(ptr)
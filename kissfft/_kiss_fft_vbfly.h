@@ -0,0 +1,441 @@
+/*
+ *  Copyright (c) 2003-2010, Mark Borgerding. All rights reserved.
+ *  This file is part of KISS FFT - https://github.com/mborgerding/kissfft
+ *
+ *  SPDX-License-Identifier: BSD-3-Clause
+ *  See COPYING file for more information.
+ */
+
+/* _kiss_fft_vbfly.h
+   The vector butterflies, included by _kiss_fft_x86.h once per instruction
+   set with the KF_V macros it describes, so there is no include guard.
+
+   Each kf_vbflyP_n does n <= KF_VN adjacent butterflies of radix P, reading
+   in[q*is] and writing out[q*os] with the twiddles w[q-1] already in
+   vectors.  They are always inlined, so that the loops' calls with
+   n == KF_VN lose the partial loads and stores; the last, short, call keeps
+   them.  kf_vbflyP drives them for the recursive engine, where the lanes
+   are consecutive u's, each with its own twiddles, and kf_vsbflyP for the
+   Stockham one, where they are consecutive j's sharing the u's. */
+
+#define KF_VINLINE static inline __attribute__((always_inline)) KF_VTARGET
+
+/* a times -i, or times i with rot=KF_VSIGNS(-0.f,0.f), as KF_ROT does */
+#define KF_VROT(a,rot) KF_VXOR(KF_VSWAP(a),rot)
+
+KF_VINLINE void KF_VNAME(kf_vbfly2_n)(
+        kiss_fft_cpx * out,
+        size_t os,
+        const kiss_fft_cpx * in,
+        size_t is,
+        const KF_V * w,
+        int n
+        )
+{
+    const KF_V a = KF_VLOAD(in,n);
+    const KF_V t = KF_VCMUL(KF_VLOAD(in+is,n),w[0]);
+    KF_VSTORE(out+os,KF_VSUB(a,t),n);
+    KF_VSTORE(out,KF_VADD(a,t),n);
+}
+
+KF_VINLINE void KF_VNAME(kf_vbfly4_n)(
+        kiss_fft_cpx * out,
+        size_t os,
+        const kiss_fft_cpx * in,
+        size_t is,
+        const KF_V * w,
+        KF_V rot,
+        int n
+        )
+{
+    KF_V x0,s0,s1,s2,s3,s4,s5;
+    x0 = KF_VLOAD(in,n);
+    s0 = KF_VCMUL(KF_VLOAD(in+is,n),w[0]);
+    s1 = KF_VCMUL(KF_VLOAD(in+2*is,n),w[1]);
+    s2 = KF_VCMUL(KF_VLOAD(in+3*is,n),w[2]);
+
+    s5 = KF_VSUB(x0,s1);
+    x0 = KF_VADD(x0,s1);
+    s3 = KF_VADD(s0,s2);
+    s4 = KF_VROT(KF_VSUB(s0,s2),rot);
+    KF_VSTORE(out+2*os,KF_VSUB(x0,s3),n);
+    KF_VSTORE(out,KF_VADD(x0,s3),n);
+    KF_VSTORE(out+os,KF_VADD(s5,s4),n);
+    KF_VSTORE(out+3*os,KF_VSUB(s5,s4),n);
+}
+
+KF_VINLINE void KF_VNAME(kf_vbfly3_n)(
+        kiss_fft_cpx * out,
+        size_t os,
+        const kiss_fft_cpx * in,
+        size_t is,
+        const KF_V * w,
+        KF_V epi3,
+        int n
+        )
+{
+    const KF_V rot = KF_VSIGNS(0.f,-0.f);
+    KF_V x0,y1,s0,s1,s2,s3;
+    x0 = KF_VLOAD(in,n);
+    s1 = KF_VCMUL(KF_VLOAD(in+is,n),w[0]);
+    s2 = KF_VCMUL(KF_VLOAD(in+2*is,n),w[1]);
+
+    s3 = KF_VADD(s1,s2);
+    s0 = KF_VSUB(s1,s2);
+    y1 = KF_VSUB(x0,KF_VMUL(s3,KF_VSET1(.5f)));
+    s0 = KF_VROT(KF_VMUL(s0,epi3),rot);
+
+    KF_VSTORE(out,KF_VADD(x0,s3),n);
+    KF_VSTORE(out+2*os,KF_VADD(y1,s0),n);
+    KF_VSTORE(out+os,KF_VSUB(y1,s0),n);
+}
+
+KF_VINLINE void KF_VNAME(kf_vbfly5_n)(
+        kiss_fft_cpx * out,
+        size_t os,
+        const kiss_fft_cpx * in,
+        size_t is,
+        const KF_V * w,
+        const KF_V * y, /* ya.r, ya.i, yb.r, yb.i */
+        int n
+        )
+{
+    const KF_V rot = KF_VSIGNS(0.f,-0.f);
+    KF_V s0,s1,s2,s3,s4,s5,s6,s7,s8,s9,s10,s11,s12;
+    s0 = KF_VLOAD(in,n);
+    s1 = KF_VCMUL(KF_VLOAD(in+is,n),w[0]);
+    s2 = KF_VCMUL(KF_VLOAD(in+2*is,n),w[1]);
+    s3 = KF_VCMUL(KF_VLOAD(in+3*is,n),w[2]);
+    s4 = KF_VCMUL(KF_VLOAD(in+4*is,n),w[3]);
+
+    s7 = KF_VADD(s1,s4);
+    s10 = KF_VSUB(s1,s4);
+    s8 = KF_VADD(s2,s3);
+    s9 = KF_VSUB(s2,s3);
+
+    KF_VSTORE(out,KF_VADD(s0,KF_VADD(s7,s8)),n);
+
+    s5 = KF_VADD(KF_VADD(s0,KF_VMUL(s7,y[0])),KF_VMUL(s8,y[2]));
+    s6 = KF_VROT(KF_VADD(KF_VMUL(s10,y[1]),KF_VMUL(s9,y[3])),rot);
+    KF_VSTORE(out+os,KF_VSUB(s5,s6),n);
+    KF_VSTORE(out+4*os,KF_VADD(s5,s6),n);
+
+    s11 = KF_VADD(KF_VADD(s0,KF_VMUL(s7,y[2])),KF_VMUL(s8,y[0]));
+    s12 = KF_VROT(KF_VSUB(KF_VMUL(s9,y[1]),KF_VMUL(s10,y[3])),rot);
+    KF_VSTORE(out+2*os,KF_VADD(s11,s12),n);
+    KF_VSTORE(out+3*os,KF_VSUB(s11,s12),n);
+}
+
+/* KF_DFT8, a vector at a time; w is NULL when the twiddles are all 1 */
+KF_VINLINE void KF_VNAME(kf_vbfly8_n)(
+        kiss_fft_cpx * out,
+        size_t os,
+        const kiss_fft_cpx * in,
+        size_t is,
+        const KF_V * w,
+        KF_V rot,
+        KF_V h,
+        int n
+        )
+{
+    KF_V x[8],e0,e1,e2,e3,o0,o1,o2,o3,t0,t1,t2,t3;
+    int q;
+    x[0] = KF_VLOAD(in,n);
+    for (q=1;q<8;++q) {
+        x[q] = KF_VLOAD(in+q*is,n);
+        if (w)
+            x[q] = KF_VCMUL(x[q],w[q-1]);
+    }
+
+    t0 = KF_VADD(x[0],x[4]);
+    t1 = KF_VSUB(x[0],x[4]);
+    t2 = KF_VADD(x[2],x[6]);
+    t3 = KF_VROT(KF_VSUB(x[2],x[6]),rot);
+    e0 = KF_VADD(t0,t2);
+    e2 = KF_VSUB(t0,t2);
+    e1 = KF_VADD(t1,t3);
+    e3 = KF_VSUB(t1,t3);
+    t0 = KF_VADD(x[1],x[5]);
+    t1 = KF_VSUB(x[1],x[5]);
+    t2 = KF_VADD(x[3],x[7]);
+    t3 = KF_VROT(KF_VSUB(x[3],x[7]),rot);
+    o0 = KF_VADD(t0,t2);
+    o2 = KF_VROT(KF_VSUB(t0,t2),rot);
+    t0 = KF_VADD(t1,t3);
+    t2 = KF_VSUB(t1,t3);
+    o1 = KF_VMUL(KF_VADD(t0,KF_VROT(t0,rot)),h);
+    t3 = KF_VMUL(KF_VADD(t2,KF_VROT(t2,rot)),h);
+    o3 = KF_VROT(t3,rot);
+
+    KF_VSTORE(out,KF_VADD(e0,o0),n);
+    KF_VSTORE(out+4*os,KF_VSUB(e0,o0),n);
+    KF_VSTORE(out+os,KF_VADD(e1,o1),n);
+    KF_VSTORE(out+5*os,KF_VSUB(e1,o1),n);
+    KF_VSTORE(out+2*os,KF_VADD(e2,o2),n);
+    KF_VSTORE(out+6*os,KF_VSUB(e2,o2),n);
+    KF_VSTORE(out+3*os,KF_VADD(e3,o3),n);
+    KF_VSTORE(out+7*os,KF_VSUB(e3,o3),n);
+}
+
+/* the recursive engine's stages, in place over Fout, for u0 <= u < u1 */
+
+static KF_VTARGET void KF_VNAME(kf_vbfly2)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    KF_V w[1];
+    int u;
+    for (u=u0;u+KF_VN<=u1;u+=KF_VN) {
+        w[0] = KF_VLOAD(tw+u,KF_VN);
+        KF_VNAME(kf_vbfly2_n)(Fout+u,m,Fout+u,m,w,KF_VN);
+    }
+    if (u<u1) {
+        w[0] = KF_VLOAD(tw+u,u1-u);
+        KF_VNAME(kf_vbfly2_n)(Fout+u,m,Fout+u,m,w,u1-u);
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vbfly4)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    const KF_V rot = st->inverse ? KF_VSIGNS(-0.f,0.f) : KF_VSIGNS(0.f,-0.f);
+    KF_V w[3];
+    int u,q;
+    for (u=u0;u+KF_VN<=u1;u+=KF_VN) {
+        for (q=0;q<3;++q)
+            w[q] = KF_VTW(tw+3*u+q,3,KF_VN);
+        KF_VNAME(kf_vbfly4_n)(Fout+u,m,Fout+u,m,w,rot,KF_VN);
+    }
+    if (u<u1) {
+        for (q=0;q<3;++q)
+            w[q] = KF_VTW(tw+3*u+q,3,u1-u);
+        KF_VNAME(kf_vbfly4_n)(Fout+u,m,Fout+u,m,w,rot,u1-u);
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vbfly3)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    const KF_V epi3 = KF_VSET1(tw[2*m+1].i);
+    KF_V w[2];
+    int u,q;
+    for (u=u0;u+KF_VN<=u1;u+=KF_VN) {
+        for (q=0;q<2;++q)
+            w[q] = KF_VTW(tw+2*u+q,2,KF_VN);
+        KF_VNAME(kf_vbfly3_n)(Fout+u,m,Fout+u,m,w,epi3,KF_VN);
+    }
+    if (u<u1) {
+        for (q=0;q<2;++q)
+            w[q] = KF_VTW(tw+2*u+q,2,u1-u);
+        KF_VNAME(kf_vbfly3_n)(Fout+u,m,Fout+u,m,w,epi3,u1-u);
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vbfly5)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    KF_V w[4],y[4];
+    int u,q;
+    y[0] = KF_VSET1(tw[4*m+1].r);
+    y[1] = KF_VSET1(tw[4*m+1].i);
+    y[2] = KF_VSET1(tw[4*m+2].r);
+    y[3] = KF_VSET1(tw[4*m+2].i);
+    for (u=u0;u+KF_VN<=u1;u+=KF_VN) {
+        for (q=0;q<4;++q)
+            w[q] = KF_VTW(tw+4*u+q,4,KF_VN);
+        KF_VNAME(kf_vbfly5_n)(Fout+u,m,Fout+u,m,w,y,KF_VN);
+    }
+    if (u<u1) {
+        for (q=0;q<4;++q)
+            w[q] = KF_VTW(tw+4*u+q,4,u1-u);
+        KF_VNAME(kf_vbfly5_n)(Fout+u,m,Fout+u,m,w,y,u1-u);
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vbfly8)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    const KF_V rot = st->inverse ? KF_VSIGNS(-0.f,0.f) : KF_VSIGNS(0.f,-0.f);
+    const KF_V h = KF_VSET1(tw[7*m+1].r);
+    KF_V w[7];
+    int u,q;
+    for (u=u0;u+KF_VN<=u1;u+=KF_VN) {
+        for (q=0;q<7;++q)
+            w[q] = KF_VTW(tw+7*u+q,7,KF_VN);
+        KF_VNAME(kf_vbfly8_n)(Fout+u,m,Fout+u,m,w,rot,h,KF_VN);
+    }
+    if (u<u1) {
+        for (q=0;q<7;++q)
+            w[q] = KF_VTW(tw+7*u+q,7,u1-u);
+        KF_VNAME(kf_vbfly8_n)(Fout+u,m,Fout+u,m,w,rot,h,u1-u);
+    }
+}
+
+/* the Stockham engine's stages, from a contiguous Fin to Fout */
+
+static KF_VTARGET void KF_VNAME(kf_vsbfly2)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t mf = m*f;
+    KF_V w[1];
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 2*u*f;
+        kiss_fft_cpx * out = Fout + u*f;
+        w[0] = KF_VDUP(tw);
+        for (j=0;j+KF_VN<=f;j+=KF_VN)
+            KF_VNAME(kf_vbfly2_n)(out+j,mf,in+j,f,w,KF_VN);
+        if (j<f)
+            KF_VNAME(kf_vbfly2_n)(out+j,mf,in+j,f,w,f-j);
+        ++tw;
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vsbfly4)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        size_t m
+        )
+{
+    const KF_V rot = st->inverse ? KF_VSIGNS(-0.f,0.f) : KF_VSIGNS(0.f,-0.f);
+    const size_t mf = m*f;
+    KF_V w[3];
+    size_t u,j;
+    int q;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 4*u*f;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (q=0;q<3;++q)
+            w[q] = KF_VDUP(tw+q);
+        for (j=0;j+KF_VN<=f;j+=KF_VN)
+            KF_VNAME(kf_vbfly4_n)(out+j,mf,in+j,f,w,rot,KF_VN);
+        if (j<f)
+            KF_VNAME(kf_vbfly4_n)(out+j,mf,in+j,f,w,rot,f-j);
+        tw += 3;
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vsbfly3)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const KF_V epi3 = KF_VSET1(tw[2*m+1].i);
+    const size_t mf = m*f;
+    KF_V w[2];
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 3*u*f;
+        kiss_fft_cpx * out = Fout + u*f;
+        w[0] = KF_VDUP(tw);
+        w[1] = KF_VDUP(tw+1);
+        for (j=0;j+KF_VN<=f;j+=KF_VN)
+            KF_VNAME(kf_vbfly3_n)(out+j,mf,in+j,f,w,epi3,KF_VN);
+        if (j<f)
+            KF_VNAME(kf_vbfly3_n)(out+j,mf,in+j,f,w,epi3,f-j);
+        tw += 2;
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vsbfly5)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t mf = m*f;
+    KF_V w[4],y[4];
+    size_t u,j;
+    int q;
+    y[0] = KF_VSET1(tw[4*m+1].r);
+    y[1] = KF_VSET1(tw[4*m+1].i);
+    y[2] = KF_VSET1(tw[4*m+2].r);
+    y[3] = KF_VSET1(tw[4*m+2].i);
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 5*u*f;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (q=0;q<4;++q)
+            w[q] = KF_VDUP(tw+q);
+        for (j=0;j+KF_VN<=f;j+=KF_VN)
+            KF_VNAME(kf_vbfly5_n)(out+j,mf,in+j,f,w,y,KF_VN);
+        if (j<f)
+            KF_VNAME(kf_vbfly5_n)(out+j,mf,in+j,f,w,y,f-j);
+        tw += 4;
+    }
+}
+
+static KF_VTARGET void KF_VNAME(kf_vsbfly8)(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        size_t m
+        )
+{
+    const KF_V rot = st->inverse ? KF_VSIGNS(-0.f,0.f) : KF_VSIGNS(0.f,-0.f);
+    const KF_V h = KF_VSET1(tw[7*m+1].r);
+    const size_t mf = m*f;
+    KF_V w[7];
+    size_t u,j;
+    int q;
+
+    /* u == 0, whose twiddles are all 1 */
+    for (j=0;j+KF_VN<=f;j+=KF_VN)
+        KF_VNAME(kf_vbfly8_n)(Fout+j,mf,Fin+j,f,NULL,rot,h,KF_VN);
+    if (j<f)
+        KF_VNAME(kf_vbfly8_n)(Fout+j,mf,Fin+j,f,NULL,rot,h,f-j);
+    for (u=1;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 8*u*f;
+        kiss_fft_cpx * out = Fout + u*f;
+        tw += 7;
+        for (q=0;q<7;++q)
+            w[q] = KF_VDUP(tw+q);
+        for (j=0;j+KF_VN<=f;j+=KF_VN)
+            KF_VNAME(kf_vbfly8_n)(out+j,mf,in+j,f,w,rot,h,KF_VN);
+        if (j<f)
+            KF_VNAME(kf_vbfly8_n)(out+j,mf,in+j,f,w,rot,h,f-j);
+    }
+}
+
+#undef KF_VINLINE
+#undef KF_VROT
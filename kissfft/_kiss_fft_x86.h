@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2003-2010, Mark Borgerding. All rights reserved.
+ *  This file is part of KISS FFT - https://github.com/mborgerding/kissfft
+ *
+ *  SPDX-License-Identifier: BSD-3-Clause
+ *  See COPYING file for more information.
+ */
+
+/* _kiss_fft_x86.h
+   SSE2 and AVX2 butterflies for the float fft, included by kiss_fft.c when
+   KISS_FFT_X86 is defined.  They work on the ordinary kiss_fft_cpx layout,
+   a vector holding 2 (SSE2) or 4 (AVX2) complex points r,i,r,i,...  which
+   are the same point of consecutive sub-fft's: lane k of a radix p stage
+   handles u+k, so Fout[u+q*m] is a plain unaligned load and only the
+   twiddles, p-1 apart in the stage's table, need gathering.  A Stockham
+   stage puts lanes on consecutive j instead, which share a twiddle, and
+   that is what kiss_fft_batch's interleaved transforms run on.
+
+   Each function is compiled for its instruction set with a target
+   attribute, so no compiler flags are needed, and kiss_fft_alloc picks the
+   widest one the cpu has.  They do the scalar code's arithmetic in the same
+   order with no fused multiply-adds, so in a default build the results
+   match the scalar butterflies exactly, up to the sign of a zero. */
+
+#ifndef _kiss_fft_x86_h
+#define _kiss_fft_x86_h
+
+#include <immintrin.h>
+
+#define KF_SIMD_NONE 0
+#define KF_SIMD_SSE2 1
+#define KF_SIMD_AVX2 2
+
+/* the instruction set the vector butterflies can use on this cpu */
+static int kf_simd_level(void)
+{
+    if (sizeof(kiss_fft_scalar) != sizeof(float))
+        return KF_SIMD_NONE; /* a double build compiles them, but for floats */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return KF_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return KF_SIMD_SSE2;
+    return KF_SIMD_NONE;
+}
+
+/*
+ The butterflies are written once, in _kiss_fft_vbfly.h, against these
+ macros, and included once per instruction set:
+
+   KF_V                 : the vector type
+   KF_VN                : complex points per vector
+   KF_VNAME(f)          : f with the instruction set appended
+   KF_VLOAD(p,n)        : n <= KF_VN points from p, the rest zero
+   KF_VSTORE(p,v,n)     : the first n points of v to p
+   KF_VTW(tw,step,n)    : tw[0], tw[step], ... n twiddles
+   KF_VDUP(tw)          : tw[0] in every lane
+   KF_VSIGNS(a,b)       : a,b,a,b,... for flipping signs with KF_VXOR
+   KF_VCMUL(a,b)        : pointwise complex a*b, as C_MUL does it
+   KF_VSWAP(a)          : each point's r and i exchanged
+ * */
+
+/* SSE2 */
+#define KF_VTARGET __attribute__((target("sse2")))
+#define KF_V __m128
+#define KF_VN 2
+#define KF_VNAME(f) f##_sse2
+#define KF_VADD _mm_add_ps
+#define KF_VSUB _mm_sub_ps
+#define KF_VMUL _mm_mul_ps
+#define KF_VXOR _mm_xor_ps
+#define KF_VSET1 _mm_set1_ps
+#define KF_VSIGNS(a,b) _mm_set_ps(b,a,b,a)
+#define KF_VSWAP(a) _mm_shuffle_ps(a,a,0xB1)
+
+static inline KF_VTARGET __m128 kf_vload_sse2(const kiss_fft_cpx * p,int n)
+{
+    if (n == 2)
+        return _mm_loadu_ps((const float*)p);
+    return _mm_castpd_ps(_mm_load_sd((const double*)p));
+}
+
+static inline KF_VTARGET void kf_vstore_sse2(kiss_fft_cpx * p,__m128 v,int n)
+{
+    if (n == 2)
+        _mm_storeu_ps((float*)p,v);
+    else
+        _mm_storel_pi((__m64*)p,v);
+}
+
+static inline KF_VTARGET __m128 kf_vtw_sse2(const kiss_fft_cpx * tw,int step,int n)
+{
+    __m128 w = _mm_castpd_ps(_mm_load_sd((const double*)tw));
+    if (n == 2)
+        w = _mm_loadh_pi(w,(const __m64*)(tw+step));
+    return w;
+}
+
+static inline KF_VTARGET __m128 kf_vcmul_sse2(__m128 a,__m128 b)
+{
+    const __m128 re = _mm_mul_ps(a,_mm_shuffle_ps(b,b,0xA0));
+    const __m128 im = _mm_mul_ps(KF_VSWAP(a),_mm_shuffle_ps(b,b,0xF5));
+    return _mm_add_ps(re,_mm_xor_ps(im,KF_VSIGNS(-0.f,0.f)));
+}
+
+#define KF_VDUP(tw) _mm_castpd_ps(_mm_load1_pd((const double*)(tw)))
+#define KF_VLOAD kf_vload_sse2
+#define KF_VSTORE kf_vstore_sse2
+#define KF_VTW kf_vtw_sse2
+#define KF_VCMUL kf_vcmul_sse2
+#include "_kiss_fft_vbfly.h"
+#undef KF_VTARGET
+#undef KF_V
+#undef KF_VN
+#undef KF_VNAME
+#undef KF_VADD
+#undef KF_VSUB
+#undef KF_VMUL
+#undef KF_VXOR
+#undef KF_VSET1
+#undef KF_VSIGNS
+#undef KF_VSWAP
+#undef KF_VLOAD
+#undef KF_VSTORE
+#undef KF_VTW
+#undef KF_VDUP
+#undef KF_VCMUL
+
+/* AVX2 */
+#define KF_VTARGET __attribute__((target("avx2")))
+#define KF_V __m256
+#define KF_VN 4
+#define KF_VNAME(f) f##_avx2
+#define KF_VADD _mm256_add_ps
+#define KF_VSUB _mm256_sub_ps
+#define KF_VMUL _mm256_mul_ps
+#define KF_VXOR _mm256_xor_ps
+#define KF_VSET1 _mm256_set1_ps
+#define KF_VSIGNS(a,b) _mm256_set_ps(b,a,b,a,b,a,b,a)
+#define KF_VSWAP(a) _mm256_permute_ps(a,0xB1)
+
+/* the masks for n points are the 2*n -1's ending at kf_vmask_avx2+8 */
+static const int kf_vmask_avx2[16] = {-1,-1,-1,-1,-1,-1,-1,-1,0,0,0,0,0,0,0,0};
+
+static inline KF_VTARGET __m256 kf_vload_avx2(const kiss_fft_cpx * p,int n)
+{
+    if (n == 4)
+        return _mm256_loadu_ps((const float*)p);
+    return _mm256_maskload_ps((const float*)p,
+            _mm256_loadu_si256((const __m256i*)(kf_vmask_avx2+8-2*n)));
+}
+
+static inline KF_VTARGET void kf_vstore_avx2(kiss_fft_cpx * p,__m256 v,int n)
+{
+    if (n == 4)
+        _mm256_storeu_ps((float*)p,v);
+    else
+        _mm256_maskstore_ps((float*)p,
+                _mm256_loadu_si256((const __m256i*)(kf_vmask_avx2+8-2*n)),v);
+}
+
+static inline KF_VTARGET __m256 kf_vtw_avx2(const kiss_fft_cpx * tw,int step,int n)
+{
+    kiss_fft_cpx w[4];
+    int k;
+    if (n == 4) {
+        const __m128 lo = _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd((const double*)tw)),
+                (const __m64*)(tw+step));
+        const __m128 hi = _mm_loadh_pi(_mm_castpd_ps(_mm_load_sd((const double*)(tw+2*step))),
+                (const __m64*)(tw+3*step));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo),hi,1);
+    }
+    memset(w,0,sizeof(w));
+    for (k=0;k<n;++k)
+        w[k] = tw[k*step];
+    return _mm256_loadu_ps((const float*)w);
+}
+
+static inline KF_VTARGET __m256 kf_vcmul_avx2(__m256 a,__m256 b)
+{
+    const __m256 re = _mm256_mul_ps(a,_mm256_moveldup_ps(b));
+    const __m256 im = _mm256_mul_ps(KF_VSWAP(a),_mm256_movehdup_ps(b));
+    return _mm256_addsub_ps(re,im);
+}
+
+#define KF_VDUP(tw) _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(tw)))
+#define KF_VLOAD kf_vload_avx2
+#define KF_VSTORE kf_vstore_avx2
+#define KF_VTW kf_vtw_avx2
+#define KF_VCMUL kf_vcmul_avx2
+#include "_kiss_fft_vbfly.h"
+#undef KF_VTARGET
+#undef KF_V
+#undef KF_VN
+#undef KF_VNAME
+#undef KF_VADD
+#undef KF_VSUB
+#undef KF_VMUL
+#undef KF_VXOR
+#undef KF_VSET1
+#undef KF_VSIGNS
+#undef KF_VSWAP
+#undef KF_VLOAD
+#undef KF_VSTORE
+#undef KF_VTW
+#undef KF_VDUP
+#undef KF_VCMUL
+
+/* runs a stage's butterflies u0 <= u < u1 with vectors if it can, returning
+   0 if not: there need to be at least a vector's worth of them */
+static int kf_vbfly(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        int m,
+        int p,
+        int u0,
+        int u1
+        )
+{
+    if (st->simd >= KF_SIMD_AVX2 && u1-u0 >= 4) {
+        switch (p) {
+            case 2: kf_vbfly2_avx2(Fout,tw,m,u0,u1); return 1;
+            case 3: kf_vbfly3_avx2(Fout,tw,m,u0,u1); return 1;
+            case 4: kf_vbfly4_avx2(Fout,tw,st,m,u0,u1); return 1;
+            case 5: kf_vbfly5_avx2(Fout,tw,m,u0,u1); return 1;
+            case 8: kf_vbfly8_avx2(Fout,tw,st,m,u0,u1); return 1;
+        }
+    }
+    if (st->simd >= KF_SIMD_SSE2 && u1-u0 >= 2) {
+        switch (p) {
+            case 2: kf_vbfly2_sse2(Fout,tw,m,u0,u1); return 1;
+            case 3: kf_vbfly3_sse2(Fout,tw,m,u0,u1); return 1;
+            case 4: kf_vbfly4_sse2(Fout,tw,st,m,u0,u1); return 1;
+            case 5: kf_vbfly5_sse2(Fout,tw,m,u0,u1); return 1;
+            case 8: kf_vbfly8_sse2(Fout,tw,st,m,u0,u1); return 1;
+        }
+    }
+    return 0;
+}
+
+/* the same for a Stockham stage, which needs a vector's worth of j's */
+static int kf_vsbfly(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        int m,
+        int p
+        )
+{
+    if (st->simd >= KF_SIMD_AVX2 && f >= 4) {
+        switch (p) {
+            case 2: kf_vsbfly2_avx2(Fout,Fin,tw,f,m); return 1;
+            case 3: kf_vsbfly3_avx2(Fout,Fin,tw,f,m); return 1;
+            case 4: kf_vsbfly4_avx2(Fout,Fin,tw,st,f,m); return 1;
+            case 5: kf_vsbfly5_avx2(Fout,Fin,tw,f,m); return 1;
+            case 8: kf_vsbfly8_avx2(Fout,Fin,tw,st,f,m); return 1;
+        }
+    }
+    if (st->simd >= KF_SIMD_SSE2 && f >= 2) {
+        switch (p) {
+            case 2: kf_vsbfly2_sse2(Fout,Fin,tw,f,m); return 1;
+            case 3: kf_vsbfly3_sse2(Fout,Fin,tw,f,m); return 1;
+            case 4: kf_vsbfly4_sse2(Fout,Fin,tw,st,f,m); return 1;
+            case 5: kf_vsbfly5_sse2(Fout,Fin,tw,f,m); return 1;
+            case 8: kf_vsbfly8_sse2(Fout,Fin,tw,st,f,m); return 1;
+        }
+    }
+    return 0;
+}
+
+#endif /* _kiss_fft_x86_h */
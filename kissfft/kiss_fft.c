@@ -11,61 +11,72 @@
 /* The guts header contains all the multiplication and addition macros that are defined for
  fixed or floating point complex numbers.  It also delares the kf_ internal functions.
  */
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef KISS_FFT_X86
+#include "_kiss_fft_x86.h"
+#endif
+
+/* Each butterfly function does the butterflies u0 <= u < u1 of its stage,
+   so that a stage can be run in blocks; see kf_work. */
 
 static void kf_bfly2(
         kiss_fft_cpx * Fout,
-        const size_t fstride,
-        const kiss_fft_cfg st,
-        int m
+        const kiss_fft_cpx * tw,
+        int m,
+        int u0,
+        int u1
         )
 {
     kiss_fft_cpx * Fout2;
-    kiss_fft_cpx * tw1 = st->twiddles;
     kiss_fft_cpx t;
+    int k=u1-u0;
+    Fout += u0;
+    tw += u0;
     Fout2 = Fout + m;
     do{
         C_FIXDIV(*Fout,2); C_FIXDIV(*Fout2,2);
 
-        C_MUL (t,  *Fout2 , *tw1);
-        tw1 += fstride;
+        C_MUL (t,  *Fout2 , *tw);
+        ++tw;
         C_SUB( *Fout2 ,  *Fout , t );
         C_ADDTO( *Fout ,  t );
         ++Fout2;
         ++Fout;
-    }while (--m);
+    }while (--k);
 }
 
 static void kf_bfly4(
         kiss_fft_cpx * Fout,
-        const size_t fstride,
+        const kiss_fft_cpx * tw,
         const kiss_fft_cfg st,
-        const size_t m
+        const size_t m,
+        size_t u0,
+        size_t u1
         )
 {
-    kiss_fft_cpx *tw1,*tw2,*tw3;
     kiss_fft_cpx scratch[6];
-    size_t k=m;
+    size_t k=u1-u0;
     const size_t m2=2*m;
     const size_t m3=3*m;
 
-
-    tw3 = tw2 = tw1 = st->twiddles;
+    Fout += u0;
+    tw += 3*u0;
 
     do {
         C_FIXDIV(*Fout,4); C_FIXDIV(Fout[m],4); C_FIXDIV(Fout[m2],4); C_FIXDIV(Fout[m3],4);
 
-        C_MUL(scratch[0],Fout[m] , *tw1 );
-        C_MUL(scratch[1],Fout[m2] , *tw2 );
-        C_MUL(scratch[2],Fout[m3] , *tw3 );
+        C_MUL(scratch[0],Fout[m] , tw[0] );
+        C_MUL(scratch[1],Fout[m2] , tw[1] );
+        C_MUL(scratch[2],Fout[m3] , tw[2] );
 
         C_SUB( scratch[5] , *Fout, scratch[1] );
         C_ADDTO(*Fout, scratch[1]);
         C_ADD( scratch[3] , scratch[0] , scratch[2] );
         C_SUB( scratch[4] , scratch[0] , scratch[2] );
         C_SUB( Fout[m2], *Fout, scratch[3] );
-        tw1 += fstride;
-        tw2 += fstride*2;
-        tw3 += fstride*3;
+        tw += 3;
         C_ADDTO( *Fout , scratch[3] );
 
         if(st->inverse) {
@@ -85,30 +96,30 @@ static void kf_bfly4(
 
 static void kf_bfly3(
          kiss_fft_cpx * Fout,
-         const size_t fstride,
-         const kiss_fft_cfg st,
-         size_t m
+         const kiss_fft_cpx * tw,
+         size_t m,
+         size_t u0,
+         size_t u1
          )
 {
-     size_t k=m;
+     size_t k=u1-u0;
      const size_t m2 = 2*m;
-     kiss_fft_cpx *tw1,*tw2;
      kiss_fft_cpx scratch[5];
      kiss_fft_cpx epi3;
-     epi3 = st->twiddles[fstride*m];
+     epi3 = tw[2*m+1];
 
-     tw1=tw2=st->twiddles;
+     Fout += u0;
+     tw += 2*u0;
 
      do{
          C_FIXDIV(*Fout,3); C_FIXDIV(Fout[m],3); C_FIXDIV(Fout[m2],3);
 
-         C_MUL(scratch[1],Fout[m] , *tw1);
-         C_MUL(scratch[2],Fout[m2] , *tw2);
+         C_MUL(scratch[1],Fout[m] , tw[0]);
+         C_MUL(scratch[2],Fout[m2] , tw[1]);
 
          C_ADD(scratch[3],scratch[1],scratch[2]);
          C_SUB(scratch[0],scratch[1],scratch[2]);
-         tw1 += fstride;
-         tw2 += fstride*2;
+         tw += 2;
 
          Fout[m].r = Fout->r - HALF_OF(scratch[3].r);
          Fout[m].i = Fout->i - HALF_OF(scratch[3].i);
@@ -129,35 +140,35 @@ static void kf_bfly3(
 
 static void kf_bfly5(
         kiss_fft_cpx * Fout,
-        const size_t fstride,
-        const kiss_fft_cfg st,
-        int m
+        const kiss_fft_cpx * tw,
+        int m,
+        int u0,
+        int u1
         )
 {
     kiss_fft_cpx *Fout0,*Fout1,*Fout2,*Fout3,*Fout4;
     int u;
     kiss_fft_cpx scratch[13];
-    kiss_fft_cpx * twiddles = st->twiddles;
-    kiss_fft_cpx *tw;
     kiss_fft_cpx ya,yb;
-    ya = twiddles[fstride*m];
-    yb = twiddles[fstride*2*m];
+    ya = tw[4*m+1];
+    yb = tw[4*m+2];
+    tw += 4*u0;
 
-    Fout0=Fout;
+    Fout0=Fout+u0;
     Fout1=Fout0+m;
     Fout2=Fout0+2*m;
     Fout3=Fout0+3*m;
     Fout4=Fout0+4*m;
 
-    tw=st->twiddles;
-    for ( u=0; u<m; ++u ) {
+    for ( u=u0; u<u1; ++u ) {
         C_FIXDIV( *Fout0,5); C_FIXDIV( *Fout1,5); C_FIXDIV( *Fout2,5); C_FIXDIV( *Fout3,5); C_FIXDIV( *Fout4,5);
         scratch[0] = *Fout0;
 
-        C_MUL(scratch[1] ,*Fout1, tw[u*fstride]);
-        C_MUL(scratch[2] ,*Fout2, tw[2*u*fstride]);
-        C_MUL(scratch[3] ,*Fout3, tw[3*u*fstride]);
-        C_MUL(scratch[4] ,*Fout4, tw[4*u*fstride]);
+        C_MUL(scratch[1] ,*Fout1, tw[0]);
+        C_MUL(scratch[2] ,*Fout2, tw[1]);
+        C_MUL(scratch[3] ,*Fout3, tw[2]);
+        C_MUL(scratch[4] ,*Fout4, tw[3]);
+        tw += 4;
 
         C_ADD( scratch[7],scratch[1],scratch[4]);
         C_SUB( scratch[10],scratch[1],scratch[4]);
@@ -188,19 +199,108 @@ static void kf_bfly5(
     }
 }
 
+/* a times -i for a forward fft, times i for an inverse one */
+#define KF_ROT(res,a,inverse) \
+    do{ \
+        kiss_fft_scalar rot_r = (a).r; \
+        if (inverse) { (res).r = -(a).i; (res).i = rot_r; } \
+        else { (res).r = (a).i; (res).i = -rot_r; } \
+    }while(0)
+
+/* an 8 point DFT of x, in place, as two 4 point DFTs of the even and odd
+   points.  The odd ones are then turned by w8^k; h is sqrt(1/2), so w8
+   (w8^3 being w8 turned by -i) costs two multiplies rather than four.  A
+   macro, so that it is inlined into both engines' loops. */
+#define KF_DFT8(x,h,inverse) \
+    do{ \
+        kiss_fft_cpx e0,e1,e2,e3,o0,o1,o2,o3,t0,t1,t2,t3; \
+        C_ADD(t0,x[0],x[4]); \
+        C_SUB(t1,x[0],x[4]); \
+        C_ADD(t2,x[2],x[6]); \
+        C_SUB(t3,x[2],x[6]); \
+        KF_ROT(t3,t3,inverse); \
+        C_ADD(e0,t0,t2); \
+        C_SUB(e2,t0,t2); \
+        C_ADD(e1,t1,t3); \
+        C_SUB(e3,t1,t3); \
+        C_ADD(t0,x[1],x[5]); \
+        C_SUB(t1,x[1],x[5]); \
+        C_ADD(t2,x[3],x[7]); \
+        C_SUB(t3,x[3],x[7]); \
+        KF_ROT(t3,t3,inverse); \
+        C_ADD(o0,t0,t2); \
+        C_SUB(t2,t0,t2); \
+        KF_ROT(o2,t2,inverse); \
+        C_ADD(t0,t1,t3); \
+        C_SUB(t2,t1,t3); \
+        if (inverse) { \
+            o1.r = S_MUL(t0.r - t0.i,h); \
+            o1.i = S_MUL(t0.r + t0.i,h); \
+            t3.r = S_MUL(t2.r - t2.i,h); \
+            t3.i = S_MUL(t2.r + t2.i,h); \
+        }else{ \
+            o1.r = S_MUL(t0.r + t0.i,h); \
+            o1.i = S_MUL(t0.i - t0.r,h); \
+            t3.r = S_MUL(t2.r + t2.i,h); \
+            t3.i = S_MUL(t2.i - t2.r,h); \
+        } \
+        KF_ROT(o3,t3,inverse); \
+        C_ADD(x[0],e0,o0); \
+        C_SUB(x[4],e0,o0); \
+        C_ADD(x[1],e1,o1); \
+        C_SUB(x[5],e1,o1); \
+        C_ADD(x[2],e2,o2); \
+        C_SUB(x[6],e2,o2); \
+        C_ADD(x[3],e3,o3); \
+        C_SUB(x[7],e3,o3); \
+    }while(0)
+
+static void kf_bfly8(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        int m,
+        int u0,
+        int u1
+        )
+{
+    const kiss_fft_scalar h = tw[7*m+1].r;
+    kiss_fft_cpx x[8],t;
+    int u,q;
+
+    tw += 7*u0;
+    for ( u=u0; u<u1; ++u ) {
+        x[0] = Fout[u];
+        C_FIXDIV(x[0],8);
+        for (q=1;q<8;++q) {
+            t = Fout[u+q*m];
+            C_FIXDIV(t,8);
+            if (u)
+                C_MUL(x[q],t,tw[q-1]);
+            else
+                x[q] = t; /* the first twiddles are all 1 */
+        }
+        tw += 7;
+
+        KF_DFT8(x,h,st->inverse);
+        for (q=0;q<8;++q)
+            Fout[u+q*m] = x[q];
+    }
+}
+
 /* perform the butterfly for one stage of a mixed radix FFT */
 static void kf_bfly_generic(
         kiss_fft_cpx * Fout,
-        const size_t fstride,
-        const kiss_fft_cfg st,
+        const kiss_fft_cpx * tw,
         int m,
-        int p
+        int p,
+        int u0,
+        int u1
         )
 {
-    int u,k,q1,q;
-    kiss_fft_cpx * twiddles = st->twiddles;
+    int u,k,q1,q,r;
+    const kiss_fft_cpx * roots = tw + (p-1)*m;
     kiss_fft_cpx t;
-    int Norig = st->nfft;
 
     kiss_fft_cpx * scratch = (kiss_fft_cpx*)KISS_FFT_TMP_ALLOC(sizeof(kiss_fft_cpx)*p);
     if (scratch == NULL){
@@ -208,30 +308,63 @@ static void kf_bfly_generic(
         return;
     }
 
-    for ( u=0; u<m; ++u ) {
+    tw += (p-1)*u0;
+    for ( u=u0; u<u1; ++u ) {
+        scratch[0] = Fout[u];
+        C_FIXDIV(scratch[0],p);
         k=u;
-        for ( q1=0 ; q1<p ; ++q1 ) {
-            scratch[q1] = Fout[ k  ];
-            C_FIXDIV(scratch[q1],p);
+        for ( q=1 ; q<p ; ++q ) {
             k += m;
+            t = Fout[ k ];
+            C_FIXDIV(t,p);
+            C_MUL(scratch[q], t, tw[q-1]);
         }
+        tw += p-1;
 
+        /* what is left is a length p DFT, whose twiddles are the p roots */
         k=u;
         for ( q1=0 ; q1<p ; ++q1 ) {
-            int twidx=0;
-            Fout[ k ] = scratch[0];
+            kiss_fft_cpx sum = scratch[0];
+            r=0;
             for (q=1;q<p;++q ) {
-                twidx += fstride * k;
-                if (twidx>=Norig) twidx-=Norig;
-                C_MUL(t,scratch[q] , twiddles[twidx] );
-                C_ADDTO( Fout[ k ] ,t);
+                r += q1;
+                if (r>=p) r-=p;
+                C_MUL(t,scratch[q] , roots[r] );
+                C_ADDTO( sum ,t);
             }
+            Fout[ k ] = sum;
             k += m;
         }
     }
     KISS_FFT_TMP_FREE(scratch);
 }
 
+/* the butterflies u0 <= u < u1 of a stage of radix p over m-point sub-fft's */
+static
+void kf_bfly(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        int m,
+        int p,
+        int u0,
+        int u1
+        )
+{
+#ifdef KISS_FFT_X86
+    if (st->simd && kf_vbfly(Fout,tw,st,m,p,u0,u1))
+        return;
+#endif
+    switch (p) {
+        case 2: kf_bfly2(Fout,tw,m,u0,u1); break;
+        case 3: kf_bfly3(Fout,tw,m,u0,u1); break;
+        case 4: kf_bfly4(Fout,tw,st,m,u0,u1); break;
+        case 5: kf_bfly5(Fout,tw,m,u0,u1); break;
+        case 8: kf_bfly8(Fout,tw,st,m,u0,u1); break;
+        default: kf_bfly_generic(Fout,tw,m,p,u0,u1); break;
+    }
+}
+
 static
 void kf_work(
         kiss_fft_cpx * Fout,
@@ -239,6 +372,7 @@ void kf_work(
         const size_t fstride,
         int in_stride,
         int * factors,
+        const kiss_fft_cpx * tw,
         const kiss_fft_cfg st
         )
 {
@@ -246,27 +380,46 @@ void kf_work(
     const int p=*factors++; /* the radix  */
     const int m=*factors++; /* stage's fft length/p */
     const kiss_fft_cpx * Fout_end = Fout + p*m;
+    const kiss_fft_cpx * next_tw = tw + (p-1)*m + p; /* the next stage's table */
 
-#ifdef _OPENMP
+#ifdef KISS_FFT_TASKS
+    // in a parallel region (see kiss_fft_stride), a sub-fft bigger than
+    // the grain size runs its p sub-fft's as tasks, recursively, and then
+    // its butterflies as tasks of about KISS_FFT_GRAIN points each
+    if (p*m > KISS_FFT_GRAIN && m!=1 && omp_in_parallel())
+    {
+        int k,u,blk;
+
+        for (k=0;k<p;++k) {
+#           pragma omp task
+            kf_work( Fout +k*m, f+ fstride*in_stride*k,fstride*p,in_stride,factors,next_tw,st);
+        }
+#       pragma omp taskwait
+
+        blk = (KISS_FFT_GRAIN/p) & ~7;
+        if (blk < 8)
+            blk = 8;
+        for (u=0;u<m;u+=blk) {
+#           pragma omp task
+            kf_bfly(Fout,tw,st,m,p,u,u+blk < m ? u+blk : m);
+        }
+#       pragma omp taskwait
+        return;
+    }
+#elif defined(_OPENMP)
     // use openmp extensions at the
     // top-level (not recursive)
-    if (fstride==1 && p<=5 && m!=1)
+    if (fstride==1 && (p<=5 || p==8) && m!=1)
     {
         int k;
 
         // execute the p different work units in different threads
 #       pragma omp parallel for
         for (k=0;k<p;++k)
-            kf_work( Fout +k*m, f+ fstride*in_stride*k,fstride*p,in_stride,factors,st);
+            kf_work( Fout +k*m, f+ fstride*in_stride*k,fstride*p,in_stride,factors,next_tw,st);
         // all threads have joined by this point
 
-        switch (p) {
-            case 2: kf_bfly2(Fout,fstride,st,m); break;
-            case 3: kf_bfly3(Fout,fstride,st,m); break;
-            case 4: kf_bfly4(Fout,fstride,st,m); break;
-            case 5: kf_bfly5(Fout,fstride,st,m); break;
-            default: kf_bfly_generic(Fout,fstride,st,m,p); break;
-        }
+        kf_bfly(Fout,tw,st,m,p,0,m);
         return;
     }
 #endif
@@ -282,7 +435,7 @@ void kf_work(
             // DFT of size m*p performed by doing
             // p instances of smaller DFTs of size m,
             // each one takes a decimated version of the input
-            kf_work( Fout , f, fstride*p, in_stride, factors,st);
+            kf_work( Fout , f, fstride*p, in_stride, factors,next_tw,st);
             f += fstride*in_stride;
         }while( (Fout += m) != Fout_end );
     }
@@ -290,15 +443,424 @@ void kf_work(
     Fout=Fout_beg;
 
     // recombine the p smaller DFTs
+    kf_bfly(Fout,tw,st,m,p,0,m);
+}
+
+/*
+ The Stockham engine runs the same butterflies breadth first: a stage at a
+ time over the whole transform, innermost stage first, reading one buffer
+ and writing the other.  Before a stage of radix p over m-point sub-fft's
+ with fstride f, the p*f sub-fft's of its input are stored frequency-major,
+ element u of sub-fft j at [u*p*f + j].  Sub-fft j of the output, the
+ combination of input sub-fft's j, j+f, ... j+(p-1)*f, goes to [k*f + j].
+ Before the innermost stage (m==1) that layout is just the input, so that
+ stage reads fin directly in place of the leaf copy, and after the last
+ (f==1) it is the natural order; no permutation pass is needed.  The j's
+ of a stage share their twiddles, and each runs of f contiguous elements.
+ */
+static void kf_sbfly2(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    kiss_fft_cpx t,a,b;
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 2*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            a = in[0]; b = in[fs];
+            C_FIXDIV(a,2); C_FIXDIV(b,2);
+
+            C_MUL (t, b , *tw);
+            C_SUB( out[mf] , a , t );
+            C_ADD( out[0] , a , t );
+            in += in_stride;
+            ++out;
+        }
+        ++tw;
+    }
+}
+
+static void kf_sbfly4(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    kiss_fft_cpx scratch[6],x0,x1,x2,x3;
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 4*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            x0 = in[0]; x1 = in[fs]; x2 = in[2*fs]; x3 = in[3*fs];
+            C_FIXDIV(x0,4); C_FIXDIV(x1,4); C_FIXDIV(x2,4); C_FIXDIV(x3,4);
+
+            C_MUL(scratch[0],x1 , tw[0] );
+            C_MUL(scratch[1],x2 , tw[1] );
+            C_MUL(scratch[2],x3 , tw[2] );
+
+            C_SUB( scratch[5] , x0, scratch[1] );
+            C_ADDTO(x0, scratch[1]);
+            C_ADD( scratch[3] , scratch[0] , scratch[2] );
+            C_SUB( scratch[4] , scratch[0] , scratch[2] );
+            C_SUB( out[2*mf], x0, scratch[3] );
+            C_ADD( out[0], x0 , scratch[3] );
+
+            if(st->inverse) {
+                out[mf].r = scratch[5].r - scratch[4].i;
+                out[mf].i = scratch[5].i + scratch[4].r;
+                out[3*mf].r = scratch[5].r + scratch[4].i;
+                out[3*mf].i = scratch[5].i - scratch[4].r;
+            }else{
+                out[mf].r = scratch[5].r + scratch[4].i;
+                out[mf].i = scratch[5].i - scratch[4].r;
+                out[3*mf].r = scratch[5].r - scratch[4].i;
+                out[3*mf].i = scratch[5].i + scratch[4].r;
+            }
+            in += in_stride;
+            ++out;
+        }
+        tw += 3;
+    }
+}
+
+static void kf_sbfly3(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    const kiss_fft_cpx epi3 = tw[2*m+1];
+    kiss_fft_cpx scratch[5],x0,x1,x2,y1;
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 3*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            x0 = in[0]; x1 = in[fs]; x2 = in[2*fs];
+            C_FIXDIV(x0,3); C_FIXDIV(x1,3); C_FIXDIV(x2,3);
+
+            C_MUL(scratch[1],x1 , tw[0]);
+            C_MUL(scratch[2],x2 , tw[1]);
+
+            C_ADD(scratch[3],scratch[1],scratch[2]);
+            C_SUB(scratch[0],scratch[1],scratch[2]);
+
+            y1.r = x0.r - HALF_OF(scratch[3].r);
+            y1.i = x0.i - HALF_OF(scratch[3].i);
+
+            C_MULBYSCALAR( scratch[0] , epi3.i );
+
+            C_ADD(out[0],x0,scratch[3]);
+
+            out[2*mf].r = y1.r + scratch[0].i;
+            out[2*mf].i = y1.i - scratch[0].r;
+
+            out[mf].r = y1.r - scratch[0].i;
+            out[mf].i = y1.i + scratch[0].r;
+
+            in += in_stride;
+            ++out;
+        }
+        tw += 2;
+    }
+}
+
+static void kf_sbfly5(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    const kiss_fft_cpx ya = tw[4*m+1];
+    const kiss_fft_cpx yb = tw[4*m+2];
+    kiss_fft_cpx scratch[13],x1,x2,x3,x4;
+    size_t u,j;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 5*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            scratch[0] = in[0]; x1 = in[fs]; x2 = in[2*fs]; x3 = in[3*fs]; x4 = in[4*fs];
+            C_FIXDIV(scratch[0],5); C_FIXDIV(x1,5); C_FIXDIV(x2,5); C_FIXDIV(x3,5); C_FIXDIV(x4,5);
+
+            C_MUL(scratch[1] ,x1, tw[0]);
+            C_MUL(scratch[2] ,x2, tw[1]);
+            C_MUL(scratch[3] ,x3, tw[2]);
+            C_MUL(scratch[4] ,x4, tw[3]);
+
+            C_ADD( scratch[7],scratch[1],scratch[4]);
+            C_SUB( scratch[10],scratch[1],scratch[4]);
+            C_ADD( scratch[8],scratch[2],scratch[3]);
+            C_SUB( scratch[9],scratch[2],scratch[3]);
+
+            out[0].r = scratch[0].r + (scratch[7].r + scratch[8].r);
+            out[0].i = scratch[0].i + (scratch[7].i + scratch[8].i);
+
+            scratch[5].r = scratch[0].r + S_MUL(scratch[7].r,ya.r) + S_MUL(scratch[8].r,yb.r);
+            scratch[5].i = scratch[0].i + S_MUL(scratch[7].i,ya.r) + S_MUL(scratch[8].i,yb.r);
+
+            scratch[6].r =  S_MUL(scratch[10].i,ya.i) + S_MUL(scratch[9].i,yb.i);
+            scratch[6].i = -S_MUL(scratch[10].r,ya.i) - S_MUL(scratch[9].r,yb.i);
+
+            C_SUB(out[mf],scratch[5],scratch[6]);
+            C_ADD(out[4*mf],scratch[5],scratch[6]);
+
+            scratch[11].r = scratch[0].r + S_MUL(scratch[7].r,yb.r) + S_MUL(scratch[8].r,ya.r);
+            scratch[11].i = scratch[0].i + S_MUL(scratch[7].i,yb.r) + S_MUL(scratch[8].i,ya.r);
+            scratch[12].r = - S_MUL(scratch[10].i,yb.i) + S_MUL(scratch[9].i,ya.i);
+            scratch[12].i = S_MUL(scratch[10].r,yb.i) - S_MUL(scratch[9].r,ya.i);
+
+            C_ADD(out[2*mf],scratch[11],scratch[12]);
+            C_SUB(out[3*mf],scratch[11],scratch[12]);
+
+            in += in_stride;
+            ++out;
+        }
+        tw += 4;
+    }
+}
+
+static void kf_sbfly8(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        size_t m
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    const kiss_fft_scalar h = tw[7*m+1].r;
+    kiss_fft_cpx x[8],t;
+    size_t u,j;
+    int q;
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + 8*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            x[0] = in[0];
+            C_FIXDIV(x[0],8);
+            for (q=1;q<8;++q) {
+                t = in[q*fs];
+                C_FIXDIV(t,8);
+                if (u)
+                    C_MUL(x[q],t,tw[q-1]);
+                else
+                    x[q] = t;
+            }
+
+            KF_DFT8(x,h,st->inverse);
+            for (q=0;q<8;++q)
+                out[q*mf] = x[q];
+            in += in_stride;
+            ++out;
+        }
+        tw += 7;
+    }
+}
+
+static void kf_sbfly_generic(
+        kiss_fft_cpx * Fout,
+        const kiss_fft_cpx * Fin,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        size_t f,
+        size_t m,
+        int p
+        )
+{
+    const size_t fs = f*in_stride;
+    const size_t mf = m*f;
+    const kiss_fft_cpx * roots = tw + (p-1)*m;
+    kiss_fft_cpx t;
+    size_t u,j;
+    int q1,q,r;
+
+    kiss_fft_cpx * scratch = (kiss_fft_cpx*)KISS_FFT_TMP_ALLOC(sizeof(kiss_fft_cpx)*p);
+    if (scratch == NULL){
+        KISS_FFT_ERROR("Memory allocation failed.");
+        return;
+    }
+
+    for (u=0;u<m;++u) {
+        const kiss_fft_cpx * in = Fin + p*u*fs;
+        kiss_fft_cpx * out = Fout + u*f;
+        for (j=0;j<f;++j) {
+            scratch[0] = in[0];
+            C_FIXDIV(scratch[0],p);
+            for ( q=1 ; q<p ; ++q ) {
+                t = in[q*fs];
+                C_FIXDIV(t,p);
+                C_MUL(scratch[q], t, tw[q-1]);
+            }
+
+            for ( q1=0 ; q1<p ; ++q1 ) {
+                kiss_fft_cpx sum = scratch[0];
+                r=0;
+                for (q=1;q<p;++q ) {
+                    r += q1;
+                    if (r>=p) r-=p;
+                    C_MUL(t,scratch[q] , roots[r] );
+                    C_ADDTO( sum ,t);
+                }
+                out[q1*mf] = sum;
+            }
+            in += in_stride;
+            ++out;
+        }
+        tw += p-1;
+    }
+    KISS_FFT_TMP_FREE(scratch);
+}
+
+/* the stage tables, outermost first; returns the number of stages */
+static
+int kf_stage_tables(const kiss_fft_cfg st,const kiss_fft_cpx ** tw)
+{
+    int nstages=0;
+    int p,m;
+    tw[0] = st->twiddles;
+    do {
+        p = st->factors[2*nstages];
+        m = st->factors[2*nstages+1];
+        ++nstages;
+        tw[nstages] = tw[nstages-1] + (p-1)*m + p;
+    } while (m > 1);
+    return nstages;
+}
+
+/* one breadth-first stage, with fstride f */
+static
+void kf_sstage(
+        kiss_fft_cpx * out,
+        const kiss_fft_cpx * in,
+        size_t in_stride,
+        const kiss_fft_cpx * tw,
+        const kiss_fft_cfg st,
+        size_t f,
+        int m,
+        int p
+        )
+{
+#ifdef KISS_FFT_X86
+    if (st->simd && in_stride == 1 && kf_vsbfly(out,in,tw,st,f,m,p))
+        return;
+#endif
     switch (p) {
-        case 2: kf_bfly2(Fout,fstride,st,m); break;
-        case 3: kf_bfly3(Fout,fstride,st,m); break;
-        case 4: kf_bfly4(Fout,fstride,st,m); break;
-        case 5: kf_bfly5(Fout,fstride,st,m); break;
-        default: kf_bfly_generic(Fout,fstride,st,m,p); break;
+        case 2: kf_sbfly2(out,in,in_stride,tw,f,m); break;
+        case 3: kf_sbfly3(out,in,in_stride,tw,f,m); break;
+        case 4: kf_sbfly4(out,in,in_stride,tw,st,f,m); break;
+        case 5: kf_sbfly5(out,in,in_stride,tw,f,m); break;
+        case 8: kf_sbfly8(out,in,in_stride,tw,st,f,m); break;
+        default: kf_sbfly_generic(out,in,in_stride,tw,f,m,p); break;
     }
 }
 
+static
+void kf_stockham(
+        kiss_fft_cpx * fout,
+        const kiss_fft_cpx * fin,
+        size_t in_stride,
+        const kiss_fft_cfg st
+        )
+{
+    const kiss_fft_cpx * tw[MAXFACTORS];
+    const kiss_fft_cpx * in = fin;
+    kiss_fft_cpx * tmpbuf = NULL;
+    kiss_fft_cpx * out;
+    const int nstages = kf_stage_tables(st,tw);
+    int s;
+
+    if (nstages > 1 || fin == fout) {
+        tmpbuf = (kiss_fft_cpx*)KISS_FFT_TMP_ALLOC( sizeof(kiss_fft_cpx)*st->nfft);
+        if (tmpbuf == NULL){
+            KISS_FFT_ERROR("Memory allocation error.");
+            return;
+        }
+    }
+
+    /* ping-pong so that the last stage writes fout */
+    out = (nstages & 1) ? fout : tmpbuf;
+    if (fin == fout && out == fout) {
+        /* in place, and the first stage would overwrite its own input */
+        for (s=0;s<st->nfft;++s)
+            tmpbuf[s] = fin[s*in_stride];
+        in = tmpbuf;
+        in_stride = 1;
+    }
+    for (s=nstages-1;s>=0;--s) {
+        const int p = st->factors[2*s];
+        const int m = st->factors[2*s+1];
+        kf_sstage(out,in,in_stride,tw[s],st,st->nfft/(p*m),m,p);
+        in = out;
+        in_stride = 1;
+        out = (out == fout) ? tmpbuf : fout;
+    }
+    KISS_FFT_TMP_FREE(tmpbuf);
+}
+
+/*
+ A batch of nb transforms runs interleaved point by point, point k of
+ transform b at [k*nb + b].  To the Stockham stages that is one transform
+ with nb times the fstride, the b's being more sub-fft's sharing each
+ twiddle, so every stage runs over contiguous groups of at least nb points.
+ */
+size_t kf_batch_size(const kiss_fft_cfg st)
+{
+    const size_t nb = KISS_FFT_BATCH_BYTES / (sizeof(kiss_fft_cpx)*st->nfft);
+    if (nb == 0)
+        return 1;
+    return nb == 1 ? 2 : nb; /* a pair, once one fits */
+}
+
+kiss_fft_cpx * kf_batch_work(const kiss_fft_cfg st,kiss_fft_cpx * buf,kiss_fft_cpx * tmp,size_t nb)
+{
+    const kiss_fft_cpx * tw[MAXFACTORS];
+    const int nstages = kf_stage_tables(st,tw);
+    kiss_fft_cpx * in = buf;
+    kiss_fft_cpx * out = tmp;
+    int s;
+
+    if (nb == 1 && st->engine == KISS_FFT_RECURSIVE) {
+        kf_work(tmp,buf,1,1,st->factors,st->twiddles,st);
+        return tmp;
+    }
+    for (s=nstages-1;s>=0;--s) {
+        const int p = st->factors[2*s];
+        const int m = st->factors[2*s+1];
+        kf_sstage(out,in,1,tw[s],st,nb*(st->nfft/(p*m)),m,p);
+        in = out;
+        out = (out == buf) ? tmp : buf;
+    }
+    return in;
+}
+
 /*  facbuf is populated by p1,m1,p2,m2, ...
     where
     p[i] * m[i] = m[i-1]
@@ -306,18 +868,51 @@ void kf_work(
 static
 void kf_factor(int n,int * facbuf)
 {
-    int p=4;
+    const int * facbeg = facbuf;
+    int p,m;
+    int twos=0,eights,fours=0;
     double floor_sqrt;
-    floor_sqrt = floor( sqrt((double)n) );
 
-    /*factor out powers of 4, powers of 2, then any remaining primes */
+    /* powers of 2 go in radix 8 stages, after one or two radix 4 stages
+       for what is left over rather than a radix 2 one.  The radix 8 ones
+       are innermost, where their leaf stage needs no twiddles. */
+    for (m=n; m>1 && (m&1)==0; m>>=1)
+        ++twos;
+    eights = twos/3;
+    if (twos%3 == 2) {
+        fours = 1;
+        twos = 0;
+    }else if (twos%3 == 1 && eights) {
+        --eights;
+        fours = 2;
+        twos = 0;
+    }else{
+        twos %= 3; /* a single 2, for twice an odd number */
+    }
+    for (p=4; fours>0; --fours) {
+        n /= p;
+        *facbuf++ = p;
+        *facbuf++ = n;
+    }
+    for (p=8; eights>0; --eights) {
+        n /= p;
+        *facbuf++ = p;
+        *facbuf++ = n;
+    }
+    if (twos) {
+        n /= 2;
+        *facbuf++ = 2;
+        *facbuf++ = n;
+    }
+    if (n == 1 && facbuf != facbeg)
+        return;
+
+    /* then 3, 5, 7, 9, ... and whatever is left */
+    p=3;
+    floor_sqrt = floor( sqrt((double)n) );
     do {
         while (n % p) {
-            switch (p) {
-                case 4: p = 2; break;
-                case 2: p = 3; break;
-                default: p += 2; break;
-            }
+            p += 2;
             if (p > floor_sqrt)
                 p = n;          /* no more factors, skip to end */
         }
@@ -327,6 +922,31 @@ void kf_factor(int n,int * facbuf)
     } while (n > 1);
 }
 
+/* the twiddle exp(-2*pi*i*k/nfft), conjugated for an inverse fft */
+static
+void kf_twiddle(kiss_fft_cpx * x,size_t k,const kiss_fft_cfg st)
+{
+    const double pi=3.141592653589793238462643383279502884197169399375105820974944;
+    double phase = -2*pi*k / st->nfft;
+    if (st->inverse)
+        phase *= -1;
+    kf_cexp(x, phase );
+}
+
+/* the length of the per-stage twiddle tables described in _kiss_fft_guts.h */
+static
+size_t kf_twiddles_len(const int * factors)
+{
+    size_t len=0;
+    int p,m;
+    do {
+        p=*factors++;
+        m=*factors++;
+        len += (size_t)(p-1)*m + p;
+    } while (m > 1);
+    return len;
+}
+
 /*
  *
  * User-callable function to allocate all necessary storage space for the fft.
@@ -339,8 +959,10 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
     KISS_FFT_ALIGN_CHECK(mem)
 
     kiss_fft_cfg st=NULL;
+    int factors[2*MAXFACTORS];
+    kf_factor(nfft,factors);
     size_t memneeded = KISS_FFT_ALIGN_SIZE_UP(sizeof(struct kiss_fft_state)
-        + sizeof(kiss_fft_cpx)*(nfft-1)); /* twiddle factors*/
+        + sizeof(kiss_fft_cpx)*(kf_twiddles_len(factors)-1)); /* twiddle factors*/
 
     if ( lenmem==NULL ) {
         st = ( kiss_fft_cfg)KISS_FFT_MALLOC( memneeded );
@@ -350,19 +972,32 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
         *lenmem = memneeded;
     }
     if (st) {
-        int i;
+        kiss_fft_cpx * tw = st->twiddles;
+        const int * f = factors;
+        size_t fstride=1;
+        int p,m,u,q;
         st->nfft=nfft;
         st->inverse = inverse_fft;
+        st->engine = KISS_FFT_RECURSIVE;
+#ifdef KISS_FFT_X86
+        st->simd = kf_simd_level();
+#else
+        st->simd = 0;
+#endif
+        memcpy(st->factors,factors,sizeof(factors));
 
-        for (i=0;i<nfft;++i) {
-            const double pi=3.141592653589793238462643383279502884197169399375105820974944;
-            double phase = -2*pi*i / nfft;
-            if (st->inverse)
-                phase *= -1;
-            kf_cexp(st->twiddles+i, phase );
-        }
-
-        kf_factor(nfft,st->factors);
+        /* each stage's twiddles in the order its butterfly takes them,
+           then its p roots of unity */
+        do {
+            p=*f++;
+            m=*f++;
+            for (u=0;u<m;++u)
+                for (q=1;q<p;++q)
+                    kf_twiddle(tw++, fstride*q*u, st);
+            for (q=0;q<p;++q)
+                kf_twiddle(tw++, fstride*m*q, st);
+            fstride *= p;
+        } while (m > 1);
     }
     return st;
 }
@@ -370,7 +1005,19 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
 
 void kiss_fft_stride(kiss_fft_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,int in_stride)
 {
-    if (fin == fout) {
+#ifdef KISS_FFT_TASKS
+    if (st->engine == KISS_FFT_RECURSIVE && st->nfft > KISS_FFT_GRAIN
+            && !omp_in_parallel() && omp_get_max_threads() > 1) {
+        // the threads for kf_work's tasks
+#       pragma omp parallel
+#       pragma omp single
+        kiss_fft_stride(st,fin,fout,in_stride);
+        return;
+    }
+#endif
+    if (st->engine == KISS_FFT_STOCKHAM) {
+        kf_stockham(fout,fin,in_stride,st);
+    }else if (fin == fout) {
         //NOTE: this is not really an in-place FFT algorithm.
         //It just performs an out-of-place FFT into a temp buffer
         if (fout == NULL){
@@ -386,11 +1033,11 @@ void kiss_fft_stride(kiss_fft_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,
 
 
 
-        kf_work(tmpbuf,fin,1,in_stride, st->factors,st);
+        kf_work(tmpbuf,fin,1,in_stride, st->factors,st->twiddles,st);
         memcpy(fout,tmpbuf,sizeof(kiss_fft_cpx)*st->nfft);
         KISS_FFT_TMP_FREE(tmpbuf);
     }else{
-        kf_work( fout, fin, 1,in_stride, st->factors,st );
+        kf_work( fout, fin, 1,in_stride, st->factors,st->twiddles,st );
     }
 }
 
@@ -399,6 +1046,93 @@ void kiss_fft(kiss_fft_cfg cfg,const kiss_fft_cpx *fin,kiss_fft_cpx *fout)
     kiss_fft_stride(cfg,fin,fout,1);
 }
 
+void kf_batch_groups(const kiss_fft_cfg st,int howmany,
+        void (*group)(void * arg,kiss_fft_cpx * buf,int k,int n),void * arg)
+{
+    const int nb = (int)kf_batch_size(st);
+    const int ngroups = (howmany + nb - 1) / nb;
+    int g;
+
+#ifdef _OPENMP
+#   pragma omp parallel if ((ngroups > 1 || st->nfft > KISS_FFT_GRAIN) && !omp_in_parallel())
+#endif
+    {
+        kiss_fft_cpx * buf = (kiss_fft_cpx*)KISS_FFT_TMP_ALLOC(2*sizeof(kiss_fft_cpx)*nb*st->nfft);
+        if (buf == NULL){
+            KISS_FFT_ERROR("Memory allocation error.");
+        }
+#ifdef _OPENMP
+#       pragma omp for schedule(dynamic)
+#endif
+        for (g=0;g<ngroups;++g) {
+            const int k = g*nb;
+            if (buf)
+                group(arg,buf,k,howmany-k < nb ? howmany-k : nb);
+        }
+        KISS_FFT_TMP_FREE(buf);
+    }
+}
+
+struct kf_batch_args {
+    kiss_fft_cfg st;
+    const kiss_fft_cpx * fin;
+    int istride,idist;
+    kiss_fft_cpx * fout;
+    int ostride,odist;
+};
+
+static
+void kf_batch_group(void * arg,kiss_fft_cpx * buf,int k,int n)
+{
+    const struct kf_batch_args * a = (const struct kf_batch_args*)arg;
+    const int nfft = a->st->nfft;
+    const kiss_fft_cpx * res;
+    int b,j;
+
+    for (b=0;b<n;++b) {
+        const kiss_fft_cpx * in = a->fin + (size_t)(k+b)*a->idist;
+        for (j=0;j<nfft;++j)
+            buf[(size_t)j*n+b] = in[(size_t)j*a->istride];
+    }
+    res = kf_batch_work(a->st,buf,buf+kf_batch_size(a->st)*nfft,n);
+    for (b=0;b<n;++b) {
+        kiss_fft_cpx * out = a->fout + (size_t)(k+b)*a->odist;
+        for (j=0;j<nfft;++j)
+            out[(size_t)j*a->ostride] = res[(size_t)j*n+b];
+    }
+}
+
+void kiss_fft_batch(kiss_fft_cfg st,int howmany,
+        const kiss_fft_cpx *fin,int istride,int idist,
+        kiss_fft_cpx *fout,int ostride,int odist)
+{
+    struct kf_batch_args a;
+    int k;
+
+    if (kf_batch_size(st) == 1 && ostride == 1) {
+        /* too big to interleave, and nothing to rearrange */
+#ifdef _OPENMP
+#       pragma omp parallel for schedule(dynamic) if (howmany > 1 && !omp_in_parallel())
+#endif
+        for (k=0;k<howmany;++k)
+            kiss_fft_stride(st,fin+(size_t)k*idist,fout+(size_t)k*odist,istride);
+        return;
+    }
+    a.st = st;
+    a.fin = fin;
+    a.istride = istride;
+    a.idist = idist;
+    a.fout = fout;
+    a.ostride = ostride;
+    a.odist = odist;
+    kf_batch_groups(st,howmany,kf_batch_group,&a);
+}
+
+
+void kiss_fft_set_engine(kiss_fft_cfg st,int engine)
+{
+    st->engine = engine;
+}
 
 void kiss_fft_cleanup(void)
 {
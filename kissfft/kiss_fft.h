@@ -133,6 +133,39 @@ void KISS_FFT_API kiss_fft(kiss_fft_cfg cfg,const kiss_fft_cpx *fin,kiss_fft_cpx
  * */
 void KISS_FFT_API kiss_fft_stride(kiss_fft_cfg cfg,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,int fin_stride);
 
+/*
+ * kiss_fft_batch(cfg,howmany,fin,istride,idist,fout,ostride,odist)
+ *
+ * Performs howmany FFTs with the one cfg, as FFTW's advanced interface does.
+ * Point j of transform k is read from fin[k*idist + j*istride] and its
+ * result written to fout[k*odist + j*ostride], so e.g. the columns of a
+ * rows x nfft matrix are istride=nfft, idist=1.
+ *
+ * Transforms are run several at a time, interleaved, a stage at a time over
+ * all of them, which shares each twiddle between them and gives every stage
+ * runs of points to vectorize; the results agree with kiss_fft_stride to
+ * within rounding.  fin may equal fout only if the two layouts are the same.
+ * */
+void KISS_FFT_API kiss_fft_batch(kiss_fft_cfg cfg,int howmany,
+        const kiss_fft_cpx *fin,int istride,int idist,
+        kiss_fft_cpx *fout,int ostride,int odist);
+
+/*
+ * kiss_fft_set_engine(cfg,engine)
+ *
+ * Chooses how kiss_fft runs the plan.  The results agree to within rounding.
+ *
+ * KISS_FFT_RECURSIVE (the default) recurses depth first, one sub-fft at a
+ *      time, and is the better choice when there is no memory to spare.
+ * KISS_FFT_STOCKHAM runs a stage at a time over the whole transform, with
+ *      no recursion and no reordering pass, ping-ponging between fout and a
+ *      temporary buffer of nfft points taken for each call.
+ * */
+#define KISS_FFT_RECURSIVE 0
+#define KISS_FFT_STOCKHAM 1
+
+void KISS_FFT_API kiss_fft_set_engine(kiss_fft_cfg cfg,int engine);
+
 /* If kiss_fft_alloc allocated a buffer, it is one contiguous 
    buffer and can be simply free()d when no longer needed*/
 #define kiss_fft_free KISS_FFT_FREE
@@ -108,7 +108,7 @@ Stage 0 ( D=2): treat the buffer as a 2x12 matrix
      [m n ... w x] ]
 
    FFT each column with size 2.
-   Transpose the matrix at the same time using kiss_fft_stride.
+   Transpose the matrix at the same time using kiss_fft_batch.
 
    [ [ a+m a-m ]
      [ b+n b-n]
@@ -155,7 +155,7 @@ Stage 2 ( D=4) treats this buffer as a 4*6 matrix,
 */
 void kiss_fftnd(kiss_fftnd_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout)
 {
-    int i,k;
+    int k;
     const kiss_fft_cpx * bufin=fin;
     kiss_fft_cpx * bufout;
 
@@ -173,8 +173,7 @@ void kiss_fftnd(kiss_fftnd_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout)
         int curdim = st->dims[k];
         int stride = st->dimprod / curdim;
 
-        for ( i=0 ; i<stride ; ++i ) 
-            kiss_fft_stride( st->states[k], bufin+i , bufout+i*curdim, stride );
+        kiss_fft_batch( st->states[k], stride, bufin, stride, 1, bufout, 1, curdim );
 
         /*toggle back and forth between the two buffers*/
         if (bufout == st->tmpbuf){
@@ -83,12 +83,8 @@ void kiss_fftndr(kiss_fftndr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx
 
     // timedata is N0 x N1 x ... x Nk real
 
-    // take a real chunk of data, fft it and place the output at correct intervals
-    for (k1=0;k1<dimOther;++k1) {
-        kiss_fftr( st->cfg_r, timedata + k1*dimReal , tmp1 ); // tmp1 now holds nrbins complex points
-        for (k2=0;k2<nrbins;++k2)
-           tmp2[ k2*dimOther+k1 ] = tmp1[k2];
-    }
+    // fft each real chunk of data, placing the output at correct intervals
+    kiss_fftr_batch( st->cfg_r, dimOther, timedata, 1, dimReal, tmp2, dimOther, 1 );
 
     for (k2=0;k2<nrbins;++k2) {
         kiss_fftnd(st->cfg_nd, tmp2+k2*dimOther, tmp1);  // tmp1 now holds dimOther complex points
@@ -112,9 +108,5 @@ void kiss_fftndri(kiss_fftndr_cfg st,const kiss_fft_cpx *freqdata,kiss_fft_scala
         kiss_fftnd(st->cfg_nd, tmp1, tmp2+k2*dimOther);
     }
 
-    for (k1=0;k1<dimOther;++k1) {
-        for (k2=0;k2<nrbins;++k2)
-            tmp1[k2] = tmp2[ k2*dimOther+k1 ];
-        kiss_fftri( st->cfg_r,tmp1,timedata + k1*dimReal);
-    }
+    kiss_fftri_batch( st->cfg_r, dimOther, tmp2, dimOther, 1, timedata, 1, dimReal );
 }
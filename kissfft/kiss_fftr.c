@@ -60,22 +60,16 @@ kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenme
     return st;
 }
 
-void kiss_fftr(kiss_fftr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx *freqdata)
+/* the spectrum of a real signal, to freqdata[k*os], from the fft of its
+   points taken in pairs, tmp[k*ts] */
+static void kf_fftr_split(kiss_fftr_cfg st,const kiss_fft_cpx *tmp,size_t ts,kiss_fft_cpx *freqdata,size_t os)
 {
-    /* input buffer timedata is stored row-wise */
     int k,ncfft;
     kiss_fft_cpx fpnk,fpk,f1k,f2k,tw,tdc;
 
-    if ( st->substate->inverse) {
-        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
-        return;/* The caller did not call the correct function */
-    }
-
     ncfft = st->substate->nfft;
 
-    /*perform the parallel fft of two real signals packed in real,imag*/
-    kiss_fft( st->substate , (const kiss_fft_cpx*)timedata, st->tmpbuf );
-    /* The real part of the DC element of the frequency spectrum in st->tmpbuf
+    /* The real part of the DC element of the frequency spectrum in tmp
      * contains the sum of the even-numbered elements of the input time sequence
      * The imag part is the sum of the odd-numbered elements
      *
@@ -85,23 +79,23 @@ void kiss_fftr(kiss_fftr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx *fr
      *      yielding Nyquist bin of input time sequence
      */
 
-    tdc.r = st->tmpbuf[0].r;
-    tdc.i = st->tmpbuf[0].i;
+    tdc.r = tmp[0].r;
+    tdc.i = tmp[0].i;
     C_FIXDIV(tdc,2);
     CHECK_OVERFLOW_OP(tdc.r ,+, tdc.i);
     CHECK_OVERFLOW_OP(tdc.r ,-, tdc.i);
     freqdata[0].r = tdc.r + tdc.i;
-    freqdata[ncfft].r = tdc.r - tdc.i;
+    freqdata[ncfft*os].r = tdc.r - tdc.i;
 #ifdef USE_SIMD
-    freqdata[ncfft].i = freqdata[0].i = _mm_set1_ps(0);
+    freqdata[ncfft*os].i = freqdata[0].i = _mm_set1_ps(0);
 #else
-    freqdata[ncfft].i = freqdata[0].i = 0;
+    freqdata[ncfft*os].i = freqdata[0].i = 0;
 #endif
 
     for ( k=1;k <= ncfft/2 ; ++k ) {
-        fpk    = st->tmpbuf[k];
-        fpnk.r =   st->tmpbuf[ncfft-k].r;
-        fpnk.i = - st->tmpbuf[ncfft-k].i;
+        fpk    = tmp[k*ts];
+        fpnk.r =   tmp[(ncfft-k)*ts].r;
+        fpnk.i = - tmp[(ncfft-k)*ts].i;
         C_FIXDIV(fpk,2);
         C_FIXDIV(fpnk,2);
 
@@ -109,47 +103,171 @@ void kiss_fftr(kiss_fftr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx *fr
         C_SUB( f2k, fpk , fpnk );
         C_MUL( tw , f2k , st->super_twiddles[k-1]);
 
-        freqdata[k].r = HALF_OF(f1k.r + tw.r);
-        freqdata[k].i = HALF_OF(f1k.i + tw.i);
-        freqdata[ncfft-k].r = HALF_OF(f1k.r - tw.r);
-        freqdata[ncfft-k].i = HALF_OF(tw.i - f1k.i);
+        freqdata[k*os].r = HALF_OF(f1k.r + tw.r);
+        freqdata[k*os].i = HALF_OF(f1k.i + tw.i);
+        freqdata[(ncfft-k)*os].r = HALF_OF(f1k.r - tw.r);
+        freqdata[(ncfft-k)*os].i = HALF_OF(tw.i - f1k.i);
     }
 }
 
-void kiss_fftri(kiss_fftr_cfg st,const kiss_fft_cpx *freqdata,kiss_fft_scalar *timedata)
+/* the reverse: from freqdata[k*is] to tmp[k*ts], for the inverse fft */
+static void kf_fftri_merge(kiss_fftr_cfg st,const kiss_fft_cpx *freqdata,size_t is,kiss_fft_cpx *tmp,size_t ts)
 {
-    /* input buffer timedata is stored row-wise */
     int k, ncfft;
 
-    if (st->substate->inverse == 0) {
-        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
-        return;/* The caller did not call the correct function */
-    }
-
     ncfft = st->substate->nfft;
 
-    st->tmpbuf[0].r = freqdata[0].r + freqdata[ncfft].r;
-    st->tmpbuf[0].i = freqdata[0].r - freqdata[ncfft].r;
-    C_FIXDIV(st->tmpbuf[0],2);
+    tmp[0].r = freqdata[0].r + freqdata[ncfft*is].r;
+    tmp[0].i = freqdata[0].r - freqdata[ncfft*is].r;
+    C_FIXDIV(tmp[0],2);
 
     for (k = 1; k <= ncfft / 2; ++k) {
-        kiss_fft_cpx fk, fnkc, fek, fok, tmp;
-        fk = freqdata[k];
-        fnkc.r = freqdata[ncfft - k].r;
-        fnkc.i = -freqdata[ncfft - k].i;
+        kiss_fft_cpx fk, fnkc, fek, fok, t;
+        fk = freqdata[k*is];
+        fnkc.r = freqdata[(ncfft - k)*is].r;
+        fnkc.i = -freqdata[(ncfft - k)*is].i;
         C_FIXDIV( fk , 2 );
         C_FIXDIV( fnkc , 2 );
 
         C_ADD (fek, fk, fnkc);
-        C_SUB (tmp, fk, fnkc);
-        C_MUL (fok, tmp, st->super_twiddles[k-1]);
-        C_ADD (st->tmpbuf[k],     fek, fok);
-        C_SUB (st->tmpbuf[ncfft - k], fek, fok);
+        C_SUB (t, fk, fnkc);
+        C_MUL (fok, t, st->super_twiddles[k-1]);
+        C_ADD (tmp[k*ts],     fek, fok);
+        C_SUB (tmp[(ncfft - k)*ts], fek, fok);
 #ifdef USE_SIMD
-        st->tmpbuf[ncfft - k].i *= _mm_set1_ps(-1.0);
+        tmp[(ncfft - k)*ts].i *= _mm_set1_ps(-1.0);
 #else
-        st->tmpbuf[ncfft - k].i *= -1;
+        tmp[(ncfft - k)*ts].i *= -1;
 #endif
     }
+}
+
+void kiss_fftr(kiss_fftr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx *freqdata)
+{
+    /* input buffer timedata is stored row-wise */
+    if ( st->substate->inverse) {
+        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
+        return;/* The caller did not call the correct function */
+    }
+
+    /*perform the parallel fft of two real signals packed in real,imag*/
+    kiss_fft( st->substate , (const kiss_fft_cpx*)timedata, st->tmpbuf );
+    kf_fftr_split(st,st->tmpbuf,1,freqdata,1);
+}
+
+void kiss_fftri(kiss_fftr_cfg st,const kiss_fft_cpx *freqdata,kiss_fft_scalar *timedata)
+{
+    /* input buffer timedata is stored row-wise */
+    if (st->substate->inverse == 0) {
+        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
+        return;/* The caller did not call the correct function */
+    }
+
+    kf_fftri_merge(st,freqdata,1,st->tmpbuf,1);
     kiss_fft (st->substate, st->tmpbuf, (kiss_fft_cpx *) timedata);
 }
+
+/* The batches run in groups through kf_batch_groups, as kiss_fft_batch's
+   do, the real points going in as pairs and the spectra coming out through
+   kf_fftr_split, each group's transforms interleaved point by point. */
+struct kf_fftr_batch_args {
+    kiss_fftr_cfg st;
+    const void * in;
+    int istride,idist;
+    void * out;
+    int ostride,odist;
+};
+
+static void kf_fftr_group(void * arg,kiss_fft_cpx * buf,int k,int n)
+{
+    const struct kf_fftr_batch_args * a = (const struct kf_fftr_batch_args*)arg;
+    const int ncfft = a->st->substate->nfft;
+    const kiss_fft_cpx * res;
+    int b,j;
+
+    for (b=0;b<n;++b) {
+        const kiss_fft_scalar * in = (const kiss_fft_scalar*)a->in + (size_t)(k+b)*a->idist;
+        for (j=0;j<ncfft;++j) {
+            buf[(size_t)j*n+b].r = in[(size_t)2*j*a->istride];
+            buf[(size_t)j*n+b].i = in[(size_t)(2*j+1)*a->istride];
+        }
+    }
+    res = kf_batch_work(a->st->substate,buf,buf+kf_batch_size(a->st->substate)*ncfft,n);
+    for (b=0;b<n;++b)
+        kf_fftr_split(a->st,res+b,n,(kiss_fft_cpx*)a->out+(size_t)(k+b)*a->odist,a->ostride);
+}
+
+static void kf_fftri_group(void * arg,kiss_fft_cpx * buf,int k,int n)
+{
+    const struct kf_fftr_batch_args * a = (const struct kf_fftr_batch_args*)arg;
+    const int ncfft = a->st->substate->nfft;
+    const kiss_fft_cpx * res;
+    int b,j;
+
+    for (b=0;b<n;++b)
+        kf_fftri_merge(a->st,(const kiss_fft_cpx*)a->in+(size_t)(k+b)*a->idist,a->istride,buf+b,n);
+    res = kf_batch_work(a->st->substate,buf,buf+kf_batch_size(a->st->substate)*ncfft,n);
+    for (b=0;b<n;++b) {
+        kiss_fft_scalar * out = (kiss_fft_scalar*)a->out + (size_t)(k+b)*a->odist;
+        for (j=0;j<ncfft;++j) {
+            out[(size_t)2*j*a->ostride] = res[(size_t)j*n+b].r;
+            out[(size_t)(2*j+1)*a->ostride] = res[(size_t)j*n+b].i;
+        }
+    }
+}
+
+void kiss_fftr_batch(kiss_fftr_cfg st,int howmany,
+        const kiss_fft_scalar *timedata,int istride,int idist,
+        kiss_fft_cpx *freqdata,int ostride,int odist)
+{
+    struct kf_fftr_batch_args a;
+    int k;
+
+    if ( st->substate->inverse) {
+        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
+        return;/* The caller did not call the correct function */
+    }
+    if (kf_batch_size(st->substate) == 1 && istride == 1) {
+        for (k=0;k<howmany;++k) {
+            kiss_fft( st->substate , (const kiss_fft_cpx*)(timedata+(size_t)k*idist), st->tmpbuf );
+            kf_fftr_split(st,st->tmpbuf,1,freqdata+(size_t)k*odist,ostride);
+        }
+        return;
+    }
+    a.st = st;
+    a.in = timedata;
+    a.istride = istride;
+    a.idist = idist;
+    a.out = freqdata;
+    a.ostride = ostride;
+    a.odist = odist;
+    kf_batch_groups(st->substate,howmany,kf_fftr_group,&a);
+}
+
+void kiss_fftri_batch(kiss_fftr_cfg st,int howmany,
+        const kiss_fft_cpx *freqdata,int istride,int idist,
+        kiss_fft_scalar *timedata,int ostride,int odist)
+{
+    struct kf_fftr_batch_args a;
+    int k;
+
+    if (st->substate->inverse == 0) {
+        KISS_FFT_ERROR("kiss fft usage error: improper alloc");
+        return;/* The caller did not call the correct function */
+    }
+    if (kf_batch_size(st->substate) == 1 && ostride == 1) {
+        for (k=0;k<howmany;++k) {
+            kf_fftri_merge(st,freqdata+(size_t)k*idist,istride,st->tmpbuf,1);
+            kiss_fft (st->substate, st->tmpbuf, (kiss_fft_cpx *)(timedata+(size_t)k*odist));
+        }
+        return;
+    }
+    a.st = st;
+    a.in = freqdata;
+    a.istride = istride;
+    a.idist = idist;
+    a.out = timedata;
+    a.ostride = ostride;
+    a.odist = odist;
+    kf_batch_groups(st->substate,howmany,kf_fftri_group,&a);
+}
@@ -46,6 +46,18 @@ void KISS_FFT_API kiss_fftri(kiss_fftr_cfg cfg,const kiss_fft_cpx *freqdata,kiss
  output timedata has nfft scalar points
 */
 
+void KISS_FFT_API kiss_fftr_batch(kiss_fftr_cfg cfg,int howmany,
+        const kiss_fft_scalar *timedata,int istride,int idist,
+        kiss_fft_cpx *freqdata,int ostride,int odist);
+void KISS_FFT_API kiss_fftri_batch(kiss_fftr_cfg cfg,int howmany,
+        const kiss_fft_cpx *freqdata,int istride,int idist,
+        kiss_fft_scalar *timedata,int ostride,int odist);
+/*
+ howmany real ffts, as kiss_fft_batch does them: transform k reads point j
+ from in[k*idist + j*istride] and writes point j to out[k*odist + j*ostride],
+ nfft scalar points on the time side and nfft/2+1 complex ones on the other
+*/
+
 #define kiss_fftr_free KISS_FFT_FREE
 
 #ifdef __cplusplus
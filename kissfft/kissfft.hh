@@ -32,22 +32,41 @@ class kissfft
                 _twiddles[i] = std::exp( cpx_t(0,i*phinc) );
 
             //factorize
-            //start factoring out 4's, then 2's, then 3,5,7,9,...
+            //start with a 4 or two 4's for the powers of 2 that 8's leave
+            //over (rather than a 2), then the 8's, then 3,5,7,9,...
             std::size_t n= _nfft;
-            std::size_t p=4;
+            std::size_t twos=0;
+            for (std::size_t m=n; m>1 && m%2==0; m/=2)
+                ++twos;
+            std::size_t eights = twos/3;
+            std::size_t fours = 0;
+            if (twos%3 == 2) {
+                fours = 1;
+                twos = 0;
+            } else if (twos%3 == 1 && eights) {
+                --eights;
+                fours = 2;
+                twos = 0;
+            } else {
+                twos %= 3;
+            }
+            for (; fours; --fours)
+                push_stage(4, n);
+            for (; eights; --eights)
+                push_stage(8, n);
+            if (twos)
+                push_stage(2, n);
+            if (n==1 && !_stageRadix.empty())
+                return;
+
+            std::size_t p=3;
             do {
                 while (n % p) {
-                    switch (p) {
-                        case 4: p = 2; break;
-                        case 2: p = 3; break;
-                        default: p += 2; break;
-                    }
+                    p += 2;
                     if (p*p>n)
                         p = n;// no more factors
                 }
-                n /= p;
-                _stageRadix.push_back(p);
-                _stageRemainder.push_back(n);
+                push_stage(p, n);
             }while(n>1);
         }
 
@@ -72,6 +91,7 @@ class kissfft
                 for ( typename std::vector<cpx_t>::iterator it = _twiddles.begin();
                       it != _twiddles.end(); ++it )
                     it->imag( -it->imag() );
+                _inverse = inverse;
             }
         }
 
@@ -118,6 +138,7 @@ class kissfft
                 case 3: kf_bfly3(fft_out,fstride,m); break;
                 case 4: kf_bfly4(fft_out,fstride,m); break;
                 case 5: kf_bfly5(fft_out,fstride,m); break;
+                case 8: kf_bfly8(fft_out,fstride,m); break;
                 default: kf_bfly_generic(fft_out,fstride,m,p); break;
             }
         }
@@ -190,6 +211,20 @@ class kissfft
 
     private:
 
+        void push_stage( const std::size_t p, std::size_t & n )
+        {
+            n /= p;
+            _stageRadix.push_back(p);
+            _stageRemainder.push_back(n);
+        }
+
+        /// z times -i for a forward transform, times i for an inverse one
+        cpx_t rot( const cpx_t & z ) const
+        {
+            return _inverse ? cpx_t( -z.imag(), z.real() )
+                            : cpx_t( z.imag(), -z.real() );
+        }
+
         void kf_bfly2( cpx_t * Fout, const size_t fstride, const std::size_t m) const
         {
             for (std::size_t k=0;k<m;++k) {
@@ -317,6 +352,48 @@ class kissfft
             }
         }
 
+        void kf_bfly8( cpx_t * const Fout, const std::size_t fstride, const std::size_t m) const
+        {
+            // sqrt(1/2): w8 and w8^3 (w8 turned by -i) take two multiplies
+            const scalar_t h = scalar_t(0.70710678118654752440084436210484904L);
+            cpx_t x[8], e[4], o[4];
+            for (std::size_t k=0;k<m;++k) {
+                x[0] = Fout[k];
+                for (std::size_t q=1;q<8;++q)
+                    x[q] = Fout[k+q*m] * _twiddles[q*k*fstride];
+
+                // 4 point DFTs of the even and the odd points
+                cpx_t t0 = x[0] + x[4], t1 = x[0] - x[4];
+                cpx_t t2 = x[2] + x[6], t3 = rot( x[2] - x[6] );
+                e[0] = t0 + t2;
+                e[2] = t0 - t2;
+                e[1] = t1 + t3;
+                e[3] = t1 - t3;
+                t0 = x[1] + x[5];
+                t1 = x[1] - x[5];
+                t2 = x[3] + x[7];
+                t3 = rot( x[3] - x[7] );
+                o[0] = t0 + t2;
+                o[2] = rot( t0 - t2 );
+                o[1] = t1 + t3;
+                o[3] = t1 - t3;
+
+                // turn the odd ones by w8^k
+                if (_inverse) {
+                    o[1] = h * cpx_t( o[1].real() - o[1].imag(), o[1].real() + o[1].imag() );
+                    o[3] = rot( h * cpx_t( o[3].real() - o[3].imag(), o[3].real() + o[3].imag() ) );
+                } else {
+                    o[1] = h * cpx_t( o[1].real() + o[1].imag(), o[1].imag() - o[1].real() );
+                    o[3] = rot( h * cpx_t( o[3].real() + o[3].imag(), o[3].imag() - o[3].real() ) );
+                }
+
+                for (std::size_t q=0;q<4;++q) {
+                    Fout[k+q*m] = e[q] + o[q];
+                    Fout[k+(q+4)*m] = e[q] - o[q];
+                }
+            }
+        }
+
         /* perform the butterfly for one stage of a mixed radix FFT */
         void kf_bfly_generic(
                 cpx_t * const Fout,
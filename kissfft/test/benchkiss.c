@@ -13,6 +13,9 @@
 #include "kiss_fftr.h"
 #include "kiss_fftnd.h"
 #include "kiss_fftndr.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "pstats.h"
 
@@ -39,17 +42,21 @@ int main(int argc,char ** argv)
     kiss_fft_cpx * buf;
     kiss_fft_cpx * bufout;
     int real = 0;
+    int engine = KISS_FFT_RECURSIVE;
 
     nfft[0] = 1024;// default
 
     while (1) {
-        int c = getopt (argc, argv, "n:ix:r");
+        int c = getopt (argc, argv, "n:ix:rst:");
         if (c == -1)
             break;
         switch (c) {
             case 'r':
                 real = 1;
                 break;
+            case 's':
+                engine = KISS_FFT_STOCKHAM;
+                break;
             case 'n':
                 ndims = getdims(nfft, optarg );
                 if (nfft[0] != kiss_fft_next_fast_size(nfft[0]) ) {
@@ -63,6 +70,13 @@ int main(int argc,char ** argv)
             case 'i':
                 isinverse = 1;
                 break;
+            case 't':
+#ifdef _OPENMP
+                omp_set_num_threads(atoi(optarg));
+#else
+                fprintf(stderr,"warning: -t needs an OpenMP build, running on one thread\n");
+#endif
+                break;
         }
     }
     int nbytes = sizeof(kiss_fft_cpx);
@@ -92,6 +106,7 @@ int main(int argc,char ** argv)
             free(st);
         }else{
             kiss_fft_cfg st = kiss_fft_alloc( nfft[0] ,isinverse ,0,0);
+            kiss_fft_set_engine(st,engine);
             for (i=0;i<numffts;++i)
                 kiss_fft( st ,buf,bufout );
             free(st);
@@ -119,7 +134,11 @@ int main(int argc,char ** argv)
     fprintf(stderr,"KISS\tnfft=");
     for (k=0;k<ndims;++k)
         fprintf(stderr, "%d,",nfft[k]);
-    fprintf(stderr,"\tnumffts=%d\n" ,numffts);
+    fprintf(stderr,"\tnumffts=%d" ,numffts);
+#ifdef _OPENMP
+    fprintf(stderr,"\tthreads=%d" ,omp_get_max_threads());
+#endif
+    fprintf(stderr,"\n");
     pstats_report();
 
     kiss_fft_cleanup();
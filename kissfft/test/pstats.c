@@ -15,24 +15,29 @@
 
 static struct tms tms_beg;
 static struct tms tms_end;
+static clock_t clk_beg;
 static int has_times = 0;
 
 
 void pstats_init(void)
 {
-    has_times = times(&tms_beg) != -1;
+    clk_beg = times(&tms_beg);
+    has_times = clk_beg != (clock_t)-1;
 }
 
 static void tms_report(void)
 {
-    double cputime;
+    double cputime,elapsed;
+    clock_t clk_end;
     if (! has_times )
         return;
-    times(&tms_end);
+    clk_end = times(&tms_end);
     cputime = ( ((float)tms_end.tms_utime + tms_end.tms_stime + tms_end.tms_cutime + tms_end.tms_cstime ) -
                 ((float)tms_beg.tms_utime + tms_beg.tms_stime + tms_beg.tms_cutime + tms_beg.tms_cstime ) )
                / sysconf(_SC_CLK_TCK);
-    fprintf(stderr,"\tcputime=%.3f\n" , cputime);
+    /* with OpenMP, cputime is that of all the threads */
+    elapsed = (double)(clk_end - clk_beg) / sysconf(_SC_CLK_TCK);
+    fprintf(stderr,"\tcputime=%.3f\telapsed=%.3f\n" , cputime, elapsed);
 }
 
 static void ps_report(void)
@@ -76,7 +76,7 @@ int main(int argc,char ** argv)
 {
     int nfft = 8*3*5;
     double ts,tfft,trfft;
-    int i;
+    int i,simd;
     if (argc>1)
         nfft = atoi(argv[1]);
     kiss_fft_cpx cin[nfft];
@@ -130,6 +130,49 @@ int main(int argc,char ** argv)
 
     printf("%d complex ffts took %gs, real took %gs\n",NUMFFTS,tfft,trfft);
 
+    kiss_fft(kiss_fft_state,cin,cout);
+    kiss_fft_set_engine(kiss_fft_state,KISS_FFT_STOCKHAM);
+    kiss_fft(kiss_fft_state,cin,sout);
+    printf( "nfft=%d, stockham vs recursive, snr=%g\n",
+            nfft, snr_compare(cout,sout,nfft) );
+    ts = cputime();
+    for (i=0;i<NUMFFTS;++i) {
+        kiss_fft(kiss_fft_state,cin,cout);
+    }
+    tfft = cputime() - ts;
+    printf("%d complex ffts with the stockham engine took %gs\n",NUMFFTS,tfft);
+
+    if (kiss_fft_state->simd) {
+        simd = kiss_fft_state->simd;
+        kiss_fft_set_engine(kiss_fft_state,KISS_FFT_RECURSIVE);
+        kiss_fft(kiss_fft_state,cin,cout);
+        kiss_fft_state->simd = 0;
+        kiss_fft(kiss_fft_state,cin,sout);
+        printf( "nfft=%d, vector butterflies (level %d) vs scalar, snr=%g\n",
+                nfft, simd, snr_compare(cout,sout,nfft) );
+        ts = cputime();
+        for (i=0;i<NUMFFTS;++i) {
+            kiss_fft(kiss_fft_state,cin,cout);
+        }
+        tfft = cputime() - ts;
+        printf("%d complex ffts with scalar butterflies took %gs\n",NUMFFTS,tfft);
+    }
+
+    /* a batch of two: rin, and rin reversed */
+    for (i=0;i<nfft;++i)
+        rout[i] = rin[nfft-1-i];
+    {
+        kiss_fft_scalar rbatch[2*nfft];
+        kiss_fft_cpx cbatch[2*(nfft/2+1)];
+        memcpy(rbatch,rin,sizeof(kiss_fft_scalar)*nfft);
+        memcpy(rbatch+nfft,rout,sizeof(kiss_fft_scalar)*nfft);
+        kiss_fftr_batch(kiss_fftr_state,2,rbatch,1,nfft,cbatch,1,nfft/2+1);
+        kiss_fftr(kiss_fftr_state,rin,cout);
+        kiss_fftr(kiss_fftr_state,rout,cout+nfft/2+1);
+        printf( "nfft=%d, real batch vs one at a time, snr=%g\n",
+                nfft, snr_compare(cout,cbatch,2*(nfft/2+1)) );
+    }
+
     free(kiss_fft_state);
     free(kiss_fftr_state);
 
@@ -15,20 +15,30 @@
 #include "kiss_fft.h"
 #include "kiss_fftndr.h"
 
+/* how many blocks of nfft to read and transform at a time, for the batched
+   transforms: about 64k points' worth */
+static
+int blocks_per_read(int nfft)
+{
+    return nfft < 65536 ? 65536/nfft : 1;
+}
+
 static
 void fft_file(FILE * fin,FILE * fout,int nfft,int isinverse)
 {
     kiss_fft_cfg st;
     kiss_fft_cpx * buf;
     kiss_fft_cpx * bufout;
+    int nblocks = blocks_per_read(nfft);
+    size_t n;
 
-    buf = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * nfft );
-    bufout = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * nfft );
+    buf = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * nfft * nblocks );
+    bufout = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * nfft * nblocks );
     st = kiss_fft_alloc( nfft ,isinverse ,0,0);
 
-    while ( fread( buf , sizeof(kiss_fft_cpx) * nfft ,1, fin ) > 0 ) {
-        kiss_fft( st , buf ,bufout);
-        fwrite( bufout , sizeof(kiss_fft_cpx) , nfft , fout );
+    while ( (n = fread( buf , sizeof(kiss_fft_cpx) * nfft ,nblocks, fin )) > 0 ) {
+        kiss_fft_batch( st , (int)n , buf , 1 , nfft , bufout , 1 , nfft );
+        fwrite( bufout , sizeof(kiss_fft_cpx) * nfft , n , fout );
     }
     free(st);
     free(buf);
@@ -104,20 +114,23 @@ void fft_file_real(FILE * fin,FILE * fout,int nfft,int isinverse)
     kiss_fftr_cfg st;
     kiss_fft_scalar * rbuf;
     kiss_fft_cpx * cbuf;
+    int nblocks = blocks_per_read(nfft);
+    int nbins = nfft/2+1;
+    size_t n;
 
-    rbuf = (kiss_fft_scalar*)malloc(sizeof(kiss_fft_scalar) * nfft );
-    cbuf = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * (nfft/2+1) );
+    rbuf = (kiss_fft_scalar*)malloc(sizeof(kiss_fft_scalar) * nfft * nblocks );
+    cbuf = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx) * nbins * nblocks );
     st = kiss_fftr_alloc( nfft ,isinverse ,0,0);
 
     if (isinverse==0) {
-        while ( fread( rbuf , sizeof(kiss_fft_scalar) * nfft ,1, fin ) > 0 ) {
-            kiss_fftr( st , rbuf ,cbuf);
-            fwrite( cbuf , sizeof(kiss_fft_cpx) , (nfft/2 + 1) , fout );
+        while ( (n = fread( rbuf , sizeof(kiss_fft_scalar) * nfft ,nblocks, fin )) > 0 ) {
+            kiss_fftr_batch( st , (int)n , rbuf , 1 , nfft , cbuf , 1 , nbins );
+            fwrite( cbuf , sizeof(kiss_fft_cpx) * nbins , n , fout );
         }
     }else{
-        while ( fread( cbuf , sizeof(kiss_fft_cpx) * (nfft/2+1) ,1, fin ) > 0 ) {
-            kiss_fftri( st , cbuf ,rbuf);
-            fwrite( rbuf , sizeof(kiss_fft_scalar) , nfft , fout );
+        while ( (n = fread( cbuf , sizeof(kiss_fft_cpx) * nbins ,nblocks, fin )) > 0 ) {
+            kiss_fftri_batch( st , (int)n , cbuf , 1 , nbins , rbuf , 1 , nfft );
+            fwrite( rbuf , sizeof(kiss_fft_scalar) * nfft , n , fout );
         }
     }
     free(st);
@@ -120,55 +120,56 @@ void transform_signal(void)
     kiss_fft_scalar *tbuf;
     kiss_fft_cpx *fbuf;
     float *mag2buf;
-    int i;
+    int i,k;
     int n;
-    int avgctr=0;
 
     int nfreqs=nfft/2+1;
 
     CHECKNULL( cfg=kiss_fftr_alloc(nfft,0,0,0) );
-    CHECKNULL( inbuf=(short*)malloc(sizeof(short)*2*nfft ) );
-    CHECKNULL( tbuf=(kiss_fft_scalar*)malloc(sizeof(kiss_fft_scalar)*nfft ) );
-    CHECKNULL( fbuf=(kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx)*nfreqs ) );
+    CHECKNULL( inbuf=(short*)malloc(sizeof(short)*2*nfft*navg ) );
+    CHECKNULL( tbuf=(kiss_fft_scalar*)malloc(sizeof(kiss_fft_scalar)*nfft*navg ) );
+    CHECKNULL( fbuf=(kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx)*nfreqs*navg ) );
     CHECKNULL( mag2buf=(float*)calloc(nfreqs,sizeof(float) ) );
 
+    /* a row's navg frames at a time, the last row only if it is complete */
     while (1) {
         if (stereo) {
-            n = fread(inbuf,sizeof(short)*2,nfft,fin);
-            if (n != nfft ) 
+            n = fread(inbuf,sizeof(short)*2,nfft*navg,fin);
+            if (n != nfft*navg ) 
                 break;
-            for (i=0;i<nfft;++i) 
+            for (i=0;i<nfft*navg;++i) 
                 tbuf[i] = inbuf[2*i] + inbuf[2*i+1];
         }else{
-            n = fread(inbuf,sizeof(short),nfft,fin);
-            if (n != nfft ) 
+            n = fread(inbuf,sizeof(short),nfft*navg,fin);
+            if (n != nfft*navg ) 
                 break;
-            for (i=0;i<nfft;++i) 
+            for (i=0;i<nfft*navg;++i) 
                 tbuf[i] = inbuf[i];
         }
 
         if (remove_dc) {
-            float avg = 0;
-            for (i=0;i<nfft;++i)  avg += tbuf[i];
-            avg /= nfft;
-            for (i=0;i<nfft;++i)  tbuf[i] -= (kiss_fft_scalar)avg;
+            for (k=0;k<navg;++k) {
+                kiss_fft_scalar * frame = tbuf + k*nfft;
+                float avg = 0;
+                for (i=0;i<nfft;++i)  avg += frame[i];
+                avg /= nfft;
+                for (i=0;i<nfft;++i)  frame[i] -= (kiss_fft_scalar)avg;
+            }
         }
 
-        /* do FFT */
-        kiss_fftr(cfg,tbuf,fbuf);
-
-        for (i=0;i<nfreqs;++i)
-            mag2buf[i] += fbuf[i].r * fbuf[i].r + fbuf[i].i * fbuf[i].i;
+        /* do FFTs */
+        kiss_fftr_batch(cfg,navg,tbuf,1,nfft,fbuf,1,nfreqs);
 
-        if (++avgctr == navg) {
-            avgctr=0;
-            ++nrows;
-            CHECKNULL( vals = (float*)realloc(vals,sizeof(float)*nrows*nfreqs) );
-            float eps = 1;
+        for (k=0;k<navg;++k)
             for (i=0;i<nfreqs;++i)
-                vals[(nrows - 1) * nfreqs + i] = 10 * log10 ( mag2buf[i] / navg + eps );
-            memset(mag2buf,0,sizeof(mag2buf[0])*nfreqs);
-        }
+                mag2buf[i] += fbuf[k*nfreqs+i].r * fbuf[k*nfreqs+i].r + fbuf[k*nfreqs+i].i * fbuf[k*nfreqs+i].i;
+
+        ++nrows;
+        CHECKNULL( vals = (float*)realloc(vals,sizeof(float)*nrows*nfreqs) );
+        float eps = 1;
+        for (i=0;i<nfreqs;++i)
+            vals[(nrows - 1) * nfreqs + i] = 10 * log10 ( mag2buf[i] / navg + eps );
+        memset(mag2buf,0,sizeof(mag2buf[0])*nfreqs);
     }
 
     free(cfg);
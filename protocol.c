@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "protocol.h"
+
+enum {
+    PARSE_SYNC,
+    PARSE_HEADER,
+    PARSE_PAYLOAD,
+    PARSE_CRC,
+};
+
+uint8_t proto_crc8(uint8_t crc, const uint8_t * data, int n) {
+    for (int i=0; i < n; i++) {
+        crc ^= data[i];
+        for (int b=0; b < 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void proto_parser_init(struct proto_parser * p, uint8_t sync, uint8_t * payload, uint16_t capacity) {
+    memset(p, 0, sizeof(*p));
+    p->sync = sync;
+    p->payload = payload;
+    p->capacity = capacity;
+    p->state = PARSE_SYNC;
+}
+
+int proto_feed(struct proto_parser * p, uint8_t byte) {
+    switch (p->state) {
+        case PARSE_SYNC:
+            if (byte == p->sync) {
+                p->head[0] = byte;
+                p->pos = 1;
+                p->state = PARSE_HEADER;
+            }
+            return 0;
+        case PARSE_HEADER:
+            p->head[p->pos++] = byte;
+            if (p->pos < PROTO_HEADER) { return 0; }
+            p->crc = proto_crc8(0, p->head + 1, PROTO_HEADER - 2);
+            if (p->crc != p->head[PROTO_HEADER - 1]) {
+                // not a frame after all: a real one may start within it
+                uint8_t again[PROTO_HEADER - 1];
+                memcpy(again, p->head + 1, PROTO_HEADER - 1);
+                p->state = PARSE_SYNC;
+                int ret = 0;
+                for (int i=0; i < PROTO_HEADER - 1; i++) { ret = proto_feed(p, again[i]); }
+                return ret;
+            }
+            p->cmd = p->head[1];
+            p->status = p->head[2];
+            p->len = proto_get_u16(p->head + 3);
+            p->pos = 0;
+            if (p->len > p->capacity) {
+                p->state = PARSE_SYNC;
+                return -1;
+            }
+            p->state = p->len ? PARSE_PAYLOAD : PARSE_CRC;
+            return 0;
+        case PARSE_PAYLOAD:
+            p->payload[p->pos++] = byte;
+            p->crc = proto_crc8(p->crc, &byte, 1);
+            if (p->pos == p->len) { p->state = PARSE_CRC; }
+            return 0;
+        case PARSE_CRC:
+            p->state = PARSE_SYNC;
+            return byte == p->crc ? 1 : -1;
+    }
+    return 0;
+}
+
+uint8_t proto_header(uint8_t * out, uint8_t sync, uint8_t cmd, uint8_t status, uint16_t len) {
+    out[0] = sync;
+    out[1] = cmd;
+    out[2] = status;
+    proto_put_u16(out + 3, len);
+    out[5] = proto_crc8(0, out + 1, 4);
+    return out[5];
+}
+
+void proto_put_u16(uint8_t * out, uint16_t v) {
+    out[0] = v;
+    out[1] = v >> 8;
+}
+
+void proto_put_u32(uint8_t * out, uint32_t v) {
+    for (int i=0; i < 4; i++) { out[i] = v >> (8*i); }
+}
+
+void proto_put_f32(uint8_t * out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    proto_put_u32(out, bits);
+}
+
+uint16_t proto_get_u16(const uint8_t * in) {
+    return in[0] | (in[1] << 8);
+}
+
+uint32_t proto_get_u32(const uint8_t * in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+float proto_get_f32(const uint8_t * in) {
+    uint32_t bits = proto_get_u32(in);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
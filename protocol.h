@@ -0,0 +1,118 @@
+// Binary remote-control protocol over the USB serial port, shared by the
+// firmware and the host CLI (host/spectro_cli.c).  Requests and replies
+// have the same frame:
+//
+//   sync  cmd  status  len_lo  len_hi  hcrc  payload[len]  crc
+//
+// sync is PROTO_SYNC_REQUEST from the host and PROTO_SYNC_REPLY from the
+// device, and status is 0 in requests.  hcrc is CRC-8 (polynomial 0x07)
+// over cmd to len_hi, and crc carries that on over the payload.  Multi-byte
+// payload fields are little-endian.  The device's text output shares the
+// port, so readers hunt for the sync byte; hcrc rejects a false start
+// before its "length" can swallow a real frame, and the hunt resumes from
+// the byte after it.
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+#define PROTO_VERSION 1
+#define PROTO_SYNC_REQUEST 0xa5
+#define PROTO_SYNC_REPLY 0x5a
+#define PROTO_HEADER 6  // sync, cmd, status, len, hcrc
+#define PROTO_MAX_REQUEST 16  // payload bytes the device accepts
+
+enum proto_cmd {
+    CMD_PING = 0x01,            // -> u8 version, u8 N_MODES, u16 N_SAMPLES, u32 ADC rate
+    CMD_SET_MODE = 0x02,        // u8 mode
+    CMD_SET_FFT_SIZE = 0x03,    // u16 points -> u16 points in use
+    CMD_SET_RATE = 0x04,        // u32 ADC rate, S/s -> u32 rate achieved
+    CMD_SET_VIEW = 0x05,        // u8 1 for frequency, 0 for time
+    CMD_SET_CONTINUOUS = 0x06,  // u8 on
+    CMD_TRIGGER = 0x07,         // capture and draw; replies once drawn -> u32 frame, u32 frame us
+    CMD_GET_SAMPLES = 0x08,     // -> u8 bits, then N_SAMPLES samples of 1 byte, or 2 above 8 bits
+    CMD_GET_SPECTRUM = 0x09,    // -> u8 channels, then the display-scaled bins of each, from the
+                                //    last capture
+    CMD_GET_STATS = 0x0a,       // -> struct below
+    CMD_GET_TIMING = 0x0b,      // -> u32 frames, u32 stage_time_us[N_STAGES]
+    CMD_SET_OVERSAMPLE = 0x0c,  // u8 raw conversions averaged per MODE_WIDE sample: 1, 4 or 16;
+                                //    STATUS_UNSUPPORTED past 1 in PACKED_SAMPLES builds
+    CMD_SET_HOLD = 0x0d,        // u8 enum hold_mode, f32 per-frame decay of peak- and min-hold, 0 to 1
+    CMD_SET_DB = 0x0e,          // u8 1 for a dB spectrum, f32 top dBFS, f32 range dB (6 to 200);
+                                //    u8 0 for linear, the rest unchanged
+    CMD_SET_MASK = 0x0f,        // u16 first bin, u16 last bin, f32 limit dBFS (+inf for none)
+    CMD_ARM_MASK = 0x10,        // clear a mask hit and resume continuous captures
+    CMD_GET_MASK = 0x11,        // -> struct below
+    CMD_MASK_HIT = 0x12,        // sent unasked on a mask hit -> u32 frame, u32 bins over,
+                                //    u16 worst bin, f32 worst dB over, display-scaled bins
+    CMD_SET_PERIOD = 0x13,      // u32 us between continuous captures, 0 for back to back
+    CMD_GET_TASKS = 0x14,       // -> u8 tasks, u8 reserved[3], then for each task in priority
+                                //    order: u32 runs, overruns, deferrals, forced, max us, last us
+    CMD_SET_COLUMNS = 0x15,     // u8 enum column_reduce: max, mean or RMS of a display column's bins
+    CMD_RECORD = 0x16,          // u8 on: start (in MODE_RECORD) or stop streaming to flash
+                                //    -> u32 rate recording at, 0 once stopped; STATUS_UNSUPPORTED
+                                //    when there is no flash to record to
+    CMD_GET_RECORD = 0x17,      // -> struct below
+    CMD_READ_RECORD = 0x18,     // u32 n -> sector n of the newest recording, oldest first, as
+                                //    stored (see recorder.h); out-of-range indexes and requests
+                                //    made during a recording get STATUS_BAD_VALUE
+};
+
+enum proto_status {
+    STATUS_OK,
+    STATUS_BAD_CMD,
+    STATUS_BAD_LENGTH,
+    STATUS_BAD_VALUE,
+    STATUS_UNSUPPORTED,  // e.g. an FFT size other than the build's; the reply says what is
+};
+
+// CMD_GET_STATS payload, in this order:
+//   u32 sample_rate, u8 sample_bits, u8 mode, u8 channels, u8 reserved,
+//   u32 peak bin, f32 peak Hz, f32 counter Hz, f32 pitch Hz,
+//   f32 THD, f32 THD+N, f32 SINAD dB,
+//   f32 mean V, f32 RMS V (about the mean), f32 Vpp, f32 crest factor
+#define PROTO_STATS_LEN 52
+
+// CMD_GET_MASK payload, in this order:
+//   u8 tripped, u8 reserved, u16 worst bin, u32 spectra checked, u32 hits,
+//   u32 bins over in the last spectrum checked, f32 worst dB over
+#define PROTO_MASK_LEN 20
+
+#define PROTO_TASK_LEN 24  // bytes per task in CMD_GET_TASKS
+
+// CMD_GET_RECORD payload, in this order, for the current or last recording:
+//   u8 recording, u8 reserved[3], u32 rate, u32 samples (with those lost),
+//   u32 samples lost to overruns, u32 blocks, u32 bytes written, u32 sectors
+#define PROTO_RECORD_LEN 28
+
+// Incremental frame parser: feed it one byte at a time as they arrive.
+struct proto_parser {
+    uint8_t sync;  // which sync byte starts a frame
+    uint8_t * payload;
+    uint16_t capacity;  // of payload; longer frames are dropped
+    int state;
+    uint8_t head[PROTO_HEADER];  // as received, to hunt through again after a bad hcrc
+    uint8_t cmd, status, crc;
+    uint16_t len, pos;
+};
+
+void proto_parser_init(struct proto_parser * p, uint8_t sync, uint8_t * payload, uint16_t capacity);
+
+// 1 once a whole frame with good CRCs is in p (cmd, status, len, payload),
+// -1 for a frame that failed its payload CRC or did not fit, otherwise 0.
+int proto_feed(struct proto_parser * p, uint8_t byte);
+
+uint8_t proto_crc8(uint8_t crc, const uint8_t * data, int n);
+
+// Writes the frame header to out (PROTO_HEADER bytes) and returns the CRC
+// to continue over the payload with proto_crc8.
+uint8_t proto_header(uint8_t * out, uint8_t sync, uint8_t cmd, uint8_t status, uint16_t len);
+
+void proto_put_u16(uint8_t * out, uint16_t v);
+void proto_put_u32(uint8_t * out, uint32_t v);
+void proto_put_f32(uint8_t * out, float v);
+uint16_t proto_get_u16(const uint8_t * in);
+uint32_t proto_get_u32(const uint8_t * in);
+float proto_get_f32(const uint8_t * in);
+
+#endif
@@ -0,0 +1,333 @@
+#include <string.h>
+
+#include "recorder.h"
+
+static void put_u32(uint8_t * out, uint32_t v) {
+    for (int i=0; i < 4; i++) { out[i] = v >> (8*i); }
+}
+
+static uint32_t get_u32(const uint8_t * in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static int put_varint(uint8_t * out, uint32_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+static int varint_len(uint32_t v) {
+    int n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+// Returns the bytes taken, or -1 if it runs past len or 32 bits.
+static int get_varint(const uint8_t * in, int len, uint32_t * v) {
+    *v = 0;
+    for (int i=0; i < len && i < 5; i++) {
+        *v |= (uint32_t)(in[i] & 0x7f) << (7*i);
+        if (!(in[i] & 0x80)) { return i + 1; }
+    }
+    return -1;
+}
+
+// the difference from prev, mod 256, folded so small steps either way are small
+static uint8_t zigzag(uint8_t cur, uint8_t prev) {
+    int8_t d = (int8_t)(cur - prev);
+    return (uint8_t)(d << 1) ^ (uint8_t)(d >> 7);
+}
+
+static uint8_t unzigzag(uint8_t z, uint8_t prev) {
+    return prev + ((z >> 1) ^ -(z & 1));
+}
+
+static int rice_bits(uint8_t z, int k) {
+    int q = z >> k;
+    return q < RECORD_RICE_ESCAPE ? q + 1 + k : RECORD_RICE_ESCAPE + 8;
+}
+
+// Rice parameter for residuals that sum to sum over n: about log2 of their
+// mean, which is near the best for the roughly geometric spread of
+// differences in a sampled signal.
+static int rice_k(uint32_t sum, int n) {
+    int k = 0;
+    while (k < RECORD_RAW - 1 && ((uint32_t)n << (k + 1)) < sum) { k++; }
+    return k;
+}
+
+int record_encode(const uint8_t * s, int n, uint32_t skipped, uint8_t * out, int cap, int * used) {
+    if (n > RECORD_MAX_BLOCK) { n = RECORD_MAX_BLOCK; }
+    // room for the header as if all n fit; fewer may need a byte less
+    const int head = varint_len(skipped) + varint_len(n) + 2;
+    *used = 0;
+    if (n < 1 || cap < head) { return 0; }
+
+    uint32_t sum = 0;
+    for (int i=1; i < n; i++) { sum += zigzag(s[i], s[i-1]); }
+    const int k = rice_k(sum, n - 1);
+
+    // residuals MSB first, a whole byte out whenever there is one
+    uint8_t * bits = out + head;
+    const int budget = (cap - head) * 8;
+    int nbits = 0, pos = 0;
+    uint32_t acc = 0;
+    int nacc = 0;
+    int m = 1;
+    for (; m < n; m++) {
+        const uint8_t z = zigzag(s[m], s[m-1]);
+        const int cost = rice_bits(z, k);
+        if (nbits + cost > budget) { break; }
+        nbits += cost;
+        const int q = z >> k;
+        if (q < RECORD_RICE_ESCAPE) {
+            acc = acc << (q + 1) | ((1u << (q + 1)) - 2);
+            acc = acc << k | (z & ((1u << k) - 1));
+            nacc += q + 1 + k;
+        } else {
+            acc = acc << 16 | 0xff00 | z;
+            nacc += 16;
+        }
+        while (nacc >= 8) {
+            nacc -= 8;
+            bits[pos++] = acc >> nacc;
+        }
+    }
+    if (nacc) { bits[pos++] = acc << (8 - nacc); }
+
+    // a byte a sample does better on noise
+    int raw = 1 + (cap - head);
+    if (raw > n) { raw = n; }
+    int kind = k;
+    if (raw > m || (raw == m && raw - 1 < pos)) {
+        kind = RECORD_RAW;
+        m = raw;
+        pos = m - 1;
+        memcpy(bits, s + 1, pos);
+    }
+
+    int h = put_varint(out, skipped);
+    h += put_varint(out + h, m);
+    out[h++] = kind;
+    out[h++] = s[0];
+    if (h < head) { memmove(out + h, bits, pos); }
+    *used = m;
+    return h + pos;
+}
+
+int record_decode(const uint8_t * in, int len, uint8_t * s, int max, uint32_t * skipped) {
+    uint32_t n;
+    int h = get_varint(in, len, skipped);
+    if (h < 0) { return -1; }
+    int l = get_varint(in + h, len - h, &n);
+    if (l < 0 || n < 1 || n > (uint32_t)max) { return -1; }
+    h += l;
+    if (len < h + 2) { return -1; }
+    const int k = in[h++];
+    s[0] = in[h++];
+
+    const uint8_t * bits = in + h;
+    const int nbits = (len - h) * 8;
+    if (k == RECORD_RAW) {
+        if (len - h != (int)n - 1) { return -1; }
+        memcpy(s + 1, bits, n - 1);
+        return n;
+    }
+    if (k > RECORD_RAW) { return -1; }
+
+    int pos = 0;
+    for (uint32_t i=1; i < n; i++) {
+        int q = 0;
+        uint32_t z = 0;
+        while (q < RECORD_RICE_ESCAPE) {
+            if (pos >= nbits) { return -1; }
+            if (!(bits[pos >> 3] >> (7 - (pos & 7)) & 1)) { break; }
+            q++;
+            pos++;
+        }
+        int low = k;
+        if (q == RECORD_RICE_ESCAPE) {
+            low = 8;
+        } else {
+            pos++;  // the terminating zero
+            z = q << k;
+        }
+        if (pos + low > nbits) { return -1; }
+        for (int b=low-1; b >= 0; b--, pos++) { z |= (bits[pos >> 3] >> (7 - (pos & 7)) & 1) << b; }
+        if (z > 0xff) { return -1; }
+        s[i] = unzigzag(z, s[i-1]);
+    }
+    return n;
+}
+
+// Programs the page buffer, padded with erased bytes if it is part-filled.
+static void flush_page(struct recorder * r) {
+    const uint32_t part = r->fill % RECORD_PAGE;
+    if (!part) { return; }
+    memset(r->page + part, 0xff, RECORD_PAGE - part);
+    r->flash->program(r->sector * RECORD_SECTOR + r->fill - part, r->page);
+}
+
+static void put_bytes(struct recorder * r, const uint8_t * data, int n) {
+    for (int i=0; i < n; i++) {
+        r->page[r->fill++ % RECORD_PAGE] = data[i];
+        if (r->fill % RECORD_PAGE == 0) {
+            r->flash->program(r->sector * RECORD_SECTOR + r->fill - RECORD_PAGE, r->page);
+        }
+    }
+}
+
+static void next_sector(struct recorder * r) {
+    flush_page(r);
+    r->sector = (r->sector + 1) % r->flash->n_sectors;
+    r->flash->erase(r->sector);
+    r->fill = 0;
+
+    uint8_t head[RECORD_HEADER];
+    put_u32(head, RECORD_MAGIC);
+    put_u32(head + 4, r->seq++);
+    put_u32(head + 8, r->recording);
+    put_u32(head + 12, r->rate);
+    put_u32(head + 16, r->samples);
+    put_bytes(r, head, RECORD_HEADER);
+    r->sectors++;
+}
+
+static bool sector_valid(const struct flash_ops * flash, uint32_t sector) {
+    return get_u32(flash->base + sector * RECORD_SECTOR) == RECORD_MAGIC;
+}
+
+static uint32_t sector_field(const struct flash_ops * flash, uint32_t sector, int field) {
+    return get_u32(flash->base + sector * RECORD_SECTOR + 4*field);
+}
+
+// the sector with the highest seq, or RECORD_NONE
+static uint32_t newest_sector(const struct flash_ops * flash) {
+    uint32_t newest = RECORD_NONE;
+    for (uint32_t i=0; i < flash->n_sectors; i++) {
+        if (!sector_valid(flash, i)) { continue; }
+        if (newest == RECORD_NONE || sector_field(flash, i, 1) - sector_field(flash, newest, 1) < 0x80000000u) {
+            newest = i;
+        }
+    }
+    return newest;
+}
+
+void recorder_init(struct recorder * r, const struct flash_ops * flash) {
+    memset(r, 0, sizeof(*r));
+    r->flash = flash;
+    uint32_t newest = newest_sector(flash);
+    if (newest == RECORD_NONE) {
+        r->sector = flash->n_sectors - 1;
+    } else {
+        r->sector = newest;
+        r->seq = sector_field(flash, newest, 1) + 1;
+        r->recording = sector_field(flash, newest, 2);
+    }
+    r->fill = RECORD_SECTOR;  // the next write starts a sector
+}
+
+void recorder_start(struct recorder * r, uint32_t rate, uint8_t * block) {
+    r->block = block;
+    r->active = true;
+    r->recording++;
+    r->rate = rate;
+    r->samples = 0;
+    r->fill = RECORD_SECTOR;
+    r->sectors = r->blocks = r->coded = r->skipped = 0;
+}
+
+int recorder_write(struct recorder * r, const uint8_t * s, int n, uint32_t skipped) {
+    int taken = 0;
+    while (n > 0) {
+        // a block needs its length, its header and a sample
+        if (r->fill + 2 + RECORD_BLOCK_HEAD + 1 > RECORD_SECTOR) { next_sector(r); }
+        int used;
+        const int len = record_encode(s, n, skipped, r->block, RECORD_SECTOR - r->fill - 2, &used);
+        const uint8_t len_bytes[2] = {len & 0xff, len >> 8};
+        put_bytes(r, len_bytes, 2);
+        put_bytes(r, r->block, len);
+
+        r->samples += skipped + used;
+        r->skipped += skipped;
+        r->blocks++;
+        r->coded += len + 2;
+        taken += len + 2;
+        skipped = 0;
+        s += used;
+        n -= used;
+    }
+    return taken;
+}
+
+void recorder_stop(struct recorder * r) {
+    if (!r->active) { return; }
+    flush_page(r);
+    r->active = false;
+}
+
+struct record_extent record_find(const struct flash_ops * flash) {
+    struct record_extent e = {RECORD_NONE, 0, 0, 0};
+    uint32_t newest = newest_sector(flash);
+    if (newest == RECORD_NONE) { return e; }
+
+    // the recording's sectors run back from its newest, seq by seq
+    e.recording = sector_field(flash, newest, 2);
+    e.rate = sector_field(flash, newest, 3);
+    e.first_sector = newest;
+    e.n_sectors = 1;
+    while (e.n_sectors < flash->n_sectors) {
+        uint32_t prev = (e.first_sector + flash->n_sectors - 1) % flash->n_sectors;
+        if (!sector_valid(flash, prev) || sector_field(flash, prev, 2) != e.recording
+            || sector_field(flash, prev, 1) != sector_field(flash, e.first_sector, 1) - 1) {
+            break;
+        }
+        e.first_sector = prev;
+        e.n_sectors++;
+    }
+    return e;
+}
+
+void record_reader_open(struct record_reader * rd, const struct flash_ops * flash) {
+    rd->flash = flash;
+    rd->extent = record_find(flash);
+    rd->done = 0;
+    rd->offset = RECORD_HEADER;
+    rd->next_sample = 0;
+}
+
+int record_read(struct record_reader * rd, uint8_t * s, int max, uint32_t * skipped) {
+    uint32_t lost = 0;
+    while (rd->done < rd->extent.n_sectors) {
+        const uint32_t sector = (rd->extent.first_sector + rd->done) % rd->flash->n_sectors;
+        const uint8_t * base = rd->flash->base + sector * RECORD_SECTOR;
+        if (rd->offset == RECORD_HEADER) {
+            // the ring may have overwritten the samples before this sector
+            uint32_t first = get_u32(base + 16);
+            if (first > rd->next_sample) {
+                lost += first - rd->next_sample;
+                rd->next_sample = first;
+            }
+        }
+        if (rd->offset + 2 <= RECORD_SECTOR) {
+            const int len = base[rd->offset] | base[rd->offset + 1] << 8;
+            if (len != 0xffff) {
+                if (rd->offset + 2 + len > RECORD_SECTOR) { return -1; }
+                uint32_t block_skipped;
+                int n = record_decode(base + rd->offset + 2, len, s, max, &block_skipped);
+                if (n < 0) { return -1; }
+                rd->offset += 2 + len;
+                rd->next_sample += block_skipped + n;
+                *skipped = lost + block_skipped;
+                return n;
+            }
+        }
+        rd->done++;
+        rd->offset = RECORD_HEADER;
+    }
+    return 0;
+}
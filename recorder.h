@@ -0,0 +1,122 @@
+// Long recordings of 8 bit samples to flash, compressed as they go.  The
+// recording area is a ring of erase sectors written in order, so a
+// recording longer than the ring keeps its most recent part and wear is
+// spread evenly.  Each sector starts with a header:
+//
+//   u32 RECORD_MAGIC, u32 seq, u32 recording, u32 sample rate, u32 first sample
+//
+// seq counts up with every sector written, so the newest sector (and from
+// it the write position) is found again after a reset; recording numbers
+// the recordings, and first is the index of the sector's first sample in
+// its recording.  Blocks of samples follow, each a u16 length and that many
+// coded bytes; a length of 0xffff (erased flash) ends the sector.  A block
+// is self-contained:
+//
+//   varint skipped, varint n, u8 k, u8 first sample, residuals
+//
+// skipped counts samples lost just before the block (the capture overran
+// the writer), n the samples in it.  The residuals are the n-1 differences
+// from sample to sample mod 256, zigzagged to 0-255 and Rice coded with
+// parameter k, MSB first: the quotient in unary (ones and a zero) then the
+// low k bits.  A quotient of RECORD_RICE_ESCAPE or more is sent as that
+// many ones then the 8 bit value.  k of RECORD_RAW means the residuals are
+// the samples themselves, uncoded, which caps a block at a byte a sample
+// plus its header.  Multi-byte fields are little-endian.
+//
+// The flash is reached through struct flash_ops, so this builds on Linux
+// against RAM standing in for the flash.
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RECORD_SECTOR 4096  // erase unit
+#define RECORD_PAGE 256  // program unit
+#define RECORD_MAGIC 0x31434552  // "REC1"
+#define RECORD_HEADER 20  // bytes of sector header
+#define RECORD_MAX_BLOCK 4096  // samples in a block
+#define RECORD_BLOCK_HEAD 9  // largest block header: two varints, k and the first sample
+#define RECORD_RAW 8  // k for uncoded residuals
+#define RECORD_RICE_ESCAPE 8  // quotients from here on are sent as 8 bits
+#define RECORD_NONE 0xffffffffu
+
+struct flash_ops {
+    uint32_t n_sectors;  // in the ring
+    const uint8_t * base;  // the ring, memory mapped
+    void (*erase)(uint32_t sector);
+    void (*program)(uint32_t offset, const uint8_t * page);  // RECORD_PAGE bytes at a page boundary
+};
+
+struct recorder {
+    const struct flash_ops * flash;
+    bool active;
+    uint32_t recording;  // being written, or the last one written
+    uint32_t rate;
+    uint32_t seq;  // for the next sector started
+    uint32_t sector;  // being written
+    uint32_t fill;  // bytes of it used, the last fill % RECORD_PAGE of them still in page
+    uint32_t samples;  // of this recording so far, with those skipped
+    uint8_t page[RECORD_PAGE];
+    uint8_t * block;  // the caller's RECORD_SECTOR bytes, a block on its way into page
+
+    // statistics for the recording
+    uint32_t sectors;  // started
+    uint32_t blocks;
+    uint32_t coded;  // bytes of blocks, with their lengths
+    uint32_t skipped;  // samples lost to overruns
+};
+
+// Encodes as many of the n samples as fit in cap bytes, up to
+// RECORD_MAX_BLOCK, and returns the bytes used; *used says how many
+// samples that was.  Returns 0 if there is no room for even one.
+int record_encode(const uint8_t * s, int n, uint32_t skipped, uint8_t * out, int cap, int * used);
+
+// Decodes the len byte block in into at most max samples.  Returns the
+// number decoded, or -1 for a block that is malformed or holds more than
+// max.
+int record_decode(const uint8_t * in, int len, uint8_t * s, int max, uint32_t * skipped);
+
+// Finds the newest sector, to carry on after it.
+void recorder_init(struct recorder * r, const struct flash_ops * flash);
+
+// Starts a recording.  block, RECORD_SECTOR bytes, is only used until
+// recorder_stop(), so it can be RAM that is otherwise idle while recording.
+void recorder_start(struct recorder * r, uint32_t rate, uint8_t * block);
+
+// Appends n (at least 1) samples, after `skipped` that were lost, erasing sectors ahead
+// as they are needed.  Returns the flash bytes it took.
+int recorder_write(struct recorder * r, const uint8_t * s, int n, uint32_t skipped);
+
+// Programs the part-filled last page.
+void recorder_stop(struct recorder * r);
+
+// The newest recording, as it survives in the ring: its oldest sector
+// and how many there are, RECORD_NONE and 0 for none.
+struct record_extent {
+    uint32_t recording;
+    uint32_t rate;
+    uint32_t first_sector;
+    uint32_t n_sectors;
+};
+
+struct record_extent record_find(const struct flash_ops * flash);
+
+// Reads a recording back a block at a time, in order.
+struct record_reader {
+    const struct flash_ops * flash;
+    struct record_extent extent;
+    uint32_t done;  // sectors finished
+    uint32_t offset;  // in the current one
+    uint32_t next_sample;  // index in the recording expected next
+};
+
+void record_reader_open(struct record_reader * rd, const struct flash_ops * flash);
+
+// The next block's samples, at most max (RECORD_MAX_BLOCK will always do),
+// and in *skipped the samples missing before them: overruns, and the start
+// of a recording that the ring has since overwritten.  Returns the number
+// of samples, 0 at the end, or -1 for a damaged block.
+int record_read(struct record_reader * rd, uint8_t * s, int max, uint32_t * skipped);
+
+#endif
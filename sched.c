@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "sched.h"
+
+void sched_init(struct scheduler * s, struct sched_task * tasks, int n_tasks, uint64_t (*now_us)(void)) {
+    s->tasks = tasks;
+    s->n_tasks = n_tasks;
+    s->now_us = now_us;
+    s->deadline_us = SCHED_NO_DEADLINE;
+    sched_reset_stats(s);
+}
+
+void sched_reset_stats(struct scheduler * s) {
+    for (int i=0; i < s->n_tasks; i++) {
+        struct sched_task * t = &s->tasks[i];
+        t->runs = t->overruns = t->deferrals = t->forced = 0;
+        t->last_us = t->max_us = 0;
+        t->total_us = 0;
+        t->deferred = 0;
+        t->deferred_for = SCHED_NO_DEADLINE;
+    }
+}
+
+// Whether t, started now, would finish after the deadline.
+static bool at_risk(const struct scheduler * s, const struct sched_task * t, uint64_t now) {
+    return s->deadline_us != SCHED_NO_DEADLINE && now + t->budget_us > s->deadline_us;
+}
+
+int sched_step(struct scheduler * s) {
+    uint64_t now = s->now_us();
+    for (int i=0; i < s->n_tasks; i++) {
+        struct sched_task * t = &s->tasks[i];
+        if (!t->ready()) { continue; }
+        bool forced = false;
+        if (t->deferrable && at_risk(s, t, now)) {
+            if (!t->max_defer || t->deferred < t->max_defer) {
+                // counted once per deadline, however many steps it waits
+                if (t->deferred_for != s->deadline_us) {
+                    t->deferred_for = s->deadline_us;
+                    t->deferrals++;
+                    t->deferred++;
+                }
+                continue;
+            }
+            forced = true;
+        }
+
+        t->run();
+        uint64_t elapsed = s->now_us() - now;
+        t->last_us = elapsed;
+        if (t->last_us > t->max_us) { t->max_us = t->last_us; }
+        t->total_us += elapsed;
+        t->runs++;
+        if (elapsed > t->budget_us) { t->overruns++; }
+        if (forced) { t->forced++; }
+        t->deferred = 0;
+        t->deferred_for = SCHED_NO_DEADLINE;
+        return i;
+    }
+    return -1;
+}
@@ -0,0 +1,49 @@
+// Cooperative scheduler for the main loop.  Tasks run to completion in
+// priority order (their order in the table), one per sched_step(), so a
+// capture that comes due is never more than one task away.  Work marked
+// deferrable is put off while running it within its budget would overrun
+// the next capture deadline.  The clock is passed in, so the policy can be
+// tested on Linux with a fake one.
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHED_NO_DEADLINE UINT64_MAX
+
+struct sched_task {
+    const char * name;
+    bool (*ready)(void);  // has work to do now
+    void (*run)(void);
+    uint32_t budget_us;  // expected worst case; longer runs count as overruns
+    bool deferrable;  // may wait for the capture deadline to pass
+    uint16_t max_defer;  // deadlines in a row it waits out before running regardless, 0 for no limit
+
+    // statistics
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t deferrals;
+    uint32_t forced;  // runs despite the deadline, after max_defer deferrals
+    uint32_t last_us, max_us;
+    uint64_t total_us;
+    uint16_t deferred;  // deadlines waited out since it last ran
+    uint64_t deferred_for;  // the deadline it is waiting out
+};
+
+struct scheduler {
+    struct sched_task * tasks;
+    int n_tasks;
+    uint64_t (*now_us)(void);
+    uint64_t deadline_us;  // of the next capture, or SCHED_NO_DEADLINE
+};
+
+void sched_init(struct scheduler * s, struct sched_task * tasks, int n_tasks, uint64_t (*now_us)(void));
+
+// Runs the highest-priority ready task that fits before the deadline.
+// Returns its index, or -1 if there was nothing to run.
+int sched_step(struct scheduler * s);
+
+void sched_reset_stats(struct scheduler * s);
+
+#endif
@@ -1,48 +1,88 @@
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
 
 #include "hardware/adc.h"
+#include "hardware/clocks.h"
 #include "hardware/dma.h"
+#include "hardware/flash.h"
 #include "hardware/gpio.h"
-#include "hardware/i2c.h"
+#include "hardware/sync.h"
 
 #include "kissfft/kiss_fftr.h"
 
+#include "display.h"
+#include "fastlog.h"
 #include "font8x8_basic.h"
+#include "protocol.h"
+#include "recorder.h"
 #define FONT_WIDTH 8
 
+#include "spectro.h"
 
-#define LED_GPIO 13
-#define IMPULSE_GPIO 0
-
-#define SDA_PIN 2
-#define SCL_PIN 3
-// assuming here that SCL is consistent
-#if ((SDA_PIN/2) % 2)
-#define WHICH_I2C i2c1
-#else
-#define WHICH_I2C i2c0
-#endif
-#define I2C_KHZ 400
 
-#define DISPLAY_ADDR 0x3c
-#define WIDTH 128
-#define HEIGHT 64
+#define LED_GPIO 13
+#define IMPULSE_GPIO 0  // idles low, high during each capture, and pulsed on a mask hit
+#define MASK_PULSE_US 10  // the mask hit pulse on IMPULSE_GPIO
 
 #define ADC_CHANNEL 0 // Channel 0 is GPIO26
-#define N_SAMPLES 8192  // 8192 -> ~20 ms
+#define MAX_CHANNELS 4 // round robin over channels 0-3, GPIO26-29
 
 #define WAIT_TIME_MS 10
+#define SETTLE_TIME_MS 2  // let the stimulated system recover between averaged captures
+#define MAX_AVERAGES 256  // keeps the accumulator within 16 bits for 8 bit samples
+#define WIDE_BLOCK 256  // raw conversions per ping-pong DMA block in 12 bit mode
+#define ADC_CYCLES 96  // ADC clock cycles per conversion
+#define MAX_ETS_PHASES 32  // 3 ADC clocks per step, near the start jitter of 1
+#define HOLD_FLOOR 1.0f  // |X| a min-hold of 0 relaxes up from, some 70 dB under a one-count sine
+#define THD_HARMONICS 10  // highest harmonic counted as distortion
+#define THD_HALFWIDTH 6  // bins either side of a tone that hold its power, for the window below
+#define PEAK_MARGIN_DB 15  // a listed peak is at least this far above the noise floor
+#define PEAK_BUCKETS 96  // half-octaves of |X|^2 in the noise floor histogram, from 1 up
+#define MAX_BANDS 64  // fractional-octave bands; any further below fold into the lowest
+#define BH_POWER_GAIN 0.2580  // mean square of the Blackman-Harris window, for band levels
+#define MASK_DEFAULT_DB -40  // limit for every bin until set otherwise, dBFS
+#define MASK_OPEN INT16_MAX  // mask_q8 for a bin with no limit
+#define PITCH_THRESHOLD 0.85  // first autocorrelation peak this close to the highest is the period
+#define PITCH_MIN_LAG 4  // 125 kHz at the full rate
+#define PITCH_MAX_LAG (N_SAMPLES*3/8)  // keeps a quarter of the half record overlapping
+
+#define RECORD_FLASH_OFFSET (1024 * 1024)  // recordings from here to the end of flash, clear of the program
+#define RECORD_RING_BITS 14
+#define RECORD_RING (1 << RECORD_RING_BITS)  // bytes of DMA ring the recorder takes samples from
+#define RECORD_CHUNK 1024  // samples the record task takes at a time
+#define RECORD_DRAW_CHUNKS 16  // chunks between display frames while recording
+#define FLASH_ERASE_US 50000  // 4 KB sector erase, typical for the board's QSPI flash
+#define FLASH_PAGE_US 700  // 256 byte page program, likewise
 
 #define BUTTON_HOLD_MS 1000
+#define POLL_MAX_BYTES 64  // command bytes taken per main loop pass
 
 
 uint8_t samples[N_SAMPLES];
 uint dma_chan;
 dma_channel_config dma_cfg;
+
+// 12 bit captures keep the top 8 bits in samples, so everything that draws
+// from samples works unchanged, and the rest of each sample here.  Packed,
+// that is just the low nibbles two to a byte; otherwise the whole (possibly
+// oversampled, up to 14 bit) value is kept.
+#if PACKED_SAMPLES
+uint8_t samples_lo[N_SAMPLES/2];
+#else
+uint16_t samples_wide[N_SAMPLES];
+#endif
+uint16_t wide_dma_block[2][WIDE_BLOCK];
+uint wide_dma_chan[2];
+int oversample = 1;  // raw conversions averaged per 12 bit mode sample: 1, 4 or 16
+int ets_phases = 8;  // MODE_ETS captures per record, each offset 1/ets_phases of a sample
+uint8_t ets_moved[N_SAMPLES/8];  // bitmap for the in-place interleave
+uint32_t adc_rate = SAMPLE_RATE;  // free-running conversions per second, see set_adc_rate()
+uint32_t sample_rate = SAMPLE_RATE;  // of the last capture, after any decimation
+int sample_bits = SAMPLE_BITS;  // of the last capture
 int display_spacing = 1;
 float maxval_samples = 255.;
 
@@ -52,16 +92,207 @@ bool should_print=false;
 bool draw_frequency=false;
 bool continuous_mode=false;
 
+enum mode mode = MODE_SCOPE;
+int n_channels = 4;  // channels captured in MODE_MULTICHANNEL: 2 or 4
+bool overlay_channels = false;  // draw channels on top of each other rather than stacked
+int n_averages = 64;  // aligned captures summed per MODE_TRANSFER result
+
 alarm_id_t alarm_id_9 = -2;
 alarm_id_t alarm_id_8 = -2;
 alarm_id_t alarm_id_7 = -2;
 
 bool display_buffer[WIDTH][HEIGHT];
 
+// results of the last spectrum, used for the peak-zoom and its label.  With
+// several channels each gets N_SAMPLES/(2*n) + 1 consecutive bins.  The
+// single-channel spectrum only fills fftabs when it is to be sent (see
+// export_wanted() and export_spectrum()); the display gets its columns
+// straight from |X|^2.
+uint8_t fftabs[N_SAMPLES/2 + MAX_CHANNELS];
+kiss_fftr_cfg fft_plan;  // the N_SAMPLES real forward transform, shared by every mode that takes one
+int chan_peak_idx[MAX_CHANNELS];
+int maxfftidx;
+double maxfftsq;
+
+// the single-channel spectrum reduced to display columns, scaled 0-255
+enum column_reduce column_reduce = REDUCE_MAX;
+uint8_t spectrum_columns[WIDTH];
+int n_columns;  // from the left; the rest have no bins at this display_spacing
+double column_refsq;  // |X|^2 at the top of the linear columns and hold trace
+
+// hold traces over the single-channel spectrum, per display column, in
+// |X| units.  hold_spacing is the display_spacing they were built at (0 for
+// not built), since a column covers a different set of bins at each.
+enum hold_mode hold_mode = HOLD_OFF;
+float hold_decay = 0.9;  // per-frame amplitude factor for peak- and min-hold
+float hold_trace[WIDTH];
+int hold_spacing = 0;
+
+bool db_display = false;  // spectrum in dB rather than linear in |X|
+float db_ref = 0;  // top of the dB display, dBFS
+float db_range = 80;  // dB from top to bottom of the display
+
+struct thd_result thd;  // from the last MODE_THD spectrum
+struct pitch_result pitch;  // from the last MODE_PITCH spectrum
+
+// MODE_MASK limit on the windowed |X|^2 of each bin, in Q8 dB (1/256 dB)
+// from a full-scale sine's, MASK_OPEN for none; a per-band mask is the same
+// limit over each band's bins.  Checking it costs a table log (db10_q8) and
+// a compare per bin in the magnitude loop.  On a hit the display freezes (no more continuous
+// captures) until re-armed with A or CMD_ARM_MASK, IMPULSE_GPIO pulses and
+// the spectrum goes out as a CMD_MASK_HIT frame.
+int16_t mask_q8[N_SAMPLES/2 + 1];
+int32_t mask_fullscale_q8;  // a full-scale sine's bin in Q8 dB, at the current sample bits
+bool mask_set = false;  // false until the default mask is filled in
+bool mask_tripped = false;
+uint32_t mask_frames;  // spectra checked
+uint32_t mask_hits;  // of them, with a bin over its limit
+int mask_violations;  // bins over in the last spectrum checked
+int mask_worst_bin;
+float mask_worst_db;  // by how far it was over
+
+// One pass over each capture gives the time view's readings, the maxval
+// autoscale and the spectrum's mean; stats_fresh says it has been made.
+struct sample_stats stats;
+bool stats_fresh = false;
+bool stats_overlay = true;  // readings over single-channel time views
+float cal_fullscale = 3.3;  // volts at the top of the ADC range
+float cal_offset = 0;  // volts at code 0, for a front end that shifts the input
+
+// MODE_BANDS sums |X|^2 into bands centred on 1 kHz * 2^(n/band_fraction),
+// through a table from bin to band built whenever the bins move.  Bands go
+// down from Nyquist until one would hold no bin; everything below goes into
+// the lowest.  DC is in none.
+int band_fraction = 3;  // bands per octave: 1 or 3
+uint8_t band_of_bin[N_SAMPLES/2 + 1];  // 0xff for none
+int n_bands;
+float band_center[MAX_BANDS];  // Hz, nominal
+uint32_t band_table_rate;  // sample_rate the table was built for, 0 for not built
+int band_table_fraction;
+double band_sq[MAX_BANDS];
+uint8_t band_level[MAX_BANDS];  // on the dB display scale, 0-255
+
+// The largest local maxima of the MODE_PEAKS spectrum, kept while it is
+// computed in a min-heap of N_PEAKS, so the smallest is the one to replace.
+// The noise floor is the median bin, from a histogram of log |X|^2 filled
+// in the same pass.
+struct peak_candidate {
+    double sq;
+    int bin;
+};
+struct peak_candidate peak_heap[N_PEAKS];
+int peak_heap_n;
+uint16_t peak_hist[PEAK_BUCKETS];
+double peak_prev[2];  // |X|^2 of the two bins before the one being tracked
+struct peak peaks[N_PEAKS];  // largest first
+int n_peaks;
+float noise_floor_db;  // dBFS per bin
+
+// MODE_COUNTER times rising crossings of counter_level + counter_hysteresis,
+// re-armed only by dropping below counter_level - counter_hysteresis, so
+// noise riding on an edge is not counted twice.  The level follows the
+// middle of the previous block.
+int counter_blocks = 1;  // captures counted per reading, each adding its own cycles and span
+int counter_hysteresis = 4;  // 8 bit counts either side of the level
+int counter_level = 128;
+struct counter_result counter;
+double counter_span;  // samples between first and last crossing, summed over blocks
+
+uint64_t capture_time_us;  // time_us_64() at the start of the last capture
+uint32_t frame_count;  // frames drawn since boot
+
+// remote control over USB, see protocol.h
+uint8_t command_payload[PROTO_MAX_REQUEST];
+struct proto_parser command_parser;
+bool trigger_pending = false;  // a CMD_TRIGGER waiting for its frame to be drawn
+
+// main loop schedule, see setup_loop()
+struct scheduler loop_sched;
+uint32_t capture_period_us = 0;  // between continuous captures, 0 to run them back to back
+uint64_t next_capture_us;
+uint64_t next_ui_us;
+enum frame_stage frame_stage = FRAME_IDLE;
+bool print_pending = false;  // samples of the last capture still to go out
+
+// MODE_RECORD streams the ADC to flash through the recorder (recorder.h).
+// The DMA runs free round its ring and the record task takes a chunk
+// at a time from behind it, so the ring has to hold whatever arrives while
+// a sector erase stops the CPU.  Chunks are copied out into samples first,
+// which leaves the last N_SAMPLES of the recording there for the display,
+// written round like the ring.
+//
+// Buffers only one mode uses share their RAM: the ring and the recorder's
+// block scratch, MODE_TRANSFER's sum of captures, the pitch overlap
+// energies and the channel-pair spectra.  A recording stops on leaving
+// its mode, and the rest only live from a capture to its analysis.
+union mode_buffers {
+    struct {
+        uint8_t ring[RECORD_RING];
+        uint8_t block[RECORD_SECTOR];  // see recorder_start()
+    } record;
+    uint16_t accum[N_SAMPLES];  // sum of the last n_averages stimulus-aligned captures
+    float pitch_energy[PITCH_MAX_LAG + 1];  // see analyse_pitch()
+    kiss_fft_cpx pair_spectra[N_SAMPLES/2];  // see compute_multichannel_spectrum()
+} mode_buf __attribute__((aligned(RECORD_RING)));  // the DMA ring wraps on alignment
+struct flash_ops record_flash;
+struct recorder recorder;
+struct record_extent record_extent;  // the recording CMD_READ_RECORD reads from
+bool recording = false;
+uint32_t record_taken;  // samples taken from the ring
+uint32_t record_chunks;  // of them, whole chunks
+uint32_t record_rate_before;  // adc_rate to go back to afterwards
+
+const char * hold_names[N_HOLD_MODES] = {"off", "peak", "max", "min"};
+const char * mode_names[N_MODES] = {"scope", "multichannel", "transfer", "12 bit scope", "THD", "equivalent time", "counter", "fundamental", "peaks", "bands", "mask", "record"};
+const char * stage_names[N_STAGES] = {"capture", "print", "fft", "plot", "label", "display"};
+uint32_t stage_time_us[N_STAGES];
+
+int active_channels() {
+    return mode == MODE_MULTICHANNEL ? n_channels : 1;
+}
+
+// log4 of the oversampling ratio: the bits gained by averaging
+int oversample_shift() {
+    return oversample >= 16 ? 2 : oversample >= 4 ? 1 : 0;
+}
+
+int wide_sample_bits() {
+#if PACKED_SAMPLES
+    return 12;
+#else
+    return 12 + oversample_shift();
+#endif
+}
+
+uint16_t wide_sample(int i) {
+#if PACKED_SAMPLES
+    return (samples[i] << 4) | ((samples_lo[i/2] >> (4*(i & 1))) & 0xf);
+#else
+    return samples_wide[i];
+#endif
+}
+
+void store_wide_sample(int i, uint16_t val) {
+#if PACKED_SAMPLES
+    samples[i] = val >> 4;
+    if (i & 1) {
+        samples_lo[i/2] = (samples_lo[i/2] & 0x0f) | ((val & 0xf) << 4);
+    } else {
+        samples_lo[i/2] = (samples_lo[i/2] & 0xf0) | (val & 0xf);
+    }
+#else
+    samples_wide[i] = val;
+    samples[i] = val >> (wide_sample_bits() - 8);
+#endif
+}
+
 void setup_adc() {
     bi_decl(bi_1pin_with_name(26 + ADC_CHANNEL, "ADC pin for capturing"));
 
     adc_gpio_init(26 + ADC_CHANNEL);
+    for (int i=0; i < MAX_CHANNELS; i++) {
+        if (i != ADC_CHANNEL) { adc_gpio_init(26 + i); }
+    }
 
     adc_init();
     adc_select_input(ADC_CHANNEL);
@@ -79,42 +310,29 @@ void setup_adc() {
     // cycles, so in general you want a divider of 0 (hold down the button
     // continuously) or > 95 (take samples less frequently than 96 cycle
     // intervals). This is all timed by the 48 MHz ADC clock.
-    adc_set_clkdiv(0);
+    set_adc_rate(adc_rate);
 
 }
 
-int write_display_buffer() {
-    int thisret, ret = 0;
-
-    uint8_t byte_buffer[HEIGHT+1];
-    byte_buffer[0] = 0x40;  //control byte, all follow data
-    for (int i=0;i<HEIGHT;i++) {
-        byte_buffer[i+1] = 0;
+// Sets the free-running ADC rate, up to the full rate, and returns the rate
+// the divider actually gives: it has 8 fractional bits.
+uint32_t set_adc_rate(uint32_t rate) {
+    const uint32_t clk = clock_get_hz(clk_adc);
+    if (rate == 0 || rate >= clk / ADC_CYCLES) {
+        adc_set_clkdiv(0);
+        adc_rate = clk / ADC_CYCLES;
+        return adc_rate;
     }
+    float div = round(((float)clk / rate - 1) * 256) / 256;
+    if (div > 65535) { div = 65535; }
+    adc_set_clkdiv(div);
+    adc_rate = lround(clk / (div + 1));
+    return adc_rate;
+}
 
-    uint8_t reset_pointer_cmds[3] = {0x0, 0x10, 0xb0};
-
-    for (int i=0; i < (WIDTH/8); i++) {
-        // reset the byte buffer
-        for (int j=0; j<HEIGHT; j++) { byte_buffer[j+1] = 0; }
-
-        reset_pointer_cmds[2] = 0xb0 + i;
-        if (i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, reset_pointer_cmds, 3, false) == PICO_ERROR_GENERIC) {return PICO_ERROR_GENERIC;}
-
-        for (int j=0; j < HEIGHT; j++) {
-            for (int k=0; k < 8; k++) {
-                byte_buffer[j+1] += display_buffer[i*8+k][j] << k;
-            }
-        }
-
-        thisret = i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, byte_buffer, HEIGHT+1, false);
-        if (ret == PICO_ERROR_GENERIC) {
-            return ret;
-        } else {
-            ret += thisret;
-        }
-    }
-    return ret;
+// Sends display_buffer with the backend chosen at build time (display.h).
+int write_display_buffer() {
+    return DISPLAY_DRIVER.flush(display_buffer);
 }
 
 void clear_buffer() {
@@ -134,39 +352,46 @@ int char_to_buffer(char chr, uint x, uint y) {
     }
 }
 
-int plot_to_buffer(uint8_t * samplearr, int nsamp, float maxval) {
+// Plots every `stride`-th of nsamp values into rows y0 to y0+h-1, averaging
+// display_spacing values per column.  Does not clear the buffer.
+int plot_to_buffer(uint8_t * samplearr, int nsamp, int stride, float maxval, int y0, int h) {
     assert(nsamp >= WIDTH);
     int sample_idx = 0;
     float avgval;
 
-    clear_buffer();
-
     for (int i=0; i < WIDTH; i++) {
         avgval = 0;
         for (int j=0; j < display_spacing; j++) {
-            avgval += samplearr[sample_idx++];
+            avgval += samplearr[stride*sample_idx++];
             if (sample_idx >= nsamp) {
                 return -1;
             }
         }
         avgval /= display_spacing;
 
-        int valint = (int)round(avgval * ((HEIGHT-1.)/maxval));
+        int valint = (int)round(avgval * ((h-1.)/maxval));
 
         // clamp to display range
-        if (valint >= HEIGHT) { valint = HEIGHT-1; }
+        if (valint >= h) { valint = h-1; }
         if (valint < 0) { valint = 0; }
-        display_buffer[i][valint] = true;
+        display_buffer[i][y0 + valint] = true;
     }
     return 0;
 }
-int plot_around_to_buffer(uint8_t * samplearr, int nsamp, int around_idx, float maxval) {
+// Columns already reduced to one value each, 0-255.
+void plot_columns_to_buffer(const uint8_t * cols, int ncols, int y0, int h) {
+    for (int i=0; i < ncols; i++) {
+        int valint = (int)round(cols[i] * ((h-1.)/255.));
+        if (valint >= h) { valint = h-1; }
+        display_buffer[i][y0 + valint] = true;
+    }
+}
+
+int plot_around_to_buffer(uint8_t * samplearr, int nsamp, int around_idx, float maxval, int y0, int h) {
     assert(nsamp >= WIDTH);
 
     int start_idx;
 
-    clear_buffer();
-
     if (around_idx < WIDTH / 2) {
         start_idx = 0;
     }  else if (around_idx > (nsamp - WIDTH/2)) {
@@ -176,45 +401,20 @@ int plot_around_to_buffer(uint8_t * samplearr, int nsamp, int around_idx, float
     }
 
     for (int i=0; i < WIDTH; i++) {
-        int valint = (int)round(samplearr[i+start_idx] * ((HEIGHT-1.)/maxval));
+        int valint = (int)round(samplearr[i+start_idx] * ((h-1.)/maxval));
         // clamp to display range
-        if (valint >= HEIGHT) { valint = HEIGHT-1; }
+        if (valint >= h) { valint = h-1; }
         if (valint < 0) { valint = 0; }
-        display_buffer[i][valint] = true;
+        display_buffer[i][y0 + valint] = true;
     }
 
     return 0;
 }
 
 void setup_display() {
-    const uint8_t display_on[2] = {0x0, 0xaf};
-    const uint8_t display_init_bytes[20] = {0x0,  //control byte - many command follow
-                        0xae, // display off
-                        0xdc, 0, // start line 0 - default
-                        0x81, 0x4f, //contrast
-                        0x20, // vertical addressing - default?
-                        0xa0,  // down rotation/segment remap=0
-                        0xc0, // scan direction - default
-                        0xa8, 0x3f, // multiplex=64
-                        0xd3, 0x60, // display offset - 0x60 according to featherwing/adafruit sh1107 driver docs?
-                        0xd9, 0x22, // pre-charge/dis-charge period mode: 2 DCLKs/2 DCLKs - default
-                        0xdb, 0x35, // VCOM deselect level = 0.770 - default
-                        0xa4, // normal/disp off - default
-                        0xa6 // normal (not reversed) display - default
-    };
-    const size_t n_init_bytes = 20;
-
-    bi_decl(bi_2pins_with_func(SDA_PIN, SCL_PIN, GPIO_FUNC_I2C));
-
-    i2c_init(WHICH_I2C, I2C_KHZ * 1000);
-    gpio_set_function(SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(SDA_PIN);
-    gpio_pull_up(SCL_PIN);
-
-    i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, display_init_bytes, n_init_bytes, false);
+    printf("Display: %s\n", DISPLAY_DRIVER.name);
+    DISPLAY_DRIVER.init();
     clear_buffer();
-    i2c_write_blocking(WHICH_I2C, DISPLAY_ADDR, display_on, 2, false);
 }
 
 void setup_dma() {
@@ -228,9 +428,38 @@ void setup_dma() {
 
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&dma_cfg, DREQ_ADC);
+
+    // 12 bit mode ping-pongs between two blocks, each channel chained to
+    // the other, so the CPU can decimate/pack one while the other fills
+    wide_dma_chan[0] = dma_claim_unused_channel(true);
+    wide_dma_chan[1] = dma_claim_unused_channel(true);
+    for (int i=0; i < 2; i++) {
+        dma_channel_config cfg = dma_channel_get_default_config(wide_dma_chan[i]);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+        channel_config_set_read_increment(&cfg, false);
+        channel_config_set_write_increment(&cfg, true);
+        channel_config_set_dreq(&cfg, DREQ_ADC);
+        channel_config_set_chain_to(&cfg, wide_dma_chan[!i]);
+        dma_channel_configure(wide_dma_chan[i], &cfg, wide_dma_block[i], &adc_hw->fifo, WIDE_BLOCK, false);
+    }
+}
+
+// The one N_SAMPLES plan, kept for good rather than allocated per frame.
+void setup_fft() {
+    fft_plan = kiss_fftr_alloc(N_SAMPLES, false, 0, 0);
 }
 
 void capture_dma() {
+    if (mode == MODE_MULTICHANNEL) {
+        // the round robin starts from whichever input is selected, so the
+        // buffer comes out interleaved as ch0, ch1, ..., ch0, ch1, ...
+        adc_select_input(0);
+        adc_set_round_robin((1u << n_channels) - 1);
+    } else {
+        adc_set_round_robin(0);
+        adc_select_input(ADC_CHANNEL);
+    }
+
     dma_channel_configure(dma_chan, &dma_cfg,
         samples,    // dst
         &adc_hw->fifo,  // src
@@ -239,18 +468,343 @@ void capture_dma() {
     );
 
     printf("Starting capture\n");
-    gpio_put(IMPULSE_GPIO, !gpio_get(IMPULSE_GPIO));
+    capture_time_us = time_us_64();
+    gpio_put(IMPULSE_GPIO, 1);
     adc_run(true);
     dma_channel_wait_for_finish_blocking(dma_chan);
     adc_run(false);
     adc_fifo_drain();
-    gpio_put(IMPULSE_GPIO, !gpio_get(IMPULSE_GPIO));
+    gpio_put(IMPULSE_GPIO, 0);
+
+}
+
+// Captures N_SAMPLES full 12 bit samples, each the average of `oversample`
+// raw conversions, at SAMPLE_RATE/oversample.  The raw conversions never all
+// sit in RAM: each DMA block is decimated into the sample store while the
+// other block fills, which has WIDE_BLOCK conversion times to finish.
+void capture_wide_dma() {
+    const int shift = oversample_shift();
+    const int outbits = wide_sample_bits();
+    const int nblocks = (N_SAMPLES * oversample) / WIDE_BLOCK;
+    int out_idx = 0;
+
+    adc_set_round_robin(0);
+    adc_select_input(ADC_CHANNEL);
+    adc_fifo_setup(true, true, 1, false, false);  // full 12 bit samples
+
+    for (int i=0; i < 2; i++) {
+        dma_channel_set_write_addr(wide_dma_chan[i], wide_dma_block[i], false);
+    }
+    dma_channel_start(wide_dma_chan[0]);
+
+    printf("Starting 12 bit capture, %dx oversampled\n", oversample);
+    capture_time_us = time_us_64();
+    gpio_put(IMPULSE_GPIO, 1);
+    adc_run(true);
+    for (int b=0; b < nblocks; b++) {
+        uint chan = wide_dma_chan[b & 1];
+        const uint16_t * block = wide_dma_block[b & 1];
+        dma_channel_wait_for_finish_blocking(chan);
+        if (b == nblocks - 1) {
+            // stop the chained channel from starting on another block
+            adc_run(false);
+            dma_channel_abort(wide_dma_chan[!(b & 1)]);
+        } else {
+            // re-arm before the other block finishes and chains back here
+            dma_channel_set_write_addr(chan, wide_dma_block[b & 1], false);
+        }
+
+        for (int i=0; i < WIDE_BLOCK; i += oversample) {
+            uint32_t acc = 0;
+            for (int j=0; j < oversample; j++) { acc += block[i+j] & 0xfff; }
+            acc >>= shift;  // 12 + shift bits
+            store_wide_sample(out_idx++, acc >> (12 + shift - outbits));
+        }
+    }
+    adc_fifo_drain();
+    gpio_put(IMPULSE_GPIO, 0);
+
+    adc_fifo_setup(true, true, 1, false, true);  // back to 8 bit for the other modes
+}
+
+// Turns the phase-major record (ets_phases captures of N_SAMPLES/ets_phases
+// samples, one after another) into time order, in place.  This is a matrix
+// transpose, so sample i moves to i*ets_phases mod (N_SAMPLES-1); following
+// each cycle of moves needs just one bit per sample to mark what's done.
+void interleave_ets() {
+    const uint32_t last = N_SAMPLES - 1;
+    for (int i=0;i < N_SAMPLES/8;i++) {ets_moved[i] = 0;}
+    for (uint32_t start=1; start < last; start++) {
+        if (ets_moved[start/8] & (1 << (start % 8))) { continue; }
+        uint8_t carry = samples[start];
+        uint32_t i = start;
+        do {
+            uint32_t j = (i * ets_phases) % last;
+            uint8_t tmp = samples[j];
+            samples[j] = carry;
+            carry = tmp;
+            ets_moved[j/8] |= 1 << (j % 8);
+            i = j;
+        } while (i != start);
+    }
+}
+
+// Equivalent-time capture of a signal that repeats with the IMPULSE_GPIO
+// stimulus: capture p starts p/ets_phases of a sample period after the edge,
+// so the captures interleave into one record at ets_phases * SAMPLE_RATE.
+// The ADC clock isn't locked to the system clock, so each start is only
+// good to about one ADC clock (1/96 of a sample).
+void capture_ets() {
+    if (ets_phases > MAX_ETS_PHASES) { ets_phases = MAX_ETS_PHASES; }
+    if (ets_phases < 1) { ets_phases = 1; }
+    while (N_SAMPLES % ets_phases) { ets_phases--; }
+    const int per_phase = N_SAMPLES / ets_phases;
+    const uint32_t sys_per_sample = clock_get_hz(clk_sys) / adc_rate;
+
+    adc_set_round_robin(0);
+    adc_select_input(ADC_CHANNEL);
+    printf("Starting %d phase equivalent-time capture\n", ets_phases);
+    capture_time_us = time_us_64();
+    for (int p=0; p < ets_phases; p++) {
+        uint32_t delay = sys_per_sample * p / ets_phases;
+        dma_channel_configure(dma_chan, &dma_cfg,
+            samples + p*per_phase,  // dst
+            &adc_hw->fifo,  // src
+            per_phase,  // transfer count
+            true            // start immediately
+        );
+
+        // nothing may come between the edge and the ADC start but the delay
+        uint32_t irq = save_and_disable_interrupts();
+        gpio_put(IMPULSE_GPIO, 1);
+        busy_wait_at_least_cycles(delay);
+        adc_run(true);
+        restore_interrupts(irq);
+
+        dma_channel_wait_for_finish_blocking(dma_chan);
+        adc_run(false);
+        adc_fifo_drain();
+        gpio_put(IMPULSE_GPIO, 0);
+        sleep_ms(SETTLE_TIME_MS);
+    }
+    interleave_ets();
+}
+
+// Fires the IMPULSE_GPIO step n_averages times, summing the aligned captures
+// in accum, and leaves their average in samples for the time view.
+void capture_averaged() {
+    uint16_t * accum = mode_buf.accum;
+    if (n_averages > MAX_AVERAGES) { n_averages = MAX_AVERAGES; }
+    if (n_averages < 1) { n_averages = 1; }
+
+    for (int i=0;i < N_SAMPLES;i++) {accum[i] = 0;}
+    for (int n=0; n < n_averages; n++) {
+        // capture_dma raises IMPULSE_GPIO just before starting the ADC and
+        // drops it after, so every capture sees the same rising edge at the
+        // same sample offset
+        capture_dma();
+        for (int i=0;i < N_SAMPLES;i++) {accum[i] += samples[i];}
+        sleep_ms(SETTLE_TIME_MS);
+    }
+    for (int i=0;i < N_SAMPLES;i++) {
+        samples[i] = (accum[i] + n_averages/2) / n_averages;
+    }
+}
+
+// One pass over a block: counts the rising crossings and adds the cycles
+// between the first and last of them, and the samples they took, to
+// counter.  Crossing times are interpolated between the two samples either
+// side of the upper threshold.
+void count_crossings(const uint8_t * s, int n) {
+    const int up = counter_level + counter_hysteresis;
+    const int down = counter_level - counter_hysteresis;
+    bool armed = false;
+    int crossings = 0;
+    float first = 0, last = 0;
+    uint8_t lo = 255, hi = 0;
+
+    for (int i=0;i < n;i++) {
+        int v = s[i];
+        if (v < lo) { lo = v; }
+        if (v > hi) { hi = v; }
+        if (v < down) {
+            armed = true;
+        } else if (armed && v >= up) {
+            // s[i-1] is below up, since it armed or failed to fire
+            last = i - 1 + (float)(up - s[i-1]) / (v - s[i-1]);
+            if (crossings == 0) { first = last; }
+            crossings++;
+            armed = false;
+        }
+    }
+
+    if (crossings > 1) {
+        counter.cycles += crossings - 1;
+        counter_span += last - first;
+    }
+    counter.lo = lo;
+    counter.hi = hi;
+    if (hi - lo > 2*counter_hysteresis) { counter_level = (lo + hi + 1) / 2; }
+}
+
+// counter_blocks captures, each counted as soon as it lands.  The gaps
+// between them are not timed, so only cycles within a block add up.
+void capture_counter() {
+    counter.cycles = 0;
+    counter_span = 0;
+    for (int b=0; b < counter_blocks; b++) {
+        capture_dma();
+        count_crossings(samples, N_SAMPLES);
+    }
+    if (counter.cycles > 0) {
+        counter.period = counter_span / counter.cycles / adc_rate;
+        counter.freq = 1. / counter.period;
+    } else {
+        counter.period = 0;
+        counter.freq = 0;
+    }
+}
+
+void do_capture() {
+    stats_fresh = false;
+    if (mode == MODE_WIDE) {
+        capture_wide_dma();
+        sample_rate = adc_rate / oversample;
+        sample_bits = wide_sample_bits();
+    } else if (mode == MODE_ETS) {
+        capture_ets();
+        sample_rate = adc_rate * ets_phases;
+        sample_bits = SAMPLE_BITS;
+    } else {
+        if (mode == MODE_TRANSFER) {
+            capture_averaged();
+        } else if (mode == MODE_COUNTER) {
+            capture_counter();
+        } else {
+            capture_dma();
+        }
+        sample_rate = adc_rate;
+        sample_bits = SAMPLE_BITS;
+    }
+}
+
+void record_flash_erase(uint32_t sector) {
+    // nothing may run from flash while it is busy
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(RECORD_FLASH_OFFSET + sector * RECORD_SECTOR, RECORD_SECTOR);
+    restore_interrupts(irq);
+}
+
+void record_flash_program(uint32_t offset, const uint8_t * page) {
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_program(RECORD_FLASH_OFFSET + offset, page, RECORD_PAGE);
+    restore_interrupts(irq);
+}
+
+// The recording area, on first use: its newest sector says where to carry on.
+void setup_recorder() {
+    if (record_flash.base) { return; }
+    record_flash.n_sectors = (PICO_FLASH_SIZE_BYTES - RECORD_FLASH_OFFSET) / RECORD_SECTOR;
+    record_flash.base = (const uint8_t *)XIP_BASE + RECORD_FLASH_OFFSET;
+    record_flash.erase = record_flash_erase;
+    record_flash.program = record_flash_program;
+    recorder_init(&recorder, &record_flash);
+    record_extent = record_find(&record_flash);
+}
+
+// The fastest rate the flash keeps up with whatever the signal.  At worst
+// blocks go uncoded, a byte a sample, and every sector costs an erase and
+// its pages programmed; and the ring has to see out an erase with a chunk
+// still to take.
+uint32_t record_max_rate() {
+    const uint64_t sustained = (uint64_t)(RECORD_SECTOR - RECORD_HEADER) * 1000000
+                               / (FLASH_ERASE_US + RECORD_SECTOR/RECORD_PAGE * FLASH_PAGE_US);
+    const uint64_t covered = (uint64_t)(RECORD_RING - 2*RECORD_CHUNK) * 1000000 / FLASH_ERASE_US;
+    return sustained < covered ? sustained : covered;
+}
+
+// samples the DMA has put in the ring since the recording started
+uint32_t record_landed() {
+    return 0xffffffffu - dma_channel_hw_addr(dma_chan)->transfer_count;
+}
+
+// Takes the next n samples (up to a chunk) from the ring into the
+// recorder.  Any the DMA has come round to are given up as lost.
+void take_chunk(uint32_t landed, uint32_t n) {
+    uint32_t skipped = 0;
+    while (landed - record_taken > RECORD_RING - RECORD_CHUNK) {
+        record_taken += RECORD_CHUNK;
+        skipped += RECORD_CHUNK;
+    }
+    uint8_t * chunk = samples + (record_chunks % (N_SAMPLES/RECORD_CHUNK)) * RECORD_CHUNK;
+    memcpy(chunk, mode_buf.record.ring + record_taken % RECORD_RING, n);
+    record_taken += n;
+    record_chunks++;
+    recorder_write(&recorder, chunk, n, skipped);
+}
+
+// Starts streaming to flash at adc_rate, or at the fastest the flash
+// sustains if that is lower, and returns the rate; 0, and nothing changed,
+// when there is no room past the program for a sector and the one erased
+// ahead of it.
+uint32_t start_recording() {
+    setup_recorder();
+    if (record_flash.n_sectors < 2) {
+        printf("No flash to record to\n");
+        return 0;
+    }
+    record_rate_before = adc_rate;
+    if (adc_rate > record_max_rate()) { set_adc_rate(record_max_rate()); }
+    sample_rate = adc_rate;
+    sample_bits = SAMPLE_BITS;
+    recorder_start(&recorder, adc_rate, mode_buf.record.block);
+    record_taken = record_chunks = 0;
+
+    dma_channel_config cfg = dma_cfg;
+    channel_config_set_ring(&cfg, true, RECORD_RING_BITS);
+    adc_set_round_robin(0);
+    adc_select_input(ADC_CHANNEL);
+    dma_channel_configure(dma_chan, &cfg, mode_buf.record.ring, &adc_hw->fifo, 0xffffffffu, true);
 
+    printf("Recording at %u S/s\n", (unsigned)adc_rate);
+    capture_time_us = time_us_64();
+    recording = true;
+    adc_run(true);
+    return adc_rate;
+}
+
+// Stops the ADC and writes out what is left in the ring.
+void stop_recording() {
+    adc_run(false);
+    const uint32_t landed = record_landed();
+    dma_channel_abort(dma_chan);
+    adc_fifo_drain();
+    while (landed != record_taken) {
+        const uint32_t left = landed - record_taken;
+        take_chunk(landed, left < RECORD_CHUNK ? left : RECORD_CHUNK);
+    }
+    recorder_stop(&recorder);
+    recording = false;
+    record_extent = record_find(&record_flash);
+    printf("Recorded %u samples in %u bytes over %u sectors, %u lost\n", (unsigned)recorder.samples,
+           (unsigned)recorder.coded, (unsigned)recorder.sectors, (unsigned)recorder.skipped);
+    set_adc_rate(record_rate_before);
 }
 
 void print_samples() {
+    // metadata line, so a host can turn this dump back into a capture file
+    printf("Capture: rate=%d bits=%d n=%d t=%llu freq=%d spacing=%d maxval=%g continuous=%d channels=%d mode=%d\n",
+           sample_rate, sample_bits, N_SAMPLES, (unsigned long long)capture_time_us,
+           draw_frequency, display_spacing, maxval_samples, continuous_mode, active_channels(), mode);
     printf("Results: [\n");
 
+    if (sample_bits > 8) {
+        for (int i = 0; i < (N_SAMPLES-1); i++) {
+            printf("%-5d, ", wide_sample(i));
+        }
+        printf("%-5d\n]\n", wide_sample(N_SAMPLES-1));
+        return;
+    }
     for (int i = 0; i < (N_SAMPLES-1); i++) {
         printf("%-3d, ", samples[i]);
     }
@@ -262,6 +816,23 @@ int64_t button_hold_callback(alarm_id_t id, void *user_data) {
     if (id == alarm_id_9) {
         // A toggles continuous mode
         continuous_mode = ! continuous_mode;
+    } else if (id == alarm_id_8 && mode == MODE_COUNTER) {
+        // B hold cycles the blocks per counter reading: 1, 2, 4, 8, 16
+        counter_blocks = counter_blocks >= 16 ? 1 : counter_blocks * 2;
+        printf("Counting %d blocks per reading\n", counter_blocks);
+    } else if (id == alarm_id_8 && mode == MODE_BANDS) {
+        // B hold switches between octave and third-octave bands
+        band_fraction = band_fraction == 3 ? 1 : 3;
+        printf("%d bands per octave\n", band_fraction);
+        should_draw = true;
+    } else if (id == alarm_id_8 && draw_frequency) {
+        // maxval does nothing for spectra, so B hold cycles the hold trace
+        // there, and flips between linear and dB each time round
+        hold_mode = (hold_mode + 1) % N_HOLD_MODES;
+        if (hold_mode == HOLD_OFF) { db_display = !db_display; }
+        hold_spacing = 0;
+        printf("%s spectrum, hold trace: %s\n", db_display ? "dB" : "linear", hold_names[hold_mode]);
+        should_draw = true;
     } else if (id == alarm_id_8) {
         // use B hold to trigger reset of max level
         if (maxval_samples == 255.) {
@@ -272,8 +843,11 @@ int64_t button_hold_callback(alarm_id_t id, void *user_data) {
         }
         should_draw = true; // always redraw after display reset
     } else if (id == alarm_id_7) {
-        // DO NOTHING FOR C HOLD
-        return BUTTON_HOLD_MS * 1000;
+        // C hold cycles through the modes
+        mode = (mode + 1) % N_MODES;
+        hold_spacing = 0;
+        printf("Switching to %s mode\n", mode_names[mode]);
+        should_draw = true;
     }
 
     return 0;
@@ -322,6 +896,7 @@ void buttons_callback(uint gpio, uint32_t events) {
             case 9: //A
                 should_capture = true;
                 should_draw = true;
+                mask_tripped = false;  // re-arms a frozen mask
                 break;
             case 8: //B
                 if (display_spacing == -1) {
@@ -329,7 +904,7 @@ void buttons_callback(uint gpio, uint32_t events) {
                 } else {
                     display_spacing *= 2;
                     if (display_spacing > (N_SAMPLES/128)) {
-                        if (draw_frequency) {
+                        if (draw_frequency && mode != MODE_COUNTER) {
                             display_spacing = -1;  // means do the peak-zoom
                         } else {
                             display_spacing = 1;
@@ -342,6 +917,7 @@ void buttons_callback(uint gpio, uint32_t events) {
                 //bool toggled_gpio = ! gpio_get(IMPULSE_GPIO);
                 //gpio_put(IMPULSE_GPIO, toggled_gpio);
                 //printf("Reset impulse GPIO to %d\n", toggled_gpio);
+                hold_spacing = 0;
                 if (draw_frequency) {
                     printf("Switching to time plot\n");
                     draw_frequency = false;
@@ -355,6 +931,1494 @@ void buttons_callback(uint gpio, uint32_t events) {
     }
 }
 
+// Sum, sum of squares, min and max of the capture in one integer pass, and
+// the readings from them.  Runs at most once per capture.
+void measure_samples() {
+    if (stats_fresh) { return; }
+    if (sample_bits > 8) {
+        uint64_t sum = 0, sumsq = 0;
+        uint16_t lo = 0xffff, hi = 0;
+        for (int i=0;i < N_SAMPLES;i++) {
+            uint32_t val = wide_sample(i);
+            sum += val;
+            sumsq += val*val;
+            if (val < lo) { lo = val; }
+            if (val > hi) { hi = val; }
+        }
+        stats.sum = sum;
+        stats.sumsq = sumsq;
+        stats.min = lo;
+        stats.max = hi;
+    } else {
+        // 8192 * 255^2 still fits 32 bits
+        uint32_t sum = 0, sumsq = 0;
+        uint8_t lo = 255, hi = 0;
+        for (int i=0;i < N_SAMPLES;i++) {
+            uint32_t val = samples[i];
+            sum += val;
+            sumsq += val*val;
+            if (val < lo) { lo = val; }
+            if (val > hi) { hi = val; }
+        }
+        stats.sum = sum;
+        stats.sumsq = sumsq;
+        stats.min = lo;
+        stats.max = hi;
+    }
+    stats_fresh = true;
+
+    // N^2 times the variance, still exact
+    uint64_t var_n2 = N_SAMPLES * stats.sumsq - stats.sum * stats.sum;
+    const float volts = cal_fullscale / (1 << sample_bits);
+    const float mean = (float)stats.sum / N_SAMPLES;
+    stats.mean = cal_offset + mean * volts;
+    stats.rms = sqrt((float)var_n2) / N_SAMPLES * volts;
+    stats.vmin = cal_offset + stats.min * volts;
+    stats.vmax = cal_offset + stats.max * volts;
+    stats.vpp = (stats.max - stats.min) * volts;
+    float excursion = fmax(stats.max - mean, mean - stats.min) * volts;
+    stats.crest = stats.rms > 0 ? excursion / stats.rms : 0;
+}
+
+void update_maxval() {
+    if (maxval_samples == -1.) {
+        measure_samples();
+        // above 8 bits, keep the extra bits: maxval stays in 8 bit units but fractional
+        maxval_samples = (float) stats.max / (1 << (sample_bits - 8));
+        printf("set maxval to %d,%f\n", (int)stats.max, maxval_samples);
+    }
+}
+
+// The dB display window as the Q8 dB value at the bottom of the plot and a
+// Q16 multiplier taking dB above that onto 0-255.  Full scale is a sine of
+// the full ADC range, whose bin has |X| = 2^(bits-1) * N/2.
+void db_window(int32_t * bottom_q8, int32_t * mul) {
+    float fullscale = (float)(1 << (sample_bits - 1)) * (N_SAMPLES/2);
+    float range = db_range < 6 ? 6 : db_range;
+    *bottom_q8 = db10_q8(fullscale * fullscale) + (int32_t)((db_ref - range) * 256);
+    *mul = (int32_t)(255 * 65536 / (range * 256));
+}
+
+// A Q8 dB level onto the window's 0-255.
+uint8_t db_scale_q8(int32_t db, int32_t bottom_q8, int32_t mul) {
+    if (db <= bottom_q8) { return 0; }
+    int32_t val = ((db - bottom_q8) * mul) >> 16;
+    return val > 255 ? 255 : val;
+}
+
+uint8_t db_scale(float sq, int32_t bottom_q8, int32_t mul) {
+    return db_scale_q8(db10_q8(sq), bottom_q8, mul);
+}
+
+void update_hold_trace(const double * colmaxsq) {
+    const bool fresh = hold_spacing != display_spacing;
+    for (int i=0; i < WIDTH; i++) {
+        float val = sqrt(colmaxsq[i]);
+        if (fresh) {
+            hold_trace[i] = val;
+        } else if (hold_mode == HOLD_PEAK) {
+            hold_trace[i] *= hold_decay;
+            if (val > hold_trace[i]) { hold_trace[i] = val; }
+        } else if (hold_mode == HOLD_MAX) {
+            if (val > hold_trace[i]) { hold_trace[i] = val; }
+        } else {
+            // min-hold relaxes back up at the same rate peak-hold decays,
+            // from a floor so a column that read 0 is not stuck there
+            if (hold_trace[i] < HOLD_FLOOR) { hold_trace[i] = HOLD_FLOOR; }
+            hold_trace[i] /= hold_decay;
+            if (val < hold_trace[i]) { hold_trace[i] = val; }
+        }
+    }
+    hold_spacing = display_spacing;
+}
+
+// Whether the hold trace is drawn over this mode's spectrum.
+bool hold_shown() {
+    return hold_mode != HOLD_OFF && draw_frequency && (mode == MODE_SCOPE || mode == MODE_WIDE
+           || mode == MODE_THD || mode == MODE_PITCH || mode == MODE_PEAKS);
+}
+
+// Draws the hold trace over the live spectrum, on the same scale (see
+// compute_spectrum()), as a two pixel tick on the held side.
+void hold_trace_to_buffer() {
+    const float scale = (HEIGHT-1.) / sqrt(column_refsq);
+    int32_t bottom_q8, mul;
+    db_window(&bottom_q8, &mul);
+    for (int i=0; i < WIDTH; i++) {
+        int valint;
+        if (db_display) {
+            valint = db_scale(hold_trace[i] * hold_trace[i], bottom_q8, mul) * (HEIGHT-1) / 255;
+        } else {
+            valint = (int)round(hold_trace[i] * scale);
+        }
+        if (valint >= HEIGHT) { valint = HEIGHT-1; }
+        display_buffer[i][valint] = true;
+        if (hold_mode == HOLD_MIN) {
+            if (valint > 0) { display_buffer[i][valint-1] = true; }
+        } else if (valint < HEIGHT-1) {
+            display_buffer[i][valint+1] = true;
+        }
+    }
+}
+
+// Applies a 4-term Blackman-Harris window in place.  Its -92 dB sidelobes
+// keep the fundamental's leakage below 12 bit distortion levels outside
+// THD_HALFWIDTH bins.  cos(2 pi n/N) comes from a rotation recurrence and
+// the 2x and 3x terms from it, so there are no per-sample trig calls.
+void window_blackman_harris(kiss_fft_scalar * x, int n) {
+    const float a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
+    const float cd = cos(2 * M_PI / n), sd = sin(2 * M_PI / n);
+    float c = 1, s = 0;
+    for (int i=0; i < n; i++) {
+        x[i] *= a0 - a1*c + a2*(2*c*c - 1) - a3*(4*c*c - 3)*c;
+        float cn = c*cd - s*sd;
+        s = s*cd + c*sd;
+        c = cn;
+    }
+}
+
+double bin_sq(const kiss_fft_cpx * spec, int k) {
+    return (double)spec[k].r*spec[k].r + (double)spec[k].i*spec[k].i;
+}
+
+double power_around(const kiss_fft_cpx * spec, int nbins, int center) {
+    double sum = 0;
+    for (int i=center - THD_HALFWIDTH; i <= center + THD_HALFWIDTH; i++) {
+        if (i >= 0 && i < nbins) { sum += bin_sq(spec, i); }
+    }
+    return sum;
+}
+
+// Distortion figures from a windowed spectrum and its total power (DC
+// excluded or not, it is taken out here).  Bounded: one parabolic fit and
+// THD_HARMONICS windows of 2*THD_HALFWIDTH+1 bins, whatever the spectrum.
+// Offset from bin k to a peak's centre, from the parabola through the log
+// magnitudes; exact for a Gaussian peak, which a Blackman-Harris main lobe
+// nearly is.  *top gets log2 |X|^2 at the parabola's top, if top is given.
+float refine_peak(const kiss_fft_cpx * spec, int nbins, int k, float * top) {
+    float delta = 0;
+    const double sq = bin_sq(spec, k);
+    float b = sq > 0 ? log2_q16(sq) / 65536. : 0;
+    const double below = k > 0 ? bin_sq(spec, k-1) : 0;
+    const double above = k < nbins - 1 ? bin_sq(spec, k+1) : 0;
+    if (below > 0 && above > 0) {
+        float a = log2_q16(below) / 65536.;
+        float c = log2_q16(above) / 65536.;
+        if (a - 2*b + c < 0) {
+            delta = 0.5 * (a - c) / (a - 2*b + c);
+            b -= 0.25 * (a - c) * delta;
+        }
+    }
+    if (top) { *top = b; }
+    return delta;
+}
+
+void analyse_thd(const kiss_fft_cpx * spec, int nbins, double total) {
+    int k = maxfftidx;
+    float delta = refine_peak(spec, nbins, k, NULL);
+    thd.freq = (k + delta) * sample_rate / N_SAMPLES;
+
+    double fund = power_around(spec, nbins, k);
+    double harm = 0;
+    thd.harmonics = 0;
+    for (int h=2; h <= THD_HARMONICS; h++) {
+        int center = (int)round(h * (k + delta));
+        if (center + THD_HALFWIDTH >= nbins) { break; }
+        harm += power_around(spec, nbins, center);
+        thd.harmonics = h;
+    }
+    double dc = 0;
+    for (int i=0; i <= THD_HALFWIDTH && i < k - THD_HALFWIDTH; i++) { dc += bin_sq(spec, i); }
+    double rest = total - dc - fund;  // distortion plus noise
+    if (rest <= 0 || fund <= 0) {
+        thd.thd = thd.thdn = 0;
+        thd.sinad = 0;
+        return;
+    }
+    thd.thd = sqrt(harm / fund);
+    thd.thdn = sqrt(rest / fund);
+    thd.sinad = 10 * log10((fund + rest) / rest);
+    printf("f0 %.1f Hz: THD %.4f%% (%d harmonics), THD+N %.4f%%, SINAD %.2f dB\n",
+           thd.freq, 100 * thd.thd, thd.harmonics, 100 * thd.thdn, thd.sinad);
+}
+
+void reset_peaks() {
+    peak_heap_n = 0;
+    peak_prev[0] = peak_prev[1] = 0;
+    for (int b=0; b < PEAK_BUCKETS; b++) { peak_hist[b] = 0; }
+}
+
+// Offers bin k, of power sq, to the heap of the N_PEAKS largest.
+void push_peak(int k, double sq) {
+    int i;
+    if (peak_heap_n < N_PEAKS) {
+        // sift the new leaf up
+        i = peak_heap_n++;
+        while (i > 0 && peak_heap[(i-1)/2].sq > sq) {
+            peak_heap[i] = peak_heap[(i-1)/2];
+            i = (i-1)/2;
+        }
+    } else {
+        if (sq <= peak_heap[0].sq) { return; }
+        // replace the smallest at the root and sift down
+        i = 0;
+        while (true) {
+            int c = 2*i + 1;
+            if (c >= N_PEAKS) { break; }
+            if (c + 1 < N_PEAKS && peak_heap[c+1].sq < peak_heap[c].sq) { c++; }
+            if (peak_heap[c].sq >= sq) { break; }
+            peak_heap[i] = peak_heap[c];
+            i = c;
+        }
+    }
+    peak_heap[i].sq = sq;
+    peak_heap[i].bin = k;
+}
+
+// Called for each bin i, of power sq, in order: counts it into the
+// noise floor histogram and offers bin i-1 if it is a local maximum.
+void track_peaks(int i, double sq) {
+    int32_t l = sq > 1 ? log2_q16(sq) : 0;
+    int b = l >> 15;  // half-octaves
+    peak_hist[b < PEAK_BUCKETS ? b : PEAK_BUCKETS - 1]++;
+    if (i >= 2 && peak_prev[1] > peak_prev[0] && peak_prev[1] >= sq) {
+        push_peak(i-1, peak_prev[1]);
+    }
+    peak_prev[0] = peak_prev[1];
+    peak_prev[1] = sq;
+}
+
+// Turns the heap into the peak list, dropping those near the noise floor,
+// largest first.  fullscale is |X| of a full-scale sine through the window.
+void finish_peaks(const kiss_fft_cpx * spec, int nbins, float fullscale) {
+    const float fs_log2 = 2 * log2f(fullscale);
+    const float db_per_log2 = 10 * log10f(2.);
+
+    // median bin, interpolated within its half-octave
+    int half = nbins / 2, count = 0, b = 0;
+    while (b < PEAK_BUCKETS - 1 && count + peak_hist[b] <= half) { count += peak_hist[b++]; }
+    float floor_log2 = 0.5 * (b + (peak_hist[b] ? (float)(half - count) / peak_hist[b] : 0));
+    noise_floor_db = (floor_log2 - fs_log2) * db_per_log2;
+
+    // a handful of entries, so insertion sort, largest first
+    for (int i=1; i < peak_heap_n; i++) {
+        struct peak_candidate c = peak_heap[i];
+        int j = i;
+        for (; j > 0 && peak_heap[j-1].sq < c.sq; j--) { peak_heap[j] = peak_heap[j-1]; }
+        peak_heap[j] = c;
+    }
+
+    n_peaks = 0;
+    for (int i=0; i < peak_heap_n; i++) {
+        float top;
+        int k = peak_heap[i].bin;
+        float delta = refine_peak(spec, nbins, k, &top);
+        float db = (top - fs_log2) * db_per_log2;
+        if (db < noise_floor_db + PEAK_MARGIN_DB) { break; }
+        peaks[n_peaks].freq = (k + delta) * sample_rate / N_SAMPLES;
+        peaks[n_peaks].db = db;
+        n_peaks++;
+    }
+
+    printf("Peaks: floor %.1f dBFS", noise_floor_db);
+    for (int i=0; i < n_peaks; i++) { printf(", %.1f Hz %.1f dBFS", peaks[i].freq, peaks[i].db); }
+    printf("\n");
+}
+
+// Nominal band of bin k, as an index from 1 kHz.
+int nominal_band(int k) {
+    float f = (float)k * sample_rate / N_SAMPLES;
+    return (int)floor(band_fraction * log2(f / 1000.) + 0.5);
+}
+
+void build_band_table() {
+    const int top = nominal_band(N_SAMPLES/2);
+    // bands are numbered up from the lowest, so find it first: each band
+    // from the top down must hold at least one bin
+    int lowest = top;
+    for (int k=N_SAMPLES/2;k >= 1;k--) {
+        int nb = nominal_band(k);
+        if (nb >= lowest) { continue; }
+        if (nb < lowest - 1 || top - lowest >= MAX_BANDS - 1) { break; }
+        lowest = nb;
+    }
+    n_bands = top - lowest + 1;
+    band_of_bin[0] = 0xff;
+    for (int i=1;i < N_SAMPLES/2 + 1;i++) {
+        int b = nominal_band(i) - lowest;
+        band_of_bin[i] = b < 0 ? 0 : b;
+    }
+    for (int b=0;b < n_bands;b++) { band_center[b] = 1000. * pow(2., (double)(b + lowest) / band_fraction); }
+    band_table_rate = sample_rate;
+    band_table_fraction = band_fraction;
+}
+
+// Band levels on the dB display scale, a full-scale sine's band being 0 dBFS.
+void finish_bands() {
+    int32_t bottom_q8, mul;
+    db_window(&bottom_q8, &mul);
+    int loudest = 0;
+    for (int b=0;b < n_bands;b++) {
+        band_level[b] = db_scale(band_sq[b] / BH_POWER_GAIN, bottom_q8, mul);
+        if (band_sq[b] > band_sq[loudest]) { loudest = b; }
+    }
+    printf("%d bands, loudest %g Hz\n", n_bands, band_center[loudest]);
+}
+
+// One bar per band across the width, from the bottom of the plot.
+void bands_to_buffer() {
+    for (int b=0;b < n_bands;b++) {
+        int x0 = b * WIDTH / n_bands;
+        int x1 = (b + 1) * WIDTH / n_bands;
+        if (x1 - x0 > 2) { x1--; }  // gap between bars wide enough to have one
+        int h = band_level[b] * (HEIGHT-1) / 255;
+        for (int x=x0;x < x1;x++) {
+            for (int y=0;y <= h;y++) { display_buffer[x][y] = true; }
+        }
+    }
+}
+
+// |X|^2 of a full-scale sine through the Blackman-Harris window.
+double windowed_fullscale_sq() {
+    double fullscale = (double)(1 << (sample_bits - 1)) * (N_SAMPLES/2) * 0.35875;
+    return fullscale * fullscale;
+}
+
+void fill_mask(int first, int last, float dbfs) {
+    // limits past what a Q8 int16 holds are past anything the ADC can reach
+    int16_t limit = MASK_OPEN;
+    if (dbfs <= -127) {
+        limit = -127 * 256;
+    } else if (dbfs < 127) {
+        limit = lroundf(dbfs * 256);
+    }
+    for (int i=first;i <= last;i++) { mask_q8[i] = limit; }
+}
+
+void default_mask() {
+    fill_mask(0, N_SAMPLES/2, MASK_DEFAULT_DB);
+    // DC and its window skirt are left open
+    fill_mask(0, THD_HALFWIDTH, INFINITY);
+    mask_set = true;
+}
+
+// Limits bins first to last to dbfs, +inf for no limit.  Returns 0, or -1
+// for a bad range.
+int set_mask(int first, int last, float dbfs) {
+    if (first < 0 || last > N_SAMPLES/2 || first > last) { return -1; }
+    if (!mask_set) { default_mask(); }
+    fill_mask(first, last, dbfs);
+    return 0;
+}
+
+// Called from the magnitude loop for a bin db (Q8 dB) over its limit.
+void mask_violation(int i, int32_t db) {
+    const float over = (db - mask_fullscale_q8 - mask_q8[i]) / 256.f;
+    if (mask_violations++ == 0 || over > mask_worst_db) {
+        mask_worst_db = over;
+        mask_worst_bin = i;
+    }
+}
+
+// The mask as a dotted line, on the dB display only: the lowest limit
+// among each column's bins.
+void mask_to_buffer() {
+    if (!db_display || display_spacing < 1) { return; }
+    int32_t bottom_q8, mul;
+    db_window(&bottom_q8, &mul);
+    const int32_t fullscale_q8 = db10_q8(windowed_fullscale_sq());
+    for (int col=0;col < WIDTH;col += 2) {
+        int16_t lowest = MASK_OPEN;
+        for (int j=0;j < display_spacing;j++) {
+            int i = col * display_spacing + j;
+            if (i <= N_SAMPLES/2 && mask_q8[i] < lowest) { lowest = mask_q8[i]; }
+        }
+        if (lowest == MASK_OPEN) { continue; }
+        int y = db_scale_q8(fullscale_q8 + lowest, bottom_q8, mul) * (HEIGHT-1) / 255;
+        display_buffer[col][y] = true;
+    }
+}
+
+// Fundamental from the autocorrelation, which is the inverse FFT of the
+// power spectrum (Wiener-Khinchin), so O(N log N) rather than O(N^2).  The
+// power spectrum is real and even, so its forward transform is the same
+// inverse, and the spectrum's own plan does both ways.  Past
+// the lobe around lag 0 a harmonic-rich signal peaks at its period, where
+// the spectrum's largest bin may be a harmonic.
+//
+// The full record's spectrum would give a circular autocorrelation, whose
+// wrapped part pulls the peak by percents when the period does not divide
+// the record, so this transforms the first half zero-padded instead: a
+// linear autocorrelation out to lag N/2.  Each lag is normalised by the
+// energy of the two overlapping parts (McLeod's NSDF), which keeps short
+// records of low tones from leaning the peaks towards shorter lags.
+//
+// x holds the record on entry and the normalised autocorrelation on
+// return.  spec, N/2 + 1 bins, is scratch.  Both are the spectrum's own
+// buffers.
+void analyse_pitch(kiss_fft_scalar * x, kiss_fft_cpx * spec) {
+    const int len = N_SAMPLES/2;
+    float * energy = mode_buf.pitch_energy;
+
+    // energy[k] = sum over n < len-k of x[n]^2 + x[n+k]^2
+    double m = 0;
+    for (int i=0;i < len;i++) { m += 2 * x[i]*x[i]; }
+    energy[0] = m;
+    for (int k=1;k <= PITCH_MAX_LAG;k++) {
+        m -= x[k-1]*x[k-1] + x[len-k]*x[len-k];
+        energy[k] = m;
+    }
+
+    for (int i=len;i < N_SAMPLES;i++) { x[i] = 0; }
+    kiss_fftr(fft_plan, x, spec);
+    // |X|^2, mirrored into the whole record, transforms to N times the
+    // autocorrelation in the real parts
+    for (int i=0;i <= N_SAMPLES/2;i++) {
+        x[i] = spec[i].r*spec[i].r + spec[i].i*spec[i].i;
+        if (i > 0 && i < N_SAMPLES/2) { x[N_SAMPLES - i] = x[i]; }
+    }
+    kiss_fftr(fft_plan, x, spec);
+
+    kiss_fft_scalar * acf = x;
+    for (int k=0;k <= PITCH_MAX_LAG;k++) {
+        acf[k] = energy[k] > 0 ? 2 * spec[k].r / (N_SAMPLES * energy[k]) : 0;
+    }
+
+    pitch.freq = pitch.clarity = pitch.lag = 0;
+    if (acf[0] <= 0) { return; }
+    // skip the lobe around lag 0, then find the first peak near the highest
+    int start = 1;
+    while (start < PITCH_MAX_LAG && acf[start] > 0) { start++; }
+    if (start < PITCH_MIN_LAG) { start = PITCH_MIN_LAG; }
+    float highest = 0;
+    for (int k=start;k < PITCH_MAX_LAG;k++) {
+        if (acf[k] > highest) { highest = acf[k]; }
+    }
+    if (highest <= 0) { return; }
+    int k = start;
+    for (;k < PITCH_MAX_LAG;k++) {
+        if (acf[k] >= PITCH_THRESHOLD * highest && acf[k] >= acf[k-1] && acf[k] >= acf[k+1]) { break; }
+    }
+    if (k >= PITCH_MAX_LAG) { return; }
+
+    float a = acf[k-1], b = acf[k], c = acf[k+1];
+    float delta = a - 2*b + c < 0 ? 0.5 * (a - c) / (a - 2*b + c) : 0;
+    pitch.lag = k + delta;
+    pitch.freq = sample_rate / pitch.lag;
+    pitch.clarity = b < acf[0] ? b / acf[0] : 1;  // a period that divides the record can round over
+    printf("f0 %.2f Hz, lag %.2f, clarity %.3f\n", pitch.freq, pitch.lag, pitch.clarity);
+}
+
+// The record, less its mean, as the FFT's input; windowed for the modes
+// that measure levels.
+void load_record(kiss_fft_scalar * x, float avg) {
+    if (sample_bits > 8) {
+        // the spectrum is normalised to its peak, so no need to rescale
+        for (int i=0;i < N_SAMPLES;i++) {x[i] = (float)wide_sample(i) - avg;}
+    } else {
+        for (int i=0;i < N_SAMPLES;i++) {x[i] = (float)samples[i] - avg;}
+    }
+    const bool windowed = mode == MODE_THD || mode == MODE_PEAKS || mode == MODE_BANDS || mode == MODE_MASK;
+    if (windowed) { window_blackman_harris(x, N_SAMPLES); }
+}
+
+// Whether this spectrum's bins go out with its frame, so need fftabs: a mask
+// hit.  CMD_GET_SPECTRUM works them out when it is asked (export_spectrum()).
+bool export_wanted() {
+    return mode == MODE_MASK && mask_violations > 0;
+}
+
+// |X|^2 on the linear 0-255 scale, with refsq at the top; 0 for a spectrum
+// with nothing in it.
+uint8_t linear_scale(double sq, double refsq) {
+    return refsq > 0 ? round(255*sqrt(sq/refsq)) : 0;
+}
+
+// Every bin of a single-channel spectrum into fftabs on the display's 0-255
+// scale, with refsq at the top of the linear one.
+void bins_to_fftabs(const kiss_fft_cpx * spec, int nbins, double refsq) {
+    int32_t bottom_q8 = 0, mul = 0;
+    if (db_display) { db_window(&bottom_q8, &mul); }
+    for (int i=0;i < nbins;i++) {
+        const double sq = bin_sq(spec, i);
+        // straight from |X|^2 for dB: no sqrt, and the log is a table lookup
+        fftabs[i] = db_display ? db_scale(sq, bottom_q8, mul) : linear_scale(sq, refsq);
+    }
+}
+
+// A column's |X|^2 (or |X| for REDUCE_MEAN, summed over count bins) on the
+// display's 0-255 scale.
+uint8_t scale_column(double val, int count, int32_t bottom_q8, int32_t mul) {
+    double sq = val;
+    if (column_reduce == REDUCE_MEAN) {
+        sq = val / count;
+        sq *= sq;
+    } else if (column_reduce == REDUCE_RMS) {
+        sq = val / count;
+    }
+    if (db_display) { return db_scale(sq, bottom_q8, mul); }
+    return linear_scale(sq, column_refsq);
+}
+
+// The single-channel spectrum, straight into the display columns: one
+// pass over |X|^2 feeds the readings of the mode and each column's max and
+// sum, and no per-bin array is kept.  Column col is bins col*display_spacing
+// up to the next column's; with the peak-zoom (display_spacing -1) the
+// columns are single bins around the peak, read back from the FFT output.
+void compute_spectrum() {
+    kiss_fft_scalar samples_fft_t[N_SAMPLES];
+    kiss_fft_cpx fft_cpx[N_SAMPLES/2 + 1];
+    const int nbins = N_SAMPLES/2 + 1;
+    maxfftsq=0;
+    maxfftidx=0;
+
+    measure_samples();
+    float avg = (float)stats.sum/N_SAMPLES;
+    if (mode == MODE_PITCH) {
+        // uses both buffers as scratch, so goes first, on its own copy of the record
+        load_record(samples_fft_t, avg);
+        analyse_pitch(samples_fft_t, fft_cpx);
+    }
+    load_record(samples_fft_t, avg);
+    if (mode == MODE_PEAKS) { reset_peaks(); }
+    const bool check_mask = mode == MODE_MASK;
+    if (check_mask) {
+        if (!mask_set) { default_mask(); }
+        mask_fullscale_q8 = db10_q8(windowed_fullscale_sq());
+        mask_violations = 0;
+    }
+    if (mode == MODE_BANDS) {
+        if (band_table_rate != sample_rate || band_table_fraction != band_fraction) { build_band_table(); }
+        for (int b=0; b < n_bands; b++) { band_sq[b] = 0; }
+    }
+
+    // largest |X|^2 in each column, for REDUCE_MAX and the hold trace, and
+    // the sum for the other reductions
+    double colmaxsq[WIDTH] = {0};
+    double colsum[WIDTH] = {0};
+    const int spacing = display_spacing > 0 ? display_spacing : 0;
+    const bool sum_cols = column_reduce != REDUCE_MAX;
+    int col = 0, in_col = 0;
+    double totalsq = 0;
+
+    kiss_fftr(fft_plan, samples_fft_t, fft_cpx);
+    for (int i=0;i < nbins;i++) {
+        const double sq = bin_sq(fft_cpx, i);
+        totalsq += sq;
+        if (sq > maxfftsq) {
+            maxfftsq = sq;
+            maxfftidx = i;
+        }
+        if (mode == MODE_PEAKS) { track_peaks(i, sq); }
+        if (mode == MODE_BANDS && band_of_bin[i] != 0xff) { band_sq[band_of_bin[i]] += sq; }
+        if (check_mask) {
+            const int32_t db = db10_q8(sq);
+            if (db > mask_fullscale_q8 + mask_q8[i]) { mask_violation(i, db); }
+        }
+        if (col < WIDTH && spacing) {
+            if (sq > colmaxsq[col]) { colmaxsq[col] = sq; }
+            if (sum_cols) { colsum[col] += column_reduce == REDUCE_MEAN ? sqrt(sq) : sq; }
+            if (++in_col == spacing) { in_col = 0; col++; }
+        }
+    }
+
+    // the live frame's peak is full height, or the held trace's when that
+    // is higher, so a burst held from earlier frames is not clipped
+    column_refsq = maxfftsq;
+    if (hold_mode != HOLD_OFF && spacing) { update_hold_trace(colmaxsq); }
+    if (hold_shown() && spacing) {
+        for (int c=0; c < WIDTH; c++) {
+            const double held = (double)hold_trace[c] * hold_trace[c];
+            if (held > column_refsq) { column_refsq = held; }
+        }
+    }
+    if (mode == MODE_THD) { analyse_thd(fft_cpx, nbins, totalsq); }
+    if (mode == MODE_PEAKS) { finish_peaks(fft_cpx, nbins, sqrt(windowed_fullscale_sq())); }
+    if (mode == MODE_BANDS) { finish_bands(); }
+
+    int32_t bottom_q8 = 0, mul = 0;
+    if (db_display) { db_window(&bottom_q8, &mul); }
+    if (spacing) {
+        n_columns = col;
+        for (int c=0;c < n_columns;c++) {
+            spectrum_columns[c] = scale_column(sum_cols ? colsum[c] : colmaxsq[c], spacing, bottom_q8, mul);
+        }
+    } else {
+        // on the fundamental rather than the largest harmonic in MODE_PITCH
+        int center = mode == MODE_PITCH && pitch.freq > 0 ? (int)round(pitch.freq * N_SAMPLES / sample_rate)
+                     : maxfftidx;
+        int start = center - WIDTH/2;
+        if (start > nbins - WIDTH) { start = nbins - WIDTH; }
+        if (start < 0) { start = 0; }
+        n_columns = WIDTH;
+        for (int c=0;c < WIDTH;c++) {
+            double sq = bin_sq(fft_cpx, start + c);
+            spectrum_columns[c] = db_display ? db_scale(sq, bottom_q8, mul) : linear_scale(sq, maxfftsq);
+        }
+    }
+
+    if (export_wanted()) { bins_to_fftabs(fft_cpx, nbins, maxfftsq); }
+}
+
+// The single-channel spectrum of the last capture into fftabs, for
+// CMD_GET_SPECTRUM: the bins its frame would have sent, worked out again
+// without touching the frame's readings, hold trace or mask.
+void export_spectrum() {
+    kiss_fft_scalar samples_fft_t[N_SAMPLES];
+    kiss_fft_cpx fft_cpx[N_SAMPLES/2 + 1];
+    const int nbins = N_SAMPLES/2 + 1;
+
+    measure_samples();
+    load_record(samples_fft_t, (float)stats.sum/N_SAMPLES);
+    kiss_fftr(fft_plan, samples_fft_t, fft_cpx);
+    double refsq = 0;
+    for (int i=0;i < nbins;i++) {
+        const double sq = bin_sq(fft_cpx, i);
+        if (sq > refsq) { refsq = sq; }
+    }
+    bins_to_fftabs(fft_cpx, nbins, refsq);
+}
+
+// Separates the spectrum of the real (which=0) or imaginary (which=1) part of
+// a complex series from bin k of its length-nfft FFT z.
+kiss_fft_cpx split_pair_bin(const kiss_fft_cpx * z, int nfft, int k, int which) {
+    kiss_fft_cpx a = z[k];
+    kiss_fft_cpx b = z[(nfft - k) % nfft];
+    kiss_fft_cpx x;
+    if (which == 0) {
+        x.r = (a.r + b.r) / 2;
+        x.i = (a.i - b.i) / 2;
+    } else {
+        x.r = (a.i + b.i) / 2;
+        x.i = (b.r - a.r) / 2;
+    }
+    return x;
+}
+
+// Spectra of n_channels interleaved round-robin channels.  Channels are taken
+// in pairs as the real and imaginary parts of one complex FFT, read straight
+// out of the interleaved buffer through the kiss_fft_stride input stride.
+void compute_multichannel_spectrum() {
+    const int nch = n_channels;
+    const int npairs = nch / 2;
+    const int nfft = N_SAMPLES / nch;
+    const int nbins = nfft/2 + 1;
+    kiss_fft_scalar samples_fft_t[N_SAMPLES];
+    kiss_fft_cpx * fft_cpx = mode_buf.pair_spectra;
+    double chanmax[MAX_CHANNELS] = {0};
+    uint32_t sum[MAX_CHANNELS] = {0};
+    float avg[MAX_CHANNELS];
+    kiss_fft_cfg fftcfg = kiss_fft_alloc(nfft, false, 0, 0);
+
+    for (int i=0;i < N_SAMPLES;i++) {sum[i % nch] += samples[i];}
+    for (int c=0;c < nch;c++) {avg[c] = (float)sum[c]/nfft;}
+    for (int i=0;i < N_SAMPLES;i++) {samples_fft_t[i] = (float)samples[i] - avg[i % nch];}
+
+    // pair p is channels 2p and 2p+1, i.e. every npairs-th complex value from p
+    kiss_fft_cpx * pairs_in = (kiss_fft_cpx *)samples_fft_t;
+    for (int p=0; p < npairs; p++) {
+        kiss_fft_stride(fftcfg, pairs_in + p, fft_cpx + p*nfft, npairs);
+    }
+    kiss_fft_free(fftcfg);
+
+    // each channel's peak, then its bins scaled to it, separating the pair
+    // again rather than keeping every |X|^2
+    for (int c=0; c < nch; c++) {
+        chan_peak_idx[c] = 0;
+        for (int k=0; k < nbins; k++) {
+            kiss_fft_cpx x = split_pair_bin(fft_cpx + (c/2)*nfft, nfft, k, c % 2);
+            double sq = x.r*x.r + x.i*x.i;
+            if (sq > chanmax[c]) {
+                chanmax[c] = sq;
+                chan_peak_idx[c] = k;
+            }
+        }
+        for (int k=0; k < nbins; k++) {
+            kiss_fft_cpx x = split_pair_bin(fft_cpx + (c/2)*nfft, nfft, k, c % 2);
+            double sq = x.r*x.r + x.i*x.i;
+            fftabs[c*nbins + k] = round(255*sqrt(sq/chanmax[c]));
+        }
+    }
+    maxfftidx = chan_peak_idx[0];
+    maxfftsq = chanmax[0];
+
+    // Channel c is sampled c ADC conversions after channel 0, which shows up
+    // as a phase ramp of 2 pi f c / SAMPLE_RATE.  Magnitudes don't see it, so
+    // it is only taken out where phase is reported: relative to channel 0 at
+    // its peak.
+    kiss_fft_cpx ref = split_pair_bin(fft_cpx, nfft, maxfftidx, 0);
+    for (int c=1; c < nch; c++) {
+        kiss_fft_cpx x = split_pair_bin(fft_cpx + (c/2)*nfft, nfft, maxfftidx, c % 2);
+        double skew = -2 * M_PI * maxfftidx * c / N_SAMPLES;
+        double phase = atan2(x.i, x.r) + skew - atan2(ref.i, ref.r);
+        phase = remainder(phase, 2 * M_PI);
+        printf("ch%d phase vs ch0 at %g Hz: %.1f deg\n", c, (float)sample_rate * maxfftidx / N_SAMPLES, phase * 180 / M_PI);
+    }
+}
+
+// Transfer function of whatever IMPULSE_GPIO drives, from the averaged step
+// response in accum.  For a step stimulus the impulse response is the first
+// difference of the step response, so that is taken while converting to
+// float and a single forward transform gives H directly.
+void compute_transfer_function() {
+    kiss_fft_scalar impulse[N_SAMPLES];
+    kiss_fft_cpx fft_cpx[N_SAMPLES/2 + 1];
+    maxfftsq=0;
+    maxfftidx=0;
+
+    impulse[0] = 0;
+    for (int i=1;i < N_SAMPLES;i++) {
+        impulse[i] = ((float)mode_buf.accum[i] - mode_buf.accum[i-1]) / n_averages;
+    }
+
+    kiss_fftr(fft_plan, impulse, fft_cpx);
+
+    // the peak first, then each bin scaled to it straight into fftabs;
+    // skip DC, where H is just the step's net change
+    for (int i=1;i<N_SAMPLES/2 + 1;i++) {
+        const double sq = bin_sq(fft_cpx, i);
+        if (sq > maxfftsq) {
+            maxfftsq = sq;
+            maxfftidx = i;
+        }
+    }
+
+    // a flat response (nothing connected, or the input saturated) has no
+    // peak to scale to
+    for (int i=0;i<N_SAMPLES/2 + 1;i++) {
+        const double sq = i ? bin_sq(fft_cpx, i) : (double)fft_cpx[0].r*fft_cpx[0].r;
+        double v = maxfftsq > 0 ? 255*sqrt(sq/maxfftsq) : 0;
+        fftabs[i] = v > 255 ? 255 : round(v);
+    }
+    printf("|H| peak at %g Hz, phase %.1f deg, %d averages\n", (float)sample_rate * maxfftidx / N_SAMPLES,
+           atan2(fft_cpx[maxfftidx].i, fft_cpx[maxfftidx].r) * 180 / M_PI, n_averages);
+}
+
+// Right-aligned text on the row starting at y.  n may be snprintf's length
+// for text that was cut to fit the label.
+void text_to_buffer(const char * str, int n, int y) {
+    if (n > WIDTH/8) { n = WIDTH/8; }
+    int offset = 127 - 8*n; if (n < 0) { offset = 0; }
+    for (int i=0; i < n; i++) {
+        if (offset + 8*i + 7 >= 128) { break; } // this should only be if the string < 16...
+        char_to_buffer(str[i], offset + 8*i, y);
+    }
+}
+
+void draw_label() {
+    char toprint[17];
+    int n;
+
+    if (mode == MODE_RECORD) {
+        if (recording) {
+            n = snprintf(toprint, sizeof(toprint), "REC %.1fkS/s", recorder.rate/1e3);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "not recording");
+        }
+        text_to_buffer(toprint, n, 56);
+        if (recorder.samples == 0) { return; }
+        n = snprintf(toprint, sizeof(toprint), "%.1fs", (float)recorder.samples / recorder.rate);
+        text_to_buffer(toprint, n, 48);
+        n = snprintf(toprint, sizeof(toprint), "%.2f bit/S", 8. * recorder.coded / recorder.samples);
+        text_to_buffer(toprint, n, 40);
+        if (recorder.skipped) {
+            n = snprintf(toprint, sizeof(toprint), "lost %u", (unsigned)recorder.skipped);
+            text_to_buffer(toprint, n, 32);
+        }
+        return;
+    }
+
+    if (mode == MODE_COUNTER) {
+        // the reading replaces the time or frequency scale
+        printf("%.6g Hz, %d cycles\n", counter.freq, counter.cycles);
+        if (counter.cycles == 0) {
+            n = snprintf(toprint, sizeof(toprint), "no signal");
+        } else if (counter.freq >= 1e3) {
+            n = snprintf(toprint, sizeof(toprint), "%.4fkHz", counter.freq/1e3);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "%.3fHz", counter.freq);
+        }
+        text_to_buffer(toprint, n, 56);
+        if (counter.cycles == 0) { return; }
+        if (counter.period < 1e-3) {
+            n = snprintf(toprint, sizeof(toprint), "%.3fus", counter.period*1e6);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "%.3fms", counter.period*1e3);
+        }
+        text_to_buffer(toprint, n, 48);
+        n = snprintf(toprint, sizeof(toprint), "%dcyc", counter.cycles);
+        text_to_buffer(toprint, n, 40);
+        return;
+    }
+
+    if (draw_frequency && mode == MODE_BANDS) {
+        n = snprintf(toprint, sizeof(toprint), band_fraction == 3 ? "1/3 octave" : "octave");
+        text_to_buffer(toprint, n, 56);
+        float lo = band_center[0], hi = band_center[n_bands-1];
+        n = snprintf(toprint, sizeof(toprint), "%.3g-%.3gk", lo/1e3, hi/1e3);
+        text_to_buffer(toprint, n, 48);
+        return;
+    }
+
+    if (draw_frequency && mode == MODE_MASK) {
+        if (mask_tripped) {
+            n = snprintf(toprint, sizeof(toprint), "HIT %d bins", mask_violations);
+            text_to_buffer(toprint, n, 56);
+            float f = (float)sample_rate * mask_worst_bin / N_SAMPLES;
+            n = snprintf(toprint, sizeof(toprint), "%.2fk +%.1fdB", f/1e3, mask_worst_db);
+            text_to_buffer(toprint, n, 48);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "mask ok");
+            text_to_buffer(toprint, n, 56);
+        }
+        n = snprintf(toprint, sizeof(toprint), "%u/%u", (unsigned)mask_hits, (unsigned)mask_frames);
+        text_to_buffer(toprint, n, 40);
+        return;
+    }
+
+    if (draw_frequency && mode == MODE_PEAKS) {
+        // one row per peak from the top, in place of the frequency scale
+        for (int i=0; i < n_peaks; i++) {
+            if (peaks[i].freq >= 1e3) {
+                n = snprintf(toprint, sizeof(toprint), "%.2fk %.0fdB", peaks[i].freq/1e3, peaks[i].db);
+            } else {
+                n = snprintf(toprint, sizeof(toprint), "%.1f %.0fdB", peaks[i].freq, peaks[i].db);
+            }
+            text_to_buffer(toprint, n, 56 - 8*i);
+        }
+        if (n_peaks == 0) {
+            n = snprintf(toprint, sizeof(toprint), "no peaks");
+            text_to_buffer(toprint, n, 56);
+        }
+        return;
+    }
+
+    if (draw_frequency && mode == MODE_PITCH) {
+        if (pitch.freq == 0) {
+            n = snprintf(toprint, sizeof(toprint), "no f0");
+        } else if (pitch.freq >= 1e3) {
+            n = snprintf(toprint, sizeof(toprint), "f0 %.3fkHz", pitch.freq/1e3);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "f0 %.2fHz", pitch.freq);
+        }
+        text_to_buffer(toprint, n, 56);
+        if (pitch.freq == 0) { return; }
+        n = snprintf(toprint, sizeof(toprint), "clarity %.2f", pitch.clarity);
+        text_to_buffer(toprint, n, 48);
+        return;
+    }
+
+    if (draw_frequency && mode == MODE_THD) {
+        // three rows of readings in place of the frequency scale
+        n = snprintf(toprint, sizeof(toprint), "THD %.3f%%", 100 * thd.thd);
+        text_to_buffer(toprint, n, 56);
+        n = snprintf(toprint, sizeof(toprint), "THD+N %.3f%%", 100 * thd.thdn);
+        text_to_buffer(toprint, n, 48);
+        n = snprintf(toprint, sizeof(toprint), "SINAD %.1fdB", thd.sinad);
+        text_to_buffer(toprint, n, 40);
+        return;
+    }
+
+    if (draw_frequency) {
+        float fdisp;
+        char prefix[2];
+        if (display_spacing == -1) {
+            // tell the user where the peak is
+            fdisp = (float)sample_rate * maxfftidx / N_SAMPLES;
+            strcpy(prefix, "p");
+        } else {
+            fdisp = (float)sample_rate * display_spacing * 128. / N_SAMPLES;
+            strcpy(prefix, "");
+        }
+        printf("%g Hz\n", fdisp);
+        if (fdisp > 1e3) {
+            n = snprintf(toprint, sizeof(toprint), "%s%.2fkHz", prefix, fdisp/1e3);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "%s%.2gHz", prefix, fdisp);
+        }
+    } else {
+        float tdisp = 128./sample_rate * display_spacing * active_channels();
+        printf("%g sec\n", tdisp);
+        if ((1e-3 > tdisp) && (tdisp > 1e-6)) {
+            n = snprintf(toprint, sizeof(toprint), "%.1fus", tdisp*1e6);
+        } else if (tdisp < 1) {
+            n = snprintf(toprint, sizeof(toprint), "%.1fms", tdisp*1e3);
+        } else {
+            n = snprintf(toprint, sizeof(toprint), "%.1gs", tdisp);
+        }
+    }
+    text_to_buffer(toprint, n, 56);
+
+    if (!draw_frequency && stats_overlay && active_channels() == 1 && mode != MODE_TRANSFER) {
+        // readings of the capture under the time scale
+        n = snprintf(toprint, sizeof(toprint), "%.3fVpp", stats.vpp);
+        text_to_buffer(toprint, n, 48);
+        n = snprintf(toprint, sizeof(toprint), "%.3fVrms", stats.rms);
+        text_to_buffer(toprint, n, 40);
+        n = snprintf(toprint, sizeof(toprint), "avg %.3fV", stats.mean);
+        text_to_buffer(toprint, n, 32);
+        n = snprintf(toprint, sizeof(toprint), "%.2f-%.2fV", stats.vmin, stats.vmax);
+        text_to_buffer(toprint, n, 24);
+        n = snprintf(toprint, sizeof(toprint), "crest %.2f", stats.crest);
+        text_to_buffer(toprint, n, 16);
+    }
+}
+
+// Reply frames go out with putchar_raw, past stdio's CRLF translation.
+// reply_begin() returns the CRC to carry through reply_bytes().
+uint8_t reply_begin(uint8_t cmd, uint8_t status, uint16_t len) {
+    uint8_t head[PROTO_HEADER];
+    uint8_t crc = proto_header(head, PROTO_SYNC_REPLY, cmd, status, len);
+    for (int i=0; i < PROTO_HEADER; i++) { putchar_raw(head[i]); }
+    return crc;
+}
+
+void reply_bytes(uint8_t * crc, const uint8_t * data, int n) {
+    *crc = proto_crc8(*crc, data, n);
+    for (int i=0; i < n; i++) { putchar_raw(data[i]); }
+}
+
+void reply_end(uint8_t crc) {
+    putchar_raw(crc);
+}
+
+void reply(uint8_t cmd, uint8_t status, const uint8_t * payload, uint16_t len) {
+    uint8_t crc = reply_begin(cmd, status, len);
+    reply_bytes(&crc, payload, len);
+    reply_end(crc);
+}
+
+void finish_trigger() {
+    uint8_t out[8];
+    uint32_t frame_us = 0;
+    for (int s=0; s < N_STAGES; s++) { frame_us += stage_time_us[s]; }
+    proto_put_u32(out, frame_count);
+    proto_put_u32(out + 4, frame_us);
+    trigger_pending = false;
+    reply(CMD_TRIGGER, STATUS_OK, out, 8);
+}
+
+void reply_samples() {
+    const uint8_t bits = sample_bits;
+    const int width = sample_bits > 8 ? 2 : 1;
+    uint8_t crc = reply_begin(CMD_GET_SAMPLES, STATUS_OK, 1 + width * N_SAMPLES);
+    reply_bytes(&crc, &bits, 1);
+    if (width == 1) {
+        reply_bytes(&crc, samples, N_SAMPLES);
+    } else {
+        for (int i=0; i < N_SAMPLES; i++) {
+            uint8_t val[2];
+            proto_put_u16(val, wide_sample(i));
+            reply_bytes(&crc, val, 2);
+        }
+    }
+    reply_end(crc);
+}
+
+void reply_stats() {
+    uint8_t out[PROTO_STATS_LEN] = {0};
+    proto_put_u32(out, sample_rate);
+    out[4] = sample_bits;
+    out[5] = mode;
+    out[6] = active_channels();
+    proto_put_u32(out + 8, maxfftidx);
+    proto_put_f32(out + 12, (float)sample_rate * maxfftidx / N_SAMPLES);
+    proto_put_f32(out + 16, counter.freq);
+    proto_put_f32(out + 20, pitch.freq);
+    proto_put_f32(out + 24, thd.thd);
+    proto_put_f32(out + 28, thd.thdn);
+    proto_put_f32(out + 32, thd.sinad);
+    proto_put_f32(out + 36, stats.mean);
+    proto_put_f32(out + 40, stats.rms);
+    proto_put_f32(out + 44, stats.vpp);
+    proto_put_f32(out + 48, stats.crest);
+    reply(CMD_GET_STATS, STATUS_OK, out, PROTO_STATS_LEN);
+}
+
+// After the spectrum is scaled for display: on a hit, freeze, pulse the
+// trigger output and stream the spectrum.
+void finish_mask() {
+    mask_frames++;
+    if (mask_violations == 0) { return; }
+    mask_hits++;
+    mask_tripped = true;
+    // a pulse rather than a toggle, so the captures still start on a rising edge
+    gpio_put(IMPULSE_GPIO, 1);
+    sleep_us(MASK_PULSE_US);
+    gpio_put(IMPULSE_GPIO, 0);
+    printf("Mask hit: %d bins over, worst %.1f dB at %g Hz\n", mask_violations, mask_worst_db,
+           (float)sample_rate * mask_worst_bin / N_SAMPLES);
+
+    uint8_t head[14];
+    proto_put_u32(head, frame_count + 1);
+    proto_put_u32(head + 4, mask_violations);
+    proto_put_u16(head + 8, mask_worst_bin);
+    proto_put_f32(head + 10, mask_worst_db);
+    uint8_t crc = reply_begin(CMD_MASK_HIT, STATUS_OK, sizeof(head) + N_SAMPLES/2 + 1);
+    reply_bytes(&crc, head, sizeof(head));
+    reply_bytes(&crc, fftabs, N_SAMPLES/2 + 1);
+    reply_end(crc);
+}
+
+void run_command(uint8_t cmd, const uint8_t * payload, uint16_t len) {
+    uint8_t out[4 + 4*N_STAGES];
+    // commands with a fixed payload size, checked up front
+    int want = -1;
+    switch (cmd) {
+        case CMD_SET_MODE: case CMD_SET_VIEW: case CMD_SET_CONTINUOUS: case CMD_SET_COLUMNS: want = 1; break;
+        case CMD_SET_FFT_SIZE: want = 2; break;
+        case CMD_SET_RATE: want = 4; break;
+        case CMD_SET_MASK: want = 8; break;
+        case CMD_SET_PERIOD: want = 4; break;
+        case CMD_SET_HOLD: want = 5; break;
+        case CMD_SET_DB: want = 9; break;
+        case CMD_RECORD: case CMD_SET_OVERSAMPLE: want = 1; break;
+        case CMD_READ_RECORD: want = 4; break;
+        default: want = 0; break;
+    }
+    if (len != want) {
+        reply(cmd, STATUS_BAD_LENGTH, NULL, 0);
+        return;
+    }
+
+    switch (cmd) {
+        case CMD_PING:
+            out[0] = PROTO_VERSION;
+            out[1] = N_MODES;
+            proto_put_u16(out + 2, N_SAMPLES);
+            proto_put_u32(out + 4, adc_rate);
+            reply(cmd, STATUS_OK, out, 8);
+            break;
+        case CMD_SET_MODE:
+            if (payload[0] >= N_MODES) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+            mode = payload[0];
+            hold_spacing = 0;
+            printf("Switching to %s mode\n", mode_names[mode]);
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_SET_FFT_SIZE:
+            // the buffers are sized at build time, so only N_SAMPLES will do
+            proto_put_u16(out, N_SAMPLES);
+            reply(cmd, proto_get_u16(payload) == N_SAMPLES ? STATUS_OK : STATUS_UNSUPPORTED, out, 2);
+            break;
+        case CMD_SET_RATE:
+            proto_put_u32(out, set_adc_rate(proto_get_u32(payload)));
+            reply(cmd, STATUS_OK, out, 4);
+            break;
+        case CMD_SET_VIEW:
+            draw_frequency = payload[0] != 0;
+            hold_spacing = 0;
+            if (!draw_frequency && display_spacing == -1) { display_spacing = 1; }
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_SET_CONTINUOUS:
+            continuous_mode = payload[0] != 0;
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_TRIGGER:
+            // answered by render_frame() once the frame is on the display
+            should_capture = true;
+            should_draw = true;
+            trigger_pending = true;
+            break;
+        case CMD_GET_SAMPLES:
+            reply_samples();
+            break;
+        case CMD_GET_SPECTRUM: {
+            const int nch = active_channels();
+            // the other spectra are kept whole in fftabs by their frames
+            if (nch == 1 && mode != MODE_TRANSFER) { export_spectrum(); }
+            const uint8_t channels = nch;
+            uint8_t crc = reply_begin(cmd, STATUS_OK, 1 + nch * (N_SAMPLES/(2*nch) + 1));
+            reply_bytes(&crc, &channels, 1);
+            reply_bytes(&crc, fftabs, nch * (N_SAMPLES/(2*nch) + 1));
+            reply_end(crc);
+            break;
+        }
+        case CMD_GET_STATS:
+            reply_stats();
+            break;
+        case CMD_GET_TIMING:
+            proto_put_u32(out, frame_count);
+            for (int s=0; s < N_STAGES; s++) { proto_put_u32(out + 4 + 4*s, stage_time_us[s]); }
+            reply(cmd, STATUS_OK, out, 4 + 4*N_STAGES);
+            break;
+        case CMD_SET_MASK: {
+            float dbfs = proto_get_f32(payload + 4);
+            int ok = !isnan(dbfs) && set_mask(proto_get_u16(payload), proto_get_u16(payload + 2), dbfs) == 0;
+            reply(cmd, ok ? STATUS_OK : STATUS_BAD_VALUE, NULL, 0);
+            break;
+        }
+        case CMD_SET_COLUMNS:
+            if (payload[0] >= N_REDUCE) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+            column_reduce = payload[0];
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_SET_PERIOD:
+            capture_period_us = proto_get_u32(payload);
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_SET_OVERSAMPLE:
+            if (payload[0] != 1 && payload[0] != 4 && payload[0] != 16) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+#if PACKED_SAMPLES
+            // packed samples keep 12 bits, so the bits averaging gains would
+            // be shifted away and only the rate would drop
+            if (payload[0] != 1) {
+                reply(cmd, STATUS_UNSUPPORTED, NULL, 0);
+                break;
+            }
+#endif
+            oversample = payload[0];
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_SET_HOLD: {
+            float decay = proto_get_f32(payload + 1);
+            if (payload[0] >= N_HOLD_MODES || !(decay > 0 && decay <= 1)) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+            hold_mode = payload[0];
+            hold_decay = decay;
+            hold_spacing = 0;
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        }
+        case CMD_SET_DB: {
+            float ref = proto_get_f32(payload + 1), range = proto_get_f32(payload + 5);
+            const bool on = payload[0] != 0;
+            if (on && (!isfinite(ref) || !(range >= 6 && range <= 200))) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+            db_display = on;
+            if (on) {
+                db_ref = ref;
+                db_range = range;
+            }
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        }
+        case CMD_GET_TASKS: {
+            uint8_t head[4] = {N_TASKS};
+            uint8_t crc = reply_begin(cmd, STATUS_OK, 4 + N_TASKS * PROTO_TASK_LEN);
+            reply_bytes(&crc, head, 4);
+            for (int i=0; i < N_TASKS; i++) {
+                const struct sched_task * t = &loop_tasks[i];
+                const uint32_t vals[PROTO_TASK_LEN/4] = {t->runs, t->overruns, t->deferrals, t->forced,
+                                                         t->max_us, t->last_us};
+                for (int v=0; v < PROTO_TASK_LEN/4; v++) { proto_put_u32(out + 4*v, vals[v]); }
+                reply_bytes(&crc, out, PROTO_TASK_LEN);
+            }
+            reply_end(crc);
+            break;
+        }
+        case CMD_ARM_MASK:
+            mask_tripped = false;
+            reply(cmd, STATUS_OK, NULL, 0);
+            break;
+        case CMD_RECORD:
+            if (payload[0] && !recording) {
+                if (!start_recording()) {
+                    reply(cmd, STATUS_UNSUPPORTED, NULL, 0);
+                    break;
+                }
+                mode = MODE_RECORD;
+                frame_stage = FRAME_CAPTURED;
+            } else if (!payload[0] && recording) {
+                stop_recording();
+            }
+            proto_put_u32(out, recording ? adc_rate : 0);
+            reply(cmd, STATUS_OK, out, 4);
+            break;
+        case CMD_GET_RECORD: {
+            uint8_t rec[PROTO_RECORD_LEN] = {recording};
+            const uint32_t vals[6] = {recorder.rate, recorder.samples, recorder.skipped, recorder.blocks,
+                                      recorder.coded, recorder.sectors};
+            for (int v=0; v < 6; v++) { proto_put_u32(rec + 4 + 4*v, vals[v]); }
+            reply(cmd, STATUS_OK, rec, PROTO_RECORD_LEN);
+            break;
+        }
+        case CMD_READ_RECORD: {
+            // sector 0 looks the recording up afresh
+            uint32_t index = proto_get_u32(payload);
+            setup_recorder();
+            if (index == 0 && !recording) { record_extent = record_find(&record_flash); }
+            if (recording || index >= record_extent.n_sectors) {
+                reply(cmd, STATUS_BAD_VALUE, NULL, 0);
+                break;
+            }
+            uint32_t sector = (record_extent.first_sector + index) % record_flash.n_sectors;
+            reply(cmd, STATUS_OK, record_flash.base + sector * RECORD_SECTOR, RECORD_SECTOR);
+            break;
+        }
+        case CMD_GET_MASK:
+            out[0] = mask_tripped;
+            out[1] = 0;
+            proto_put_u16(out + 2, mask_worst_bin);
+            proto_put_u32(out + 4, mask_frames);
+            proto_put_u32(out + 8, mask_hits);
+            proto_put_u32(out + 12, mask_violations);
+            proto_put_f32(out + 16, mask_worst_db);
+            reply(cmd, STATUS_OK, out, PROTO_MASK_LEN);
+            break;
+        default:
+            reply(cmd, STATUS_BAD_CMD, NULL, 0);
+            break;
+    }
+}
+
+// Takes whatever command bytes have arrived, never waiting for more, so a
+// half-sent request does not hold up the capture loop.
+void poll_commands() {
+    if (!command_parser.payload) {
+        proto_parser_init(&command_parser, PROTO_SYNC_REQUEST, command_payload, PROTO_MAX_REQUEST);
+    }
+    for (int i=0; i < POLL_MAX_BYTES; i++) {
+        int c = getchar_timeout_us(0);
+        if (c < 0) { break; }
+        int ret = proto_feed(&command_parser, c);
+        if (ret == 1) {
+            run_command(command_parser.cmd, command_payload, command_parser.len);
+        } else if (ret == -1) {
+            printf("Dropped a bad command frame\n");
+        }
+    }
+}
+
+// The counter has its reading from the capture, and the recorder shows
+// what it is recording; both always show the waveform.
+bool frame_has_spectrum() {
+    return draw_frequency && mode != MODE_COUNTER && mode != MODE_RECORD;
+}
+
+// The stages after the capture for one displayed frame, each timed: the
+// spectrum and readings, the plot and label into the buffer, and the
+// buffer out to the display.
+void analyse_frame() {
+    const int nch = active_channels();
+
+    uint64_t t0 = time_us_64();
+    measure_samples();
+    if (frame_has_spectrum()) {
+        if (mode == MODE_TRANSFER) {
+            compute_transfer_function();
+        } else if (nch > 1) {
+            compute_multichannel_spectrum();
+        } else {
+            compute_spectrum();
+            chan_peak_idx[0] = maxfftidx;
+            if (mode == MODE_MASK) { finish_mask(); }
+        }
+    }
+    stage_time_us[STAGE_FFT] = time_us_64() - t0;
+}
+
+void draw_frame() {
+    const int nch = active_channels();
+    const int nbins = N_SAMPLES/(2*nch) + 1;
+    const bool spectrum = frame_has_spectrum();
+
+    uint64_t t0 = time_us_64();
+    clear_buffer();
+    for (int c=0; c < nch; c++) {
+        // stacked channels go top to bottom from channel 0
+        int h = overlay_channels ? HEIGHT : HEIGHT/nch;
+        int y0 = overlay_channels ? 0 : (nch-1-c)*h;
+        if (spectrum && mode == MODE_BANDS) {
+            bands_to_buffer();
+        } else if (spectrum && nch == 1 && mode != MODE_TRANSFER) {
+            plot_columns_to_buffer(spectrum_columns, n_columns, y0, h);
+        } else if (spectrum) {
+            if (display_spacing == -1) {
+                // zoom in on peak
+                plot_around_to_buffer(fftabs + c*nbins, nbins, chan_peak_idx[c], 255., y0, h);
+            } else {
+                plot_to_buffer(fftabs + c*nbins, nbins, 1, 255., y0, h);
+            }
+        } else {
+            plot_to_buffer(samples + c, N_SAMPLES/nch, nch, maxval_samples, y0, h);
+        }
+    }
+    if (hold_shown() && hold_spacing == display_spacing && column_refsq > 0) {
+        hold_trace_to_buffer();
+    }
+    if (spectrum && mode == MODE_MASK) { mask_to_buffer(); }
+    uint64_t t1 = time_us_64();
+    stage_time_us[STAGE_PLOT] = t1 - t0;
+
+    draw_label();
+    stage_time_us[STAGE_LABEL] = time_us_64() - t1;
+}
+
+void flush_frame() {
+    uint64_t t0 = time_us_64();
+    write_display_buffer();
+    stage_time_us[STAGE_DISPLAY] = time_us_64() - t0;
+
+    frame_count++;
+    if (trigger_pending) { finish_trigger(); }
+}
+
+// Runs everything after the capture for one displayed frame.
+void render_frame() {
+    analyse_frame();
+    draw_frame();
+    flush_frame();
+}
+
+// The main loop's tasks, highest priority first.  A capture sets off the
+// chain of frame stages; the display flush and the serial sample dump give
+// way to a continuous capture that is coming due, the dump until the next
+// capture replaces its samples.
+bool record_ready() {
+    if (!recording) { return false; }
+    return mode != MODE_RECORD || record_landed() - record_taken >= RECORD_CHUNK;
+}
+
+// A chunk to flash, and every RECORD_DRAW_CHUNKS a frame of the latest
+// samples, if the display is free.  Leaving the mode stops the recording.
+void record_task() {
+    if (mode != MODE_RECORD) {
+        stop_recording();
+        return;
+    }
+    take_chunk(record_landed(), RECORD_CHUNK);
+    if (record_chunks % RECORD_DRAW_CHUNKS == 0 && frame_stage == FRAME_IDLE) {
+        stats_fresh = false;
+        frame_stage = FRAME_CAPTURED;
+    }
+}
+
+bool capture_ready() {
+    if (should_capture) { return true; }
+    if (!continuous_mode || mask_tripped || mode == MODE_RECORD || loop_sched.now_us() < next_capture_us) {
+        return false;
+    }
+    if (!capture_period_us) {
+        // back to back there is no deadline to make way for, so each frame
+        // is flushed, and the dump and the UI get their turn, first
+        return frame_stage == FRAME_IDLE && !print_pending && loop_sched.now_us() < next_ui_us;
+    }
+    // only a frame waiting for the display may be dropped
+    return frame_stage == FRAME_IDLE || frame_stage == FRAME_DRAWN;
+}
+
+void capture_task() {
+    if (mode == MODE_RECORD) {
+        // A starts and stops the recording
+        should_capture = false;
+        if (recording) {
+            stop_recording();
+        } else {
+            start_recording();
+        }
+        stats_fresh = false;
+        frame_stage = FRAME_CAPTURED;
+        return;
+    }
+    // the record task normally gets there first, but the ring's RAM is
+    // the other modes' scratch (mode_buf)
+    if (recording) { stop_recording(); }
+    next_capture_us = loop_sched.now_us() + capture_period_us;
+    uint64_t t0 = time_us_64();
+    gpio_put(LED_GPIO, 1);
+    do_capture();
+    printf("Capture complete.\n");
+    gpio_put(LED_GPIO, 0);
+    stage_time_us[STAGE_CAPTURE] = time_us_64() - t0;
+
+    should_capture = false;
+    print_pending = should_print;
+    // a frame still waiting for the display is dropped
+    frame_stage = should_draw || continuous_mode ? FRAME_CAPTURED : FRAME_IDLE;
+}
+
+bool analyse_ready() {
+    return should_draw || frame_stage == FRAME_CAPTURED;
+}
+
+void analyse_task() {
+    should_draw = false;
+    analyse_frame();
+    frame_stage = FRAME_ANALYSED;
+}
+
+bool draw_ready() {
+    return frame_stage == FRAME_ANALYSED;
+}
+
+void draw_task() {
+    draw_frame();
+    frame_stage = FRAME_DRAWN;
+}
+
+bool flush_ready() {
+    return frame_stage == FRAME_DRAWN;
+}
+
+void flush_task() {
+    flush_frame();
+    frame_stage = FRAME_IDLE;
+}
+
+bool print_ready() {
+    return print_pending;
+}
+
+void print_task() {
+    uint64_t t0 = time_us_64();
+    print_samples();
+    stage_time_us[STAGE_PRINT] = time_us_64() - t0;
+    print_pending = false;
+}
+
+bool ui_ready() {
+    return loop_sched.now_us() >= next_ui_us;
+}
+
+void ui_task() {
+    next_ui_us = loop_sched.now_us() + WAIT_TIME_MS * 1000;
+    poll_commands();
+    update_maxval();
+}
+
+struct sched_task loop_tasks[N_TASKS] = {
+    // a sector erase, a chunk's pages and its coding
+    [TASK_RECORD] = {"record", record_ready, record_task, 60000},
+    [TASK_CAPTURE] = {"capture", capture_ready, capture_task, 20000},
+    [TASK_ANALYSE] = {"analyse", analyse_ready, analyse_task, 100000},
+    [TASK_DRAW] = {"draw", draw_ready, draw_task, 10000},
+    // 1 KB of display RAM at 400 kHz
+    [TASK_FLUSH] = {"flush", flush_ready, flush_task, 30000, true, 2},
+    [TASK_PRINT] = {"print", print_ready, print_task, 200000, true, 0},
+    [TASK_UI] = {"ui", ui_ready, ui_task, 2000},
+};
+
+// Starts the main loop's schedule on the clock now_us.
+void setup_loop(uint64_t (*now_us)(void)) {
+    sched_init(&loop_sched, loop_tasks, N_TASKS, now_us);
+    next_capture_us = next_ui_us = now_us();
+    frame_stage = FRAME_IDLE;
+}
+
+// Runs the next task due; false when there was none.
+bool loop_step() {
+    loop_sched.deadline_us = continuous_mode && !mask_tripped && capture_period_us ? next_capture_us
+                             : SCHED_NO_DEADLINE;
+    return sched_step(&loop_sched) >= 0;
+}
+
+
+#ifndef SPECTRO_NO_MAIN
 int main() {
     bi_decl(bi_program_description("This is an in-progress spectrometer binary."));
     bi_decl(bi_1pin_with_name(LED_GPIO, "On-board LED"));
@@ -383,6 +2447,7 @@ int main() {
     printf("ADC raw result: %d\n", adc_read());
     printf("Getting DMA Ready\n");
     setup_dma();
+    setup_fft();
 
     // this indicates startup but also ensures the cap has ample time to charge
     for (int i=0; i < 5; i++) {
@@ -392,111 +2457,11 @@ int main() {
         sleep_ms(250);
     }
 
+    setup_loop(time_us_64);
     while (true) {
-        int maxfftidx;
-        double maxfftsq;
-
-        if (maxval_samples == -1.) {
-            uint8_t maxval = 0;
-            for (int i=0;i < N_SAMPLES;i++) {
-                if (samples[i] > maxval) { maxval = samples[i]; }
-            }
-            maxval_samples = (float) maxval;
-            printf("set maxval to %d,%f\n", maxval, maxval_samples);
-        }
-
-        if (should_capture | continuous_mode) {
-            gpio_put(LED_GPIO, 1);
-            capture_dma();
-            printf("Capture complete.\n");
-            if (should_print) { print_samples(); }
-
-            gpio_put(LED_GPIO, 0);
-            should_capture = false;
-        }
-
-        if (should_draw | continuous_mode) {
-            if (draw_frequency) {
-                kiss_fft_scalar samples_fft_t[N_SAMPLES];
-                kiss_fft_cpx fft_cpx[N_SAMPLES];
-                double fftabssq[N_SAMPLES/2 + 1];
-                uint8_t fftabs[N_SAMPLES/2 + 1];
-                kiss_fftr_cfg fftrcfg = kiss_fftr_alloc(N_SAMPLES, false, 0, 0);
-                maxfftsq=0;
-                maxfftidx=0;
-
-                uint64_t sum = 0;
-                for (int i=0;i < N_SAMPLES;i++) {sum += samples[i];}
-                float avg = (float)sum/N_SAMPLES;
-                for (int i=0;i < N_SAMPLES;i++) {samples_fft_t[i] = (float)samples[i] - avg;}
-
-                kiss_fftr(fftrcfg, samples_fft_t, fft_cpx);
-                for (int i=0;i<N_SAMPLES/2 + 1;i++) {
-                    fftabssq[i] = fft_cpx[i].r*fft_cpx[i].r + fft_cpx[i].i*fft_cpx[i].i;
-                    if (fftabssq[i] > maxfftsq) {
-                        maxfftsq = fftabssq[i];
-                        maxfftidx = i;
-                    }
-                }
-                kiss_fft_free(fftrcfg);
-
-                for (int i=0;i<N_SAMPLES/2 + 1;i++) {
-                    fftabs[i] = round(255*sqrt(fftabssq[i]/maxfftsq));
-                }
-                if (display_spacing == -1) {
-                    // zoom in on peak
-                    plot_around_to_buffer(fftabs, N_SAMPLES/2 + 1, maxfftidx, 255.);
-                } else {
-                    plot_to_buffer(fftabs, N_SAMPLES/2 + 1, 255.);
-                }
-            } else {
-                plot_to_buffer(samples, N_SAMPLES, maxval_samples);
-            }
-
-            char toprint[16];
-            int n, offset;
-
-            if (draw_frequency) {
-                float fdisp;
-                char prefix[2];
-                if (display_spacing == -1) {
-                    // tell the user where the peak is
-                    fdisp = 500000. * maxfftidx / N_SAMPLES;
-                    strcpy(prefix, "p");
-                } else {
-                    fdisp = 500000. * display_spacing * 128. / N_SAMPLES;
-                    strcpy(prefix, "");
-                }
-                printf("%g Hz\n", fdisp);
-                if (fdisp > 1e3) {
-                    n = sprintf(toprint, "%s%.2fkHz", prefix, fdisp/1e3);
-                } else {
-                    n = sprintf(toprint, "%s%.2gHz", prefix, fdisp);
-                }
-            } else {
-                float tdisp = 128./500000. * display_spacing;
-                printf("%g sec\n", tdisp);
-                if ((1e-3 > tdisp) && (tdisp > 1e-6)) {
-                    n = sprintf(toprint, "%.1fus", tdisp*1e6);
-                } else if (tdisp < 1) {
-                    n = sprintf(toprint, "%.1fms", tdisp*1e3);
-                } else {
-                    n = sprintf(toprint, "%.1gs", tdisp);
-                }
-            }
-            offset = 127 - 8*n; if (n < 0) { offset = 0; }
-            for (int i=0; i < n; i++) {
-                if (offset + 8*i + 7 >= 128) { break; } // this should only be if the string < 16...
-                char_to_buffer(toprint[i], offset + 8*i, 56);
-            }
-
-            write_display_buffer();
-            should_draw = false;
-        }
-
-        sleep_ms(WAIT_TIME_MS);
-
+        if (!loop_step()) { sleep_ms(1); }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,207 @@
+// Shared sizes, state and pipeline stages of spectro.c, for the firmware
+// itself and for the host tools that drive it (see host/).
+#ifndef SPECTRO_H
+#define SPECTRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "recorder.h"
+#include "sched.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+
+#define N_SAMPLES 8192  // 8192 -> ~20 ms
+#define SAMPLE_RATE 500000  // full-speed ADC, 48 MHz / 96 cycles
+#define SAMPLE_BITS 8
+
+#define N_PEAKS 5  // spectral peaks listed in MODE_PEAKS
+
+// 12 bit mode stores samples as 8 bit plus packed low nibbles (12 KB) rather
+// than as 16 bit words (16 KB, but keeps the oversampling bits)
+#ifndef PACKED_SAMPLES
+#define PACKED_SAMPLES 1
+#endif
+
+enum mode {
+    MODE_SCOPE,          // single channel, time or frequency view
+    MODE_MULTICHANNEL,   // n_channels round-robin channels, stacked or overlaid
+    MODE_TRANSFER,       // averaged step response on IMPULSE_GPIO and its transfer function
+    MODE_WIDE,           // single channel, full 12 bit samples, optionally oversampled
+    MODE_THD,            // windowed spectrum with THD, THD+N and SINAD readings
+    MODE_ETS,            // equivalent-time sampling of signals repeating with IMPULSE_GPIO
+    MODE_COUNTER,        // reciprocal frequency counter on threshold crossings, no FFT
+    MODE_PITCH,          // fundamental from the autocorrelation of the spectrum
+    MODE_PEAKS,          // windowed spectrum with its largest peaks listed
+    MODE_BANDS,          // windowed spectrum summed into octave or third-octave bands
+    MODE_MASK,           // windowed spectrum checked against a limit per bin, freezing on a hit
+    MODE_RECORD,         // single channel streamed to flash, compressed, for as long as it fits
+    N_MODES
+};
+
+enum hold_mode {
+    HOLD_OFF,
+    HOLD_PEAK,  // running maximum that decays by hold_decay each frame
+    HOLD_MAX,   // running maximum that never decays
+    HOLD_MIN,   // running minimum that relaxes by hold_decay each frame
+    N_HOLD_MODES
+};
+
+// how the bins under one display column become its value
+enum column_reduce {
+    REDUCE_MAX,   // largest |X|, so narrow peaks survive any display_spacing
+    REDUCE_MEAN,  // mean |X|
+    REDUCE_RMS,   // root of the mean |X|^2, the column's power
+    N_REDUCE
+};
+
+struct thd_result {
+    float freq;  // fundamental, Hz, refined between bins
+    float thd;  // harmonic distortion as a fraction of the fundamental (amplitude)
+    float thdn;  // distortion plus noise, likewise
+    float sinad;  // dB
+    int harmonics;  // highest harmonic that fit below Nyquist
+};
+
+struct sample_stats {
+    int32_t min, max;  // in units of sample_bits
+    uint64_t sum, sumsq;
+    float mean, rms, vpp, vmin, vmax;  // volts; rms is about the mean
+    float crest;  // largest excursion from the mean over rms
+};
+
+struct peak {
+    float freq;  // Hz, refined between bins
+    float db;  // dBFS, a full-scale sine being 0
+};
+
+struct pitch_result {
+    float freq;  // fundamental, Hz, 0 for none found
+    float clarity;  // autocorrelation at the chosen lag over that at lag 0, up to 1
+    float lag;  // samples, refined between lags
+};
+
+struct counter_result {
+    float freq;  // Hz, counted cycles over the time they took, 0 for no reading
+    float period;  // s
+    int cycles;  // counted over all blocks of the reading
+    uint8_t lo, hi;  // sample range of the last block
+};
+
+enum stage {
+    STAGE_CAPTURE,
+    STAGE_PRINT,
+    STAGE_FFT,
+    STAGE_PLOT,
+    STAGE_LABEL,
+    STAGE_DISPLAY,
+    N_STAGES
+};
+
+// the main loop's tasks, highest priority first (see sched.h)
+enum task {
+    TASK_RECORD,
+    TASK_CAPTURE,
+    TASK_ANALYSE,
+    TASK_DRAW,
+    TASK_FLUSH,
+    TASK_PRINT,
+    TASK_UI,
+    N_TASKS
+};
+
+// how far a frame has got through the tasks after its capture
+enum frame_stage {
+    FRAME_IDLE,
+    FRAME_CAPTURED,
+    FRAME_ANALYSED,
+    FRAME_DRAWN,
+};
+
+extern uint8_t samples[N_SAMPLES];
+extern int display_spacing;
+extern float maxval_samples;
+extern bool draw_frequency;
+extern bool continuous_mode;
+extern enum mode mode;
+extern int n_channels;
+extern bool overlay_channels;
+extern int n_averages;
+extern int oversample;
+extern int ets_phases;
+extern uint32_t adc_rate;
+extern uint32_t sample_rate;
+extern int sample_bits;
+extern enum hold_mode hold_mode;
+extern float hold_decay;
+extern bool db_display;
+extern enum column_reduce column_reduce;
+extern uint8_t spectrum_columns[WIDTH];
+extern int n_columns;
+extern float db_ref;
+extern float db_range;
+extern struct thd_result thd;
+extern struct peak peaks[N_PEAKS];
+extern int n_peaks;
+extern float noise_floor_db;
+extern int band_fraction;
+extern int n_bands;
+extern float band_center[];
+extern uint8_t band_level[];
+extern struct pitch_result pitch;
+extern bool mask_tripped;
+extern uint32_t mask_frames;
+extern uint32_t mask_hits;
+extern int mask_violations;
+extern int mask_worst_bin;
+extern float mask_worst_db;
+extern struct sample_stats stats;
+extern bool stats_overlay;
+extern float cal_fullscale;
+extern float cal_offset;
+extern int counter_blocks;
+extern int counter_hysteresis;
+extern struct counter_result counter;
+extern bool display_buffer[WIDTH][HEIGHT];
+extern uint64_t capture_time_us;
+extern uint32_t frame_count;
+extern bool should_capture;
+extern bool should_draw;
+
+extern const char * mode_names[N_MODES];
+
+// per-stage wall time of the most recent frame, in microseconds
+extern const char * stage_names[N_STAGES];
+extern uint32_t stage_time_us[N_STAGES];
+extern struct scheduler loop_sched;
+extern struct sched_task loop_tasks[N_TASKS];
+extern uint32_t capture_period_us;
+extern enum frame_stage frame_stage;
+extern bool should_print;
+extern struct recorder recorder;
+extern bool recording;
+
+void setup_display();
+void setup_adc();
+void setup_dma();
+void setup_fft();
+void capture_dma();
+void do_capture();
+void update_maxval();
+void print_samples();
+uint16_t wide_sample(int i);
+int wide_sample_bits();
+int active_channels();
+void render_frame();
+void setup_loop(uint64_t (*now_us)(void));
+bool loop_step();
+void measure_samples();
+int set_mask(int first, int last, float dbfs);
+uint32_t set_adc_rate(uint32_t rate);
+void poll_commands();
+uint32_t record_max_rate();
+uint32_t start_recording();
+void stop_recording();
+
+#endif
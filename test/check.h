@@ -0,0 +1,60 @@
+// What the host tests share: CHECK, which counts a failure and carries on,
+// the device set-up every test of the firmware starts with, and tones for
+// the stubbed ADC to hand out.
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <math.h>
+#include <stdio.h>
+
+#include "host_stubs.h"
+#include "spectro.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define CHECK(cond) do { if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static int failures;
+
+// the firmware's own printing goes to /dev/null, the checks' to stderr
+static inline void check_setup(void) {
+    freopen("/dev/null", "w", stdout);
+    setup_display();
+    setup_adc();
+    setup_dma();
+    setup_fft();
+}
+
+// main's return value
+static inline int check_done(void) {
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
+
+// n 8 bit samples of ntones tones about 128, tone j at freq[j] Hz and
+// amp[j] counts with phase[j] (NULL for all zero), plus uniform noise of up
+// to +-noise counts from seed, which the stubbed ADC then hands out.  n is
+// at most 4*N_SAMPLES.
+static inline void feed_tones(int n, int ntones, const double * freq, const double * amp,
+                              const double * phase, int noise, uint32_t seed) {
+    static uint8_t feed[4 * N_SAMPLES];
+    uint32_t rng = seed;
+    for (int i=0; i < n; i++) {
+        double v = 128;
+        for (int j=0; j < ntones; j++) { v += amp[j] * sin(2*M_PI*freq[j]*i/SAMPLE_RATE + (phase ? phase[j] : 0)); }
+        rng = rng * 1664525u + 1013904223u;
+        if (noise) { v += (int)(rng >> 24) % (2*noise + 1) - noise; }
+        feed[i] = lround(v);
+    }
+    host_adc_feed(feed, n, 1);
+}
+
+// one frame of a single tone
+static inline void feed_sine(double freq, double amp) {
+    feed_tones(N_SAMPLES, 1, &freq, &amp, NULL, 0, 0);
+}
+
+#endif
@@ -0,0 +1,62 @@
+// Band analyzer against the stubbed ADC/DMA: the bin to band table, and
+// band levels of tones in octave and third-octave bands.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+static void run_tone(double freq, double amp) {
+    feed_sine(freq, amp);
+    mode = MODE_BANDS;
+    draw_frequency = true;
+    do_capture();
+    render_frame();
+}
+
+static int band_of(double freq) {
+    for (int b=n_bands-1; b > 0; b--) {
+        if (freq >= band_center[b] * pow(2., -0.5 / band_fraction)) { return b; }
+    }
+    return 0;
+}
+
+static void check_tone(double freq, double amp) {
+    run_tone(freq, amp);
+    int loudest = 0;
+    for (int b=0; b < n_bands; b++) {
+        if (band_level[b] > band_level[loudest]) { loudest = b; }
+    }
+    CHECK(loudest == band_of(freq));
+    // 80 dB over the full 0-255 scale
+    double expect = (20 * log10(amp / 127.5) + 80) * 255 / 80;
+    if (fabs(band_level[loudest] - expect) > 3) {
+        fprintf(stderr, "%g Hz in 1/%d octave band %g Hz: level %d, expected %.1f\n",
+                freq, band_fraction, band_center[loudest], band_level[loudest], expect);
+    }
+    CHECK(fabs(band_level[loudest] - expect) <= 3);
+}
+
+int main(void) {
+    check_setup();
+
+    int fractions[2] = {3, 1};
+    for (int f=0; f < 2; f++) {
+        band_fraction = fractions[f];
+        run_tone(1000, 100);
+        CHECK(n_bands > 8 && n_bands <= 64);
+        // the top band holds Nyquist and each is a fraction of an octave up
+        CHECK(fabs(log2(SAMPLE_RATE / 2. / band_center[n_bands-1])) <= 0.5 / band_fraction + 1e-6);
+        for (int b=1; b < n_bands; b++) {
+            CHECK(fabs(band_center[b] / band_center[b-1] - pow(2., 1. / band_fraction)) < 1e-4);
+        }
+
+        check_tone(1000, 100);
+        check_tone(7777, 30);
+        check_tone(123456, 5);
+    }
+
+    return check_done();
+}
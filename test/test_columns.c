@@ -0,0 +1,101 @@
+// Spectrum reduced straight to display columns: max, mean and RMS over the
+// bins of a column, the peak-zoom window, and full bins only for export.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+#define TONE_BIN 1000  // on a bin, so its energy stays in it
+
+extern uint8_t fftabs[];
+extern bool display_buffer[WIDTH][HEIGHT];
+extern float hold_trace[WIDTH];
+
+void export_spectrum();
+
+static double tone_amp = 100;
+
+static void frame(enum column_reduce reduce, int spacing) {
+    feed_sine((double)TONE_BIN * SAMPLE_RATE / N_SAMPLES, tone_amp);
+    column_reduce = reduce;
+    display_spacing = spacing;
+    do_capture();
+    render_frame();
+}
+
+int main(void) {
+    check_setup();
+    mode = MODE_SCOPE;
+    draw_frequency = true;
+
+    // one bin of 32 carries the tone: the max keeps it at full height, the
+    // mean and RMS spread it over the column
+    const int col = TONE_BIN / 32;
+    frame(REDUCE_MAX, 32);
+    CHECK(n_columns == WIDTH);
+    CHECK(spectrum_columns[col] == 255);
+    frame(REDUCE_RMS, 32);
+    CHECK(abs(spectrum_columns[col] - (int)round(255 / sqrt(32))) <= 1);
+    frame(REDUCE_MEAN, 32);
+    CHECK(abs(spectrum_columns[col] - 255 / 32) <= 1);
+    for (int c=0; c < WIDTH; c++) {
+        if (abs(c - col) > 1) { CHECK(spectrum_columns[c] < 8); }
+    }
+
+    // at 64 bins a column only 64 have bins
+    frame(REDUCE_MAX, 64);
+    CHECK(n_columns == (N_SAMPLES/2 + 1) / 64);
+
+    // the peak-zoom shows one bin a column, centred on the peak
+    frame(REDUCE_MAX, -1);
+    CHECK(spectrum_columns[WIDTH/2] == 255);
+    CHECK(spectrum_columns[WIDTH/2 - 1] < 8 && spectrum_columns[WIDTH/2 + 1] < 8);
+
+    // the full bins are only written when they are asked for, and then
+    // match the columns one bin a column
+    memset(fftabs, 0xaa, N_SAMPLES/2 + 1);
+    frame(REDUCE_MAX, 1);
+    CHECK(fftabs[0] == 0xaa && fftabs[N_SAMPLES/2] == 0xaa);
+    export_spectrum();
+    CHECK(memcmp(fftabs, spectrum_columns, WIDTH) == 0);
+    CHECK(fftabs[TONE_BIN] == 255);
+
+    // and are of the last capture, whichever mode drew it
+    mode = MODE_PEAKS;
+    feed_sine(2.0 * TONE_BIN * SAMPLE_RATE / N_SAMPLES, tone_amp);
+    do_capture();
+    render_frame();
+    mode = MODE_SCOPE;
+    export_spectrum();
+    CHECK(fftabs[2*TONE_BIN] == 255 && fftabs[TONE_BIN] < 8);
+
+    // a burst held from an earlier frame sets the scale, rather than being
+    // clipped to the top of a quieter live frame's
+    hold_mode = HOLD_MAX;
+    frame(REDUCE_MAX, 32);
+    tone_amp = 10;
+    frame(REDUCE_MAX, 32);
+    CHECK(abs(spectrum_columns[col] - 255 / 10) <= 1);
+    CHECK(display_buffer[col][HEIGHT-1] && !display_buffer[col][HEIGHT-3]);
+    hold_mode = HOLD_PEAK;
+    hold_decay = 0.5;
+    frame(REDUCE_MAX, 32);
+    CHECK(abs(spectrum_columns[col] - 255 / 5) <= 1);
+    // min-hold relaxes back up even from a column that read exactly 0
+    hold_mode = HOLD_MIN;
+    tone_amp = 0;
+    frame(REDUCE_MAX, 32);
+    CHECK(hold_trace[col] == 0);
+    tone_amp = 10;
+    frame(REDUCE_MAX, 32);
+    CHECK(hold_trace[col] > 0);
+    hold_mode = HOLD_OFF;
+    frame(REDUCE_MAX, 32);
+    CHECK(spectrum_columns[col] == 255);
+
+    return check_done();
+}
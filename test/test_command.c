@@ -0,0 +1,168 @@
+// Remote-control protocol against the stubbed USB serial port: requests
+// split across polls, bad frames, each command's reply, and finding replies
+// among the device's text output.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "protocol.h"
+#include "spectro.h"
+
+static uint8_t request_buf[64];
+static uint8_t reply_payload[65535];
+static struct proto_parser parser;
+static uint8_t tone[N_SAMPLES];
+
+static int make_request(uint8_t cmd, const uint8_t * payload, uint16_t len) {
+    uint8_t crc = proto_header(request_buf, PROTO_SYNC_REQUEST, cmd, 0, len);
+    for (int i=0; i < len; i++) { request_buf[PROTO_HEADER + i] = payload[i]; }
+    request_buf[PROTO_HEADER + len] = proto_crc8(crc, payload, len);
+    return PROTO_HEADER + len + 1;
+}
+
+// Decodes the next reply from the device's output since the last reset;
+// returns its status, or -1 for none.
+static int next_reply(size_t * pos) {
+    size_t n;
+    const uint8_t * out = host_serial_output(&n);
+    while (*pos < n) {
+        if (proto_feed(&parser, out[(*pos)++]) == 1) { return parser.status; }
+    }
+    return -1;
+}
+
+// One request, fed in one go and polled once; returns the reply's status.
+static int command(uint8_t cmd, const uint8_t * payload, uint16_t len) {
+    size_t pos = 0;
+    host_serial_reset();
+    host_serial_feed(request_buf, make_request(cmd, payload, len));
+    poll_commands();
+    int status = next_reply(&pos);
+    CHECK(status < 0 || parser.cmd == cmd);
+    return status;
+}
+
+int main(void) {
+    check_setup();
+    proto_parser_init(&parser, PROTO_SYNC_REPLY, reply_payload, sizeof(reply_payload));
+
+    CHECK(command(CMD_PING, NULL, 0) == STATUS_OK);
+    CHECK(parser.len == 8 && reply_payload[0] == PROTO_VERSION);
+    CHECK(proto_get_u16(reply_payload + 2) == N_SAMPLES);
+    CHECK(proto_get_u32(reply_payload + 4) == SAMPLE_RATE);
+
+    // a request trickling in over several polls only runs once complete
+    size_t pos = 0;
+    uint8_t payload[PROTO_MAX_REQUEST] = {MODE_THD};
+    int n = make_request(CMD_SET_MODE, payload, 1);
+    host_serial_reset();
+    for (int i=0; i < n; i++) {
+        host_serial_feed(request_buf + i, 1);
+        poll_commands();
+        CHECK(mode == (i < n - 1 ? MODE_SCOPE : MODE_THD));
+    }
+    CHECK(next_reply(&pos) == STATUS_OK && parser.cmd == CMD_SET_MODE);
+
+    // a corrupted frame is dropped without a reply
+    n = make_request(CMD_SET_MODE, payload, 1);
+    request_buf[PROTO_HEADER] = MODE_SCOPE;
+    host_serial_reset();
+    host_serial_feed(request_buf, n);
+    poll_commands();
+    pos = 0;
+    CHECK(next_reply(&pos) == -1);
+    CHECK(mode == MODE_THD);
+
+    payload[0] = N_MODES;
+    CHECK(command(CMD_SET_MODE, payload, 1) == STATUS_BAD_VALUE);
+    CHECK(command(CMD_SET_MODE, payload, 2) == STATUS_BAD_LENGTH);
+    CHECK(command(0x7f, NULL, 0) == STATUS_BAD_CMD);
+    payload[0] = MODE_SCOPE;
+    CHECK(command(CMD_SET_MODE, payload, 1) == STATUS_OK && mode == MODE_SCOPE);
+
+    proto_put_u16(payload, N_SAMPLES / 2);
+    CHECK(command(CMD_SET_FFT_SIZE, payload, 2) == STATUS_UNSUPPORTED);
+    CHECK(proto_get_u16(reply_payload) == N_SAMPLES);
+    proto_put_u16(payload, N_SAMPLES);
+    CHECK(command(CMD_SET_FFT_SIZE, payload, 2) == STATUS_OK);
+
+    proto_put_u32(payload, 100000);
+    CHECK(command(CMD_SET_RATE, payload, 4) == STATUS_OK);
+    CHECK(proto_get_u32(reply_payload) == 100000 && adc_rate == 100000);
+
+    payload[0] = 1;
+    CHECK(command(CMD_SET_VIEW, payload, 1) == STATUS_OK && draw_frequency);
+
+    payload[0] = 3;
+    CHECK(command(CMD_SET_OVERSAMPLE, payload, 1) == STATUS_BAD_VALUE && oversample == 1);
+    payload[0] = 16;
+#if PACKED_SAMPLES
+    CHECK(command(CMD_SET_OVERSAMPLE, payload, 1) == STATUS_UNSUPPORTED && oversample == 1);
+#else
+    CHECK(command(CMD_SET_OVERSAMPLE, payload, 1) == STATUS_OK && oversample == 16);
+#endif
+    payload[0] = 1;
+    CHECK(command(CMD_SET_OVERSAMPLE, payload, 1) == STATUS_OK && oversample == 1);
+
+    payload[0] = HOLD_PEAK;
+    proto_put_f32(payload + 1, 1.5);
+    CHECK(command(CMD_SET_HOLD, payload, 5) == STATUS_BAD_VALUE && hold_mode == HOLD_OFF);
+    proto_put_f32(payload + 1, 0.75);
+    CHECK(command(CMD_SET_HOLD, payload, 5) == STATUS_OK && hold_mode == HOLD_PEAK && hold_decay == 0.75f);
+    payload[0] = HOLD_OFF;
+    CHECK(command(CMD_SET_HOLD, payload, 5) == STATUS_OK && hold_mode == HOLD_OFF);
+
+    payload[0] = 1;
+    proto_put_f32(payload + 1, -10);
+    proto_put_f32(payload + 5, 3);
+    CHECK(command(CMD_SET_DB, payload, 9) == STATUS_BAD_VALUE && !db_display);
+    proto_put_f32(payload + 5, 60);
+    CHECK(command(CMD_SET_DB, payload, 9) == STATUS_OK && db_display && db_ref == -10 && db_range == 60);
+    payload[0] = 0;
+    CHECK(command(CMD_SET_DB, payload, 9) == STATUS_OK && !db_display && db_range == 60);
+    db_ref = 0;
+    db_range = 80;
+
+    // a trigger is answered once its frame has been drawn
+    for (int i=0; i < N_SAMPLES; i++) { tone[i] = lround(128 + 100 * sin(2 * M_PI * 2000. * i / 100000)); }
+    host_adc_feed(tone, N_SAMPLES, 1);
+    uint32_t frames = frame_count;
+    CHECK(command(CMD_TRIGGER, NULL, 0) == -1);
+    CHECK(should_capture && should_draw);
+    do_capture();
+    render_frame();
+    pos = 0;
+    CHECK(next_reply(&pos) == STATUS_OK && parser.cmd == CMD_TRIGGER);
+    CHECK(proto_get_u32(reply_payload) == frames + 1);
+
+    CHECK(command(CMD_GET_STATS, NULL, 0) == STATUS_OK && parser.len == PROTO_STATS_LEN);
+    CHECK(proto_get_u32(reply_payload) == 100000);
+    CHECK(fabs(proto_get_f32(reply_payload + 12) - 2000) < 100000. / N_SAMPLES);
+
+    CHECK(command(CMD_GET_SAMPLES, NULL, 0) == STATUS_OK);
+    CHECK(parser.len == N_SAMPLES + 1 && reply_payload[0] == 8);
+    CHECK(memcmp(reply_payload + 1, tone, N_SAMPLES) == 0);
+
+    CHECK(command(CMD_GET_SPECTRUM, NULL, 0) == STATUS_OK);
+    CHECK(parser.len == N_SAMPLES/2 + 2 && reply_payload[0] == 1);
+    CHECK(reply_payload[1 + 164] == 255);  // 2 kHz at 100 kS/s
+
+    CHECK(command(CMD_GET_TIMING, NULL, 0) == STATUS_OK && parser.len == 4 + 4*N_STAGES);
+    CHECK(proto_get_u32(reply_payload) == frame_count);
+
+    // replies are found among text, including false sync bytes
+    host_serial_reset();
+    const char * text = "Z: Capture complete. ZZ\n";
+    for (const char * c = text; *c; c++) { putchar_raw(*c); }
+    host_serial_feed(request_buf, make_request(CMD_PING, NULL, 0));
+    poll_commands();
+    pos = 0;
+    CHECK(next_reply(&pos) == STATUS_OK && parser.cmd == CMD_PING);
+
+    set_adc_rate(SAMPLE_RATE);
+    CHECK(adc_rate == SAMPLE_RATE);
+
+    return check_done();
+}
@@ -0,0 +1,72 @@
+// Frequency counter against the stubbed ADC/DMA: reciprocal readings of
+// off-bin tones, hysteresis against noise on the edges, and chained blocks.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+// n samples of a tone at freq Hz, amplitude amp counts, plus noise of up
+// to +-noise counts.
+static void make_tone(double freq, double amp, int noise, int n) {
+    feed_tones(n, 1, &freq, &amp, NULL, noise, 1);
+}
+
+static void read_counter(int blocks) {
+    mode = MODE_COUNTER;
+    counter_blocks = blocks;
+    // the first reading settles the level onto the signal
+    do_capture();
+    do_capture();
+}
+
+static void test_tone(double freq) {
+    make_tone(freq, 100, 0, N_SAMPLES);
+    read_counter(1);
+    double err = fabs(counter.freq - freq) / freq;
+    if (err > 1e-4) { fprintf(stderr, "%g Hz read as %g Hz\n", freq, counter.freq); }
+    CHECK(err < 1e-4);
+    CHECK(fabs(counter.period * counter.freq - 1) < 1e-6);
+    // a whole number of cycles lies between the first and last crossing
+    CHECK(abs(counter.cycles - (int)(freq * N_SAMPLES / SAMPLE_RATE)) <= 1);
+}
+
+int main(void) {
+    check_setup();
+
+    // well below and well above the FFT bin spacing of 61 Hz
+    test_tone(123.4);
+    test_tone(1000.37);
+    test_tone(7012.3);
+    test_tone(61234.5);
+
+    // noise on the edges chatters across a bare threshold, but not across
+    // the hysteresis band
+    make_tone(2500.5, 60, 3, N_SAMPLES);
+    counter_hysteresis = 0;
+    read_counter(1);
+    int chattering = counter.cycles;
+    counter_hysteresis = 4;
+    read_counter(1);
+    CHECK(chattering > counter.cycles);
+    CHECK(abs(counter.cycles - (int)(2500.5 * N_SAMPLES / SAMPLE_RATE)) <= 1);
+    CHECK(fabs(counter.freq - 2500.5) / 2500.5 < 1e-3);
+
+    // four back-to-back blocks count the cycles of each
+    make_tone(3333.3, 100, 0, 4 * N_SAMPLES);
+    read_counter(1);
+    int one = counter.cycles;
+    read_counter(4);
+    CHECK(counter.cycles >= 4 * one - 4 && counter.cycles <= 4 * one + 4);
+    CHECK(fabs(counter.freq - 3333.3) / 3333.3 < 1e-4);
+
+    // too small to clear the hysteresis: no reading
+    make_tone(1000, 3, 0, N_SAMPLES);
+    read_counter(1);
+    CHECK(counter.cycles == 0);
+    CHECK(counter.freq == 0);
+
+    return check_done();
+}
@@ -0,0 +1,115 @@
+// Display backends against the stubbed I2C and SPI, through their byte
+// recorders: the set-up sequence, the address commands around each page,
+// D/C low for commands and high for data, and the frame read back out of
+// the page bytes.  Built once per SPI controller (DISPLAY_SPI_CONTROLLER).
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "display.h"
+
+#ifndef DISPLAY_SPI_CONTROLLER
+#define DISPLAY_SPI_CONTROLLER 0
+#endif
+
+#define DC_PIN 24  // SPI_DC_PIN in display_spi.c
+#define DATA 0x100  // D/C high in the SPI recording
+
+static bool frame[WIDTH][HEIGHT];
+static bool seen[WIDTH][HEIGHT];
+
+static void unpack_sh1107_page(int page, const uint8_t * bytes) {
+    for (int y=0; y < HEIGHT; y++) {
+        for (int k=0; k < 8; k++) { seen[page*8 + k][y] = bytes[y] >> k & 1; }
+    }
+}
+
+static void unpack_row_page(int page, const uint16_t * bytes) {
+    for (int x=0; x < WIDTH; x++) {
+        for (int k=0; k < 8; k++) { seen[x][HEIGHT-1 - (page*8 + k)] = bytes[x] >> k & 1; }
+    }
+}
+
+static void test_i2c(void) {
+    size_t n;
+    host_i2c_reset();
+    sh1107_i2c_display.init();
+    const uint8_t * out = host_i2c_output(&n);
+    CHECK(n == SH1107_INIT_LEN + 3);
+    CHECK(out[0] == 0x00 && memcmp(out + 1, sh1107_init, SH1107_INIT_LEN) == 0);
+    CHECK(out[n-2] == 0x00 && out[n-1] == 0xaf);
+
+    host_i2c_reset();
+    memset(seen, 0, sizeof(seen));
+    CHECK(sh1107_i2c_display.flush(frame) == (WIDTH/8) * (HEIGHT+1));
+    out = host_i2c_output(&n);
+    CHECK(n == (WIDTH/8) * (3 + HEIGHT+1));
+    for (int p=0; p < WIDTH/8 && (size_t)(p+1) * (3 + HEIGHT+1) <= n; p++) {
+        const uint8_t * page = out + p * (3 + HEIGHT+1);
+        CHECK(page[0] == 0x00 && page[1] == 0x10 && page[2] == 0xb0 + p);
+        CHECK(page[3] == 0x40);
+        unpack_sh1107_page(p, page + 4);
+    }
+    CHECK(memcmp(seen, frame, sizeof(frame)) == 0);
+}
+
+static void test_spi(void) {
+    size_t n;
+    host_spi_reset(DC_PIN);
+    spi_display.init();
+    const uint16_t * out = host_spi_output(&n);
+    CHECK(n > 10 && out[0] == 0xae && out[n-1] == 0xaf);
+    for (size_t i=0; i < n; i++) { CHECK(!(out[i] & DATA)); }
+
+    host_spi_reset(DC_PIN);
+    memset(seen, 0, sizeof(seen));
+    int sent = spi_display.flush(frame);
+    // the last transfer is only waited for by the next flush, which records
+    // at least its own first commands after it
+    spi_display.flush(frame);
+    out = host_spi_output(&n);
+    CHECK(n > (size_t)sent && !(out[sent] & DATA));
+#if DISPLAY_SPI_CONTROLLER == 0
+    // SSD1306: the column and page window, then the frame in one transfer
+    const uint16_t window[6] = {0x21, 0, WIDTH-1, 0x22, 0, HEIGHT/8 - 1};
+    CHECK(sent == 6 + WIDTH*HEIGHT/8);
+    for (int i=0; i < 6; i++) { CHECK(out[i] == window[i]); }
+    for (int i=6; i < sent; i++) { CHECK(out[i] & DATA); }
+    for (int p=0; p < HEIGHT/8; p++) { unpack_row_page(p, out + 6 + p*WIDTH); }
+#else
+    // a page at a time: page and column address, then the page
+    const int n_pages = DISPLAY_SPI_CONTROLLER == 2 ? WIDTH/8 : HEIGHT/8;
+    const int page_bytes = WIDTH*HEIGHT/8 / n_pages;
+    const int col = DISPLAY_SPI_CONTROLLER == 1 ? 2 : 0;  // the SH1106's 132-column RAM
+    CHECK(sent == n_pages * (3 + page_bytes));
+    for (int p=0; p < n_pages && (p+1) * (3 + page_bytes) <= sent; p++) {
+        const uint16_t * page = out + p * (3 + page_bytes);
+        CHECK(page[0] == 0xb0 + p && page[1] == (col & 0xf) && page[2] == (0x10 | col >> 4));
+        for (int i=0; i < page_bytes; i++) { CHECK(page[3+i] & DATA); }
+        if (DISPLAY_SPI_CONTROLLER == 2) {
+            uint8_t bytes[HEIGHT];
+            for (int i=0; i < HEIGHT; i++) { bytes[i] = page[3+i]; }
+            unpack_sh1107_page(p, bytes);
+        } else {
+            unpack_row_page(p, page + 3);
+        }
+    }
+#endif
+    CHECK(memcmp(seen, frame, sizeof(frame)) == 0);
+}
+
+int main(void) {
+    // a pattern with no symmetry to hide a flipped or transposed layout
+    for (int x=0; x < WIDTH; x++) {
+        for (int y=0; y < HEIGHT; y++) { frame[x][y] = (x*7 + y*3 + x*y) % 5 == 0; }
+    }
+    frame[0][0] = frame[WIDTH-1][HEIGHT-1] = true;
+    frame[WIDTH-1][0] = frame[0][HEIGHT-1] = false;
+
+    test_i2c();
+    test_spi();
+
+    return check_done();
+}
@@ -0,0 +1,71 @@
+// Accuracy and host-side speed of the table-driven log2/dB approximation,
+// against libm and against the sqrt/round it replaces in the display path.
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "check.h"
+#include "fastlog.h"
+
+#define N_TIMED 2000000
+
+static float inputs[4096];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_accuracy(void) {
+    double maxerr_log2 = 0, maxerr_db = 0;
+    // every mantissa region across the dynamic range of |X|^2 on the device
+    for (float x = 1e-6f; x < 1e13f; x *= 1.0007f) {
+        double err_log2 = fabs(log2_q16(x) / 65536. - log2(x));
+        double err_db = fabs(db10_q8(x) / 256. - 10 * log10(x));
+        if (err_log2 > maxerr_log2) { maxerr_log2 = err_log2; }
+        if (err_db > maxerr_db) { maxerr_db = err_db; }
+    }
+    printf("max error: log2 %.4f, dB %.4f\n", maxerr_log2, maxerr_db);
+    CHECK(maxerr_log2 < 0.012);
+    CHECK(maxerr_db < 0.045);
+
+    CHECK(db10_q8(0.f) == FASTLOG_MIN);
+    CHECK(db10_q8(-1.f) == FASTLOG_MIN);
+    CHECK(log2_q16(1.f) >= 0 && log2_q16(1.f) < 800);
+    CHECK(db10_q8(100.f) / 256 == 20 || db10_q8(100.f) / 256 == 19);
+}
+
+static void test_speed(void) {
+    volatile int32_t sink_i = 0;
+    volatile float sink_f = 0;
+    double t0, t_approx, t_log10, t_sqrt;
+
+    for (int i=0; i < 4096; i++) { inputs[i] = (i + 1) * 1234.5f; }
+
+    t0 = now_s();
+    for (int i=0; i < N_TIMED; i++) { sink_i = db10_q8(inputs[i & 4095]); }
+    t_approx = now_s() - t0;
+
+    t0 = now_s();
+    for (int i=0; i < N_TIMED; i++) { sink_f = 10 * log10f(inputs[i & 4095]); }
+    t_log10 = now_s() - t0;
+
+    // the linear display: round(255*sqrt(sq/max))
+    t0 = now_s();
+    for (int i=0; i < N_TIMED; i++) { sink_i = (int32_t)round(255 * sqrt(inputs[i & 4095] / 5.0e6)); }
+    t_sqrt = now_s() - t0;
+
+    (void)sink_i;
+    (void)sink_f;
+    // reported, not checked: host timings say little about the device and
+    // vary with whatever else the machine is running
+    printf("ns per call: db10_q8 %.2f, 10*log10f %.2f, round(sqrt) %.2f\n",
+           t_approx / N_TIMED * 1e9, t_log10 / N_TIMED * 1e9, t_sqrt / N_TIMED * 1e9);
+}
+
+int main(void) {
+    test_accuracy();
+    test_speed();
+    return check_done();
+}
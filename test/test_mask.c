@@ -0,0 +1,103 @@
+// Spectral mask against the stubbed ADC/DMA: a clean tone under the limit,
+// a spur over it, the hit's frame on the serial port, the trigger output and
+// re-arming.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+#include "check.h"
+#include "protocol.h"
+#include "spectro.h"
+
+#define TONE_BIN 82  // about 5 kHz
+#define SPUR_BIN 328  // about 20 kHz
+
+static uint8_t reply_payload[65535];
+static struct proto_parser parser;
+
+// A tone of 100 counts on TONE_BIN, plus a spur of spur counts on SPUR_BIN,
+// both offset half a bin so their energy spreads over neighbours.
+static void frame(double spur) {
+    const double freq[2] = {(TONE_BIN + 0.5) * SAMPLE_RATE / N_SAMPLES, (SPUR_BIN + 0.5) * SAMPLE_RATE / N_SAMPLES};
+    const double amp[2] = {100, spur};
+    feed_tones(N_SAMPLES, 2, freq, amp, NULL, 0, 0);
+    host_serial_reset();
+    do_capture();
+    render_frame();
+}
+
+// The CMD_MASK_HIT frame among the output of the last frame, if any.
+static bool mask_hit_sent(void) {
+    size_t n;
+    const uint8_t * out = host_serial_output(&n);
+    proto_parser_init(&parser, PROTO_SYNC_REPLY, reply_payload, sizeof(reply_payload));
+    for (size_t i=0; i < n; i++) {
+        if (proto_feed(&parser, out[i]) == 1 && parser.cmd == CMD_MASK_HIT) { return true; }
+    }
+    return false;
+}
+
+int main(void) {
+    check_setup();
+    mode = MODE_MASK;
+    draw_frequency = true;
+
+    // the tone itself is -2 dBFS, so the default -40 dBFS mask trips on it
+    frame(0);
+    CHECK(mask_tripped && mask_hits == 1 && mask_frames == 1);
+    CHECK(abs(mask_worst_bin - TONE_BIN) <= 1);
+    CHECK(mask_worst_db > 30 && mask_worst_db < 40);
+
+    // open up around the tone: now it is clean
+    CHECK(set_mask(TONE_BIN - 8, TONE_BIN + 8, INFINITY) == 0);
+    CHECK(set_mask(0, N_SAMPLES, 0) == -1);
+    mask_tripped = false;
+    uint32_t rises = host_gpio_rises(0);
+    frame(0);
+    CHECK(!mask_tripped && mask_violations == 0 && mask_hits == 1 && mask_frames == 2);
+    CHECK(!mask_hit_sent());
+    CHECK(host_gpio_rises(0) == rises + 1);  // the capture's edge only
+
+    // a -34 dBFS spur is over by about 6 dB
+    uint32_t frames = frame_count;
+    frame(2.5);
+    CHECK(mask_tripped && mask_hits == 2);
+    CHECK(abs(mask_worst_bin - SPUR_BIN) <= 1);
+    CHECK(mask_violations >= 2 && mask_violations <= 6);
+    CHECK(mask_worst_db > 3 && mask_worst_db < 9);
+    // the hit pulses the trigger output, leaving it low for the next
+    // capture's rising edge
+    CHECK(host_gpio_rises(0) == rises + 3);
+    CHECK(!gpio_get(0));
+    CHECK(mask_hit_sent());
+    CHECK(parser.len == 14 + N_SAMPLES/2 + 1);
+    CHECK(proto_get_u32(reply_payload) == frames + 1);
+    CHECK((int)proto_get_u32(reply_payload + 4) == mask_violations);
+    CHECK(proto_get_u16(reply_payload + 8) == mask_worst_bin);
+    CHECK(reply_payload[14 + TONE_BIN] > reply_payload[14 + SPUR_BIN]);
+
+    // the hit stays up until re-armed
+    uint8_t req[PROTO_HEADER + 1];
+    uint8_t crc = proto_header(req, PROTO_SYNC_REQUEST, CMD_GET_MASK, 0, 0);
+    req[PROTO_HEADER] = crc;
+    host_serial_reset();
+    host_serial_feed(req, sizeof(req));
+    poll_commands();
+    size_t n;
+    const uint8_t * out = host_serial_output(&n);
+    proto_parser_init(&parser, PROTO_SYNC_REPLY, reply_payload, sizeof(reply_payload));
+    int got = 0;
+    for (size_t i=0; i < n && got != 1; i++) { got = proto_feed(&parser, out[i]); }
+    CHECK(got == 1 && parser.cmd == CMD_GET_MASK && parser.len == PROTO_MASK_LEN);
+    CHECK(reply_payload[0] == 1 && proto_get_u32(reply_payload + 8) == 2);
+
+    crc = proto_header(req, PROTO_SYNC_REQUEST, CMD_ARM_MASK, 0, 0);
+    req[PROTO_HEADER] = crc;
+    host_serial_feed(req, sizeof(req));
+    poll_commands();
+    CHECK(!mask_tripped);
+
+    return check_done();
+}
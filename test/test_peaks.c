@@ -0,0 +1,59 @@
+// Peak list against the stubbed ADC/DMA: the largest tones in order, with
+// refined frequencies and levels, and nothing listed from noise alone.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+#define N_TONES 8
+
+// eight tones of falling amplitude, more than the list holds, plus +-2
+// counts of noise
+static const double tone_freq[N_TONES] = {5123.4, 71234.5, 1500.7, 33333.3, 98765.4, 250.2, 12000, 150000.9};
+static const double tone_amp[N_TONES] = {40, 25, 16, 10, 6.3, 4, 2.5, 1.6};
+static const double tone_phase[N_TONES] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+static void feed_peaks(int ntones, int noise) {
+    feed_tones(N_SAMPLES, ntones, tone_freq, tone_amp, tone_phase, noise, 7);
+}
+
+static void run_peaks() {
+    mode = MODE_PEAKS;
+    draw_frequency = true;
+    display_spacing = 1;
+    do_capture();
+    render_frame();
+}
+
+int main(void) {
+    check_setup();
+
+    feed_peaks(N_TONES, 2);
+    run_peaks();
+    CHECK(n_peaks == N_PEAKS);
+    for (int i=0; i < n_peaks; i++) {
+        // a full-scale sine is 127.5 counts
+        double db = 20 * log10(tone_amp[i] / 127.5);
+        if (fabs(peaks[i].freq - tone_freq[i]) > 5 || fabs(peaks[i].db - db) > 0.5) {
+            fprintf(stderr, "peak %d: %g Hz %g dB, expected %g Hz %g dB\n", i, peaks[i].freq, peaks[i].db, tone_freq[i], db);
+        }
+        CHECK(fabs(peaks[i].freq - tone_freq[i]) < 5);
+        CHECK(fabs(peaks[i].db - db) < 0.5);
+    }
+    CHECK(noise_floor_db < -60 && noise_floor_db > -110);
+
+    // fewer tones than the list holds: only they are listed
+    feed_peaks(2, 2);
+    run_peaks();
+    CHECK(n_peaks == 2);
+
+    // noise alone: a floor, but no peaks
+    feed_peaks(0, 2);
+    run_peaks();
+    CHECK(n_peaks == 0);
+
+    return check_done();
+}
@@ -0,0 +1,63 @@
+// Fundamental estimator against the stubbed ADC/DMA: harmonic-rich signals
+// whose largest bin is a harmonic, a missing fundamental, and pure tones.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+#define MAX_HARMONICS 8
+
+// harmonic h of f0 at amplitude amp[h-1] counts, for h up to nh
+static void make_harmonics(double f0, const double * amp, int nh) {
+    double freq[MAX_HARMONICS], phase[MAX_HARMONICS];
+    for (int h=1; h <= nh; h++) {
+        freq[h-1] = h * f0;
+        phase[h-1] = h;
+    }
+    feed_tones(N_SAMPLES, nh, freq, amp, phase, 0, 0);
+}
+
+static void check_pitch(double f0, double tolerance) {
+    mode = MODE_PITCH;
+    draw_frequency = true;
+    display_spacing = 1;
+    do_capture();
+    render_frame();
+    double err = fabs(pitch.freq - f0) / f0;
+    if (err > tolerance) { fprintf(stderr, "f0 %g Hz read as %g Hz\n", f0, pitch.freq); }
+    CHECK(err <= tolerance);
+    CHECK(pitch.clarity > 0.5 && pitch.clarity <= 1);
+}
+
+int main(void) {
+    check_setup();
+
+    // the spectrum peaks on the 2nd harmonic, the estimator must not
+    const double weak_fundamental[3] = {15, 60, 45};
+    make_harmonics(440, weak_fundamental, 3);
+    check_pitch(440, 2e-3);
+    CHECK(fabs(pitch.freq - 440) < 5);
+
+    // no energy at the fundamental at all
+    const double missing[4] = {0, 40, 40, 30};
+    make_harmonics(1000, missing, 4);
+    check_pitch(1000, 2e-3);
+
+    // pure tones, low and high
+    const double pure[1] = {100};
+    make_harmonics(211.7, pure, 1);
+    check_pitch(211.7, 2e-3);
+    make_harmonics(12345, pure, 1);
+    check_pitch(12345, 5e-3);
+
+    // DC only: nothing to find
+    feed_tones(N_SAMPLES, 0, NULL, NULL, NULL, 0, 0);
+    do_capture();
+    render_frame();
+    CHECK(pitch.freq == 0);
+
+    return check_done();
+}
@@ -0,0 +1,325 @@
+// Flash recorder against RAM standing in for the flash: the block codec on
+// smooth, noisy and jumpy signals, blocks cut to fit, damaged blocks, and
+// the sector ring written, wrapped and read back, including after a reset.
+// The fake flash only clears bits when programmed, like NOR, and insists
+// on whole pages at page boundaries.  Then MODE_RECORD end to end: the
+// stubbed DMA ring run past the recorder, an overrun, and the recording
+// read back over the protocol.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "spectro.h"
+
+#define MAX_SECTORS 64
+#define SIGNAL_LEN 200000
+
+extern struct flash_ops record_flash;  // the firmware's, over the stubbed flash
+
+static uint8_t flash_ram[MAX_SECTORS * RECORD_SECTOR];
+static uint32_t n_erases, n_programs, bad_programs;
+static struct flash_ops fake_flash;
+
+static uint8_t signal_buf[SIGNAL_LEN];
+static uint8_t out_buf[SIGNAL_LEN];
+static uint8_t coded_buf[RECORD_SECTOR];
+static uint8_t block_buf[RECORD_MAX_BLOCK];
+static uint8_t block_scratch[RECORD_SECTOR];
+static uint8_t request_buf[64];
+static uint8_t reply_payload[65535];
+static struct proto_parser parser;
+
+static void fake_erase(uint32_t sector) {
+    memset(flash_ram + sector * RECORD_SECTOR, 0xff, RECORD_SECTOR);
+    n_erases++;
+}
+
+static void fake_program(uint32_t offset, const uint8_t * page) {
+    n_programs++;
+    if (offset % RECORD_PAGE || offset + RECORD_PAGE > fake_flash.n_sectors * RECORD_SECTOR) {
+        bad_programs++;
+        return;
+    }
+    for (int i=0; i < RECORD_PAGE; i++) {
+        if (~flash_ram[offset + i] & page[i]) { bad_programs++; }  // a 0 bit can't go back to 1
+        flash_ram[offset + i] &= page[i];
+    }
+}
+
+static void reset_flash(uint32_t n_sectors) {
+    memset(flash_ram, 0xff, sizeof(flash_ram));
+    fake_flash = (struct flash_ops){n_sectors, flash_ram, fake_erase, fake_program};
+    n_erases = n_programs = bad_programs = 0;
+}
+
+// a slow sine with a little noise: the ADC on a typical input
+static void make_signal(uint8_t * s, int n, int noise) {
+    for (int i=0; i < n; i++) {
+        int v = 128 + 100 * sin(i * 0.01) + (noise ? rand() % (2*noise + 1) - noise : 0);
+        s[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+}
+
+static int roundtrip(const uint8_t * s, int n, uint32_t skipped) {
+    int used;
+    int len = record_encode(s, n, skipped, coded_buf, sizeof(coded_buf), &used);
+    CHECK(used == (n < RECORD_MAX_BLOCK ? n : RECORD_MAX_BLOCK));
+    CHECK(len <= used + RECORD_BLOCK_HEAD);
+    uint32_t got_skipped;
+    CHECK(record_decode(coded_buf, len, block_buf, RECORD_MAX_BLOCK, &got_skipped) == used);
+    CHECK(got_skipped == skipped);
+    CHECK(memcmp(block_buf, s, used) == 0);
+    return len;
+}
+
+static void test_codec(void) {
+    uint8_t s[RECORD_MAX_BLOCK + 100];
+
+    memset(s, 77, sizeof(s));
+    CHECK(roundtrip(s, 1000, 0) <= 1000/8 + RECORD_BLOCK_HEAD);  // one bit a sample
+    CHECK(roundtrip(s, 1, 0) > 0);
+    roundtrip(s, sizeof(s), 0);  // cut at RECORD_MAX_BLOCK
+
+    make_signal(s, 1024, 2);
+    int len = roundtrip(s, 1024, 123456789);
+    CHECK(len < 1024/2);
+
+    // noise: no worse than a byte a sample
+    for (int i=0; i < 1024; i++) { s[i] = rand(); }
+    CHECK(roundtrip(s, 1024, 5) <= 1024 + RECORD_BLOCK_HEAD);
+
+    // a full-scale square wave: rare large steps go out escaped
+    for (int i=0; i < 1024; i++) { s[i] = (i / 50) % 2 ? 255 : 0; }
+    CHECK(roundtrip(s, 1024, 0) < 1024/4);
+
+    // every step size, either way
+    for (int i=0; i < 1024; i++) { s[i] = (i * i * 37) >> 3; }
+    roundtrip(s, 1024, 0);
+}
+
+static void test_cut(void) {
+    uint8_t s[1024];
+    make_signal(s, 1024, 3);
+    int used, full_used;
+    int full = record_encode(s, 1024, 0, coded_buf, sizeof(coded_buf), &full_used);
+    for (int cap=0; cap < full; cap += 37) {
+        int len = record_encode(s, 1024, 0, coded_buf, cap, &used);
+        CHECK(len <= cap);
+        CHECK(used < 1024);
+        if (cap < 4) {
+            CHECK(len == 0 && used == 0);
+            continue;
+        }
+        uint32_t skipped;
+        CHECK(record_decode(coded_buf, len, block_buf, RECORD_MAX_BLOCK, &skipped) == used);
+        CHECK(memcmp(block_buf, s, used) == 0);
+    }
+
+    // damage: short, too long for the caller, bad k
+    int len = record_encode(s, 1024, 0, coded_buf, sizeof(coded_buf), &used);
+    uint32_t skipped;
+    CHECK(record_decode(coded_buf, len - 10, block_buf, RECORD_MAX_BLOCK, &skipped) == -1);
+    CHECK(record_decode(coded_buf, len, block_buf, 100, &skipped) == -1);
+    coded_buf[3] = RECORD_RAW + 1;  // skipped and n take 1 and 2 bytes
+    CHECK(record_decode(coded_buf, len, block_buf, RECORD_MAX_BLOCK, &skipped) == -1);
+}
+
+// Reads the newest recording back into out_buf, lost samples left as 0.
+// Returns the samples it spans, or -1.
+static int read_back(uint32_t * lost) {
+    struct record_reader rd;
+    record_reader_open(&rd, &fake_flash);
+    int pos = 0, n;
+    uint32_t skipped;
+    *lost = 0;
+    while ((n = record_read(&rd, block_buf, RECORD_MAX_BLOCK, &skipped)) > 0) {
+        if (pos + skipped + n > SIGNAL_LEN) { return -1; }
+        memset(out_buf + pos, 0, skipped);
+        memcpy(out_buf + pos + skipped, block_buf, n);
+        pos += skipped + n;
+        *lost += skipped;
+    }
+    return n < 0 ? -1 : pos;
+}
+
+static void test_ring(void) {
+    struct recorder r;
+    uint32_t lost;
+
+    reset_flash(MAX_SECTORS);
+    CHECK(record_find(&fake_flash).n_sectors == 0);
+    CHECK(read_back(&lost) == 0);
+
+    // blocks of a DMA ring's size, with an overrun partway through
+    make_signal(signal_buf, SIGNAL_LEN, 2);
+    recorder_init(&r, &fake_flash);
+    recorder_start(&r, 50000, block_scratch);
+    const int n_blocks = 40;
+    for (int b=0; b < n_blocks; b++) {
+        if (b == 20) { continue; }
+        CHECK(recorder_write(&r, signal_buf + b*1024, 1024, b == 21 ? 1024 : 0) > 0);
+    }
+    recorder_stop(&r);
+    CHECK(bad_programs == 0);
+    CHECK(r.samples == n_blocks * 1024 && r.skipped == 1024);
+    CHECK(r.sectors < MAX_SECTORS && n_erases == r.sectors);
+
+    struct record_extent e = record_find(&fake_flash);
+    CHECK(e.recording == r.recording && e.rate == 50000 && e.n_sectors == r.sectors);
+    CHECK(read_back(&lost) == n_blocks * 1024);
+    CHECK(lost == 1024);
+    CHECK(memcmp(out_buf, signal_buf, 20*1024) == 0);
+    CHECK(memcmp(out_buf + 21*1024, signal_buf + 21*1024, (n_blocks - 21) * 1024) == 0);
+
+    // a reset: the next recording carries on after the last sector
+    const struct record_extent first = e;
+    const uint32_t first_recording = r.recording;
+    recorder_init(&r, &fake_flash);
+    CHECK(r.recording == first_recording);
+    recorder_start(&r, 20000, block_scratch);
+    for (int b=0; b < 3; b++) { recorder_write(&r, signal_buf + 100000 + b*1024, 1024, 0); }
+    recorder_stop(&r);
+    e = record_find(&fake_flash);
+    CHECK(e.recording == first_recording + 1 && e.rate == 20000);
+    CHECK(e.first_sector == (first.first_sector + first.n_sectors) % MAX_SECTORS);
+    CHECK(read_back(&lost) == 3*1024 && lost == 0);
+    CHECK(memcmp(out_buf, signal_buf + 100000, 3*1024) == 0);
+    CHECK(bad_programs == 0);
+
+    // longer than the ring: the newest part survives, the rest counts as lost
+    reset_flash(4);
+    make_signal(signal_buf, SIGNAL_LEN, 20);
+    recorder_init(&r, &fake_flash);
+    recorder_start(&r, 100000, block_scratch);
+    for (int b=0; b < SIGNAL_LEN/1000; b++) { recorder_write(&r, signal_buf + b*1000, 1000, 0); }
+    recorder_stop(&r);
+    CHECK(bad_programs == 0);
+    CHECK(r.sectors > 4);
+    e = record_find(&fake_flash);
+    CHECK(e.n_sectors == 4);
+    int span = read_back(&lost);
+    CHECK(span == SIGNAL_LEN && lost > 0 && lost < SIGNAL_LEN);
+    CHECK(memcmp(out_buf + lost, signal_buf + lost, SIGNAL_LEN - lost) == 0);
+}
+
+static uint64_t fake_now(void) { return 0; }
+
+// One request, fed in one go and polled once; returns the reply's status.
+static int command(uint8_t cmd, const uint8_t * payload, uint16_t len) {
+    uint8_t crc = proto_header(request_buf, PROTO_SYNC_REQUEST, cmd, 0, len);
+    for (int i=0; i < len; i++) { request_buf[PROTO_HEADER + i] = payload[i]; }
+    request_buf[PROTO_HEADER + len] = proto_crc8(crc, payload, len);
+    host_serial_reset();
+    host_serial_feed(request_buf, PROTO_HEADER + len + 1);
+    poll_commands();
+
+    size_t n, pos = 0;
+    const uint8_t * out = host_serial_output(&n);
+    while (pos < n) {
+        if (proto_feed(&parser, out[pos++]) == 1) {
+            CHECK(parser.cmd == cmd);
+            return parser.status;
+        }
+    }
+    return -1;
+}
+
+// ADC conversions go into the DMA ring n at a time, the main loop running
+// dry between.
+static void run_adc(unsigned int n, int times) {
+    for (int i=0; i < times; i++) {
+        host_dma_run(n);
+        while (loop_step()) {}
+    }
+}
+
+static void test_record_mode(void) {
+    const int feed_len = 60000;
+    make_signal(signal_buf, feed_len, 3);
+    host_adc_feed(signal_buf, feed_len, 1);
+    setup_loop(fake_now);
+
+    uint8_t on = 1;
+    CHECK(command(CMD_RECORD, &on, 1) == STATUS_OK);
+    const uint32_t rate = proto_get_u32(reply_payload);
+    CHECK(recording && mode == MODE_RECORD);
+    CHECK(rate <= record_max_rate() * 1.01 && rate > 30000);
+    CHECK(command(CMD_READ_RECORD, (uint8_t[4]){0}, 4) == STATUS_BAD_VALUE);  // not while recording
+
+    run_adc(700, 100);
+    // the ring overrun, as by a stall
+    run_adc(3 * N_SAMPLES, 1);
+    run_adc(900, 100);
+    const uint32_t fed = 700*100 + 3*N_SAMPLES + 900*100;
+
+    on = 0;
+    CHECK(command(CMD_RECORD, &on, 1) == STATUS_OK);
+    CHECK(proto_get_u32(reply_payload) == 0 && !recording);
+    CHECK(adc_rate == SAMPLE_RATE);
+    CHECK(command(CMD_GET_RECORD, NULL, 0) == STATUS_OK);
+    CHECK(parser.len == PROTO_RECORD_LEN && reply_payload[0] == 0);
+    CHECK(proto_get_u32(reply_payload + 4) == rate);
+    CHECK(proto_get_u32(reply_payload + 8) == fed);
+    const uint32_t lost = proto_get_u32(reply_payload + 12);
+    CHECK(lost > 0 && lost < 3 * N_SAMPLES);
+
+    // the sectors over the protocol into RAM, to read as the host would
+    reset_flash(0);
+    uint32_t n_sectors = 0;
+    uint8_t index[4];
+    for (;;) {
+        proto_put_u32(index, n_sectors);
+        int status = command(CMD_READ_RECORD, index, 4);
+        if (status != STATUS_OK || n_sectors == MAX_SECTORS) { break; }
+        CHECK(parser.len == RECORD_SECTOR);
+        memcpy(flash_ram + n_sectors++ * RECORD_SECTOR, reply_payload, RECORD_SECTOR);
+    }
+    CHECK(n_sectors > 0 && n_sectors < MAX_SECTORS);
+    fake_flash.n_sectors = n_sectors;
+
+    struct record_reader rd;
+    record_reader_open(&rd, &fake_flash);
+    CHECK(rd.extent.rate == rate);
+    uint32_t pos = 0, skipped, total_skipped = 0;
+    int n, mismatches = 0;
+    while ((n = record_read(&rd, block_buf, RECORD_MAX_BLOCK, &skipped)) > 0) {
+        pos += skipped;
+        total_skipped += skipped;
+        for (int i=0; i < n; i++, pos++) { mismatches += block_buf[i] != signal_buf[pos % feed_len]; }
+    }
+    CHECK(n == 0 && mismatches == 0);
+    CHECK(pos == fed && total_skipped == lost);
+
+    // leaving the mode stops a recording
+    on = 1;
+    CHECK(command(CMD_RECORD, &on, 1) == STATUS_OK);
+    mode = MODE_SCOPE;
+    run_adc(100, 1);
+    CHECK(!recording);
+
+    // with no flash to record to nothing starts, and the mode stays
+    const uint32_t flash_sectors = record_flash.n_sectors;
+    record_flash.n_sectors = 1;
+    CHECK(command(CMD_RECORD, &on, 1) == STATUS_UNSUPPORTED);
+    CHECK(!recording && mode == MODE_SCOPE && adc_rate == SAMPLE_RATE);
+    record_flash.n_sectors = flash_sectors;
+}
+
+int main(void) {
+    check_setup();
+    srand(1);
+    test_codec();
+    test_cut();
+    test_ring();
+
+    proto_parser_init(&parser, PROTO_SYNC_REPLY, reply_payload, sizeof(reply_payload));
+    test_record_mode();
+
+    return check_done();
+}
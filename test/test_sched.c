@@ -0,0 +1,189 @@
+// Cooperative scheduler on a fake clock: priority order, deferral of work
+// that would overrun the capture deadline, forced runs after max_defer,
+// overrun statistics, and the main loop's frame tasks.
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "sched.h"
+#include "spectro.h"
+
+static uint64_t fake_us;
+static uint8_t feed[N_SAMPLES];
+
+static uint64_t fake_now(void) { return fake_us; }
+
+// Three tasks whose run takes cost[i] on the fake clock.
+static bool pending[3];
+static uint32_t cost[3];
+static char order[16];
+static int n_run;
+
+static void run(int i) {
+    pending[i] = false;
+    fake_us += cost[i];
+    if (n_run < (int)sizeof(order) - 1) { order[n_run++] = 'a' + i; }
+}
+
+static bool ready_a(void) { return pending[0]; }
+static bool ready_b(void) { return pending[1]; }
+static bool ready_c(void) { return pending[2]; }
+static void run_a(void) { run(0); }
+static void run_b(void) { run(1); }
+static void run_c(void) { run(2); }
+
+static void test_policy(void) {
+    struct sched_task tasks[3] = {
+        {.name="a", .ready=ready_a, .run=run_a, .budget_us=1000},
+        {.name="b", .ready=ready_b, .run=run_b, .budget_us=5000, .deferrable=true, .max_defer=2},
+        {.name="c", .ready=ready_c, .run=run_c, .budget_us=500, .deferrable=true, .max_defer=0},
+    };
+    struct scheduler s;
+    sched_init(&s, tasks, 3, fake_now);
+
+    // highest priority first, one task a step
+    pending[0] = pending[1] = pending[2] = true;
+    while (sched_step(&s) >= 0) {}
+    CHECK(n_run == 3 && order[0] == 'a' && order[1] == 'b' && order[2] == 'c');
+    CHECK(sched_step(&s) == -1);
+
+    // b does not fit before the deadline, c does
+    n_run = 0;
+    s.deadline_us = fake_us + 3000;
+    pending[1] = pending[2] = true;
+    CHECK(sched_step(&s) == 2);
+    CHECK(sched_step(&s) == -1);
+    CHECK(sched_step(&s) == -1);
+    CHECK(tasks[1].deferrals == 1 && tasks[1].runs == 1);
+
+    // waited out one deadline; the next is also too close, and then it runs
+    // regardless
+    s.deadline_us = fake_us + 4000;
+    CHECK(sched_step(&s) == -1);
+    CHECK(tasks[1].deferrals == 2);
+    s.deadline_us = fake_us + 4000;
+    cost[1] = 7000;
+    CHECK(sched_step(&s) == 1);
+    CHECK(tasks[1].forced == 1 && tasks[1].deferrals == 2);
+    CHECK(tasks[1].overruns == 1 && tasks[1].last_us == 7000 && tasks[1].max_us == 7000);
+
+    // c waits for as many deadlines as it takes, and runs once there is none
+    s.deadline_us = fake_us + 100;
+    pending[2] = true;
+    for (int d=0; d < 5; d++) {
+        CHECK(sched_step(&s) == -1);
+        s.deadline_us += 50;
+    }
+    CHECK(tasks[2].deferrals == 5 && tasks[2].forced == 0);
+    s.deadline_us = SCHED_NO_DEADLINE;
+    CHECK(sched_step(&s) == 2);
+
+    // a past deadline never holds up work that is not deferrable
+    s.deadline_us = fake_us;
+    pending[0] = true;
+    CHECK(sched_step(&s) == 0);
+    CHECK(tasks[0].runs == 2 && tasks[0].overruns == 0);
+
+    sched_reset_stats(&s);
+    CHECK(tasks[1].runs == 0 && tasks[1].max_us == 0);
+}
+
+// Steps the main loop until it idles, listing the tasks run in ran;
+// returns how many.
+static int loop_until_idle(int * ran, int max) {
+    int n = 0;
+    while (n < max) {
+        int before[N_TASKS];
+        for (int i=0; i < N_TASKS; i++) { before[i] = loop_tasks[i].runs; }
+        if (!loop_step()) { break; }
+        for (int i=0; i < N_TASKS; i++) {
+            if (loop_tasks[i].runs != (uint32_t)before[i]) { ran[n++] = i; }
+        }
+    }
+    return n;
+}
+
+static void test_loop(void) {
+    int ran[32];
+    for (int i=0; i < N_SAMPLES; i++) { feed[i] = 128 + (i % 64) - 32; }
+    setup_loop(fake_now);
+
+    // a triggered frame goes through every stage, then the UI is polled
+    host_adc_feed(feed, N_SAMPLES, 1);
+    should_capture = should_draw = true;
+    uint32_t frames = frame_count;
+    int n = loop_until_idle(ran, 32);
+    CHECK(n == 5);
+    CHECK(ran[0] == TASK_CAPTURE && ran[1] == TASK_ANALYSE && ran[2] == TASK_DRAW && ran[3] == TASK_FLUSH
+          && ran[4] == TASK_UI);
+    CHECK(frame_count == frames + 1 && frame_stage == FRAME_IDLE);
+
+    // continuous captures at 50 ms; the sample dump goes out between them
+    // while there is time, and otherwise waits for the next capture's samples
+    continuous_mode = true;
+    should_print = true;
+    capture_period_us = 50000;
+    loop_tasks[TASK_PRINT].budget_us = 45000;
+    fake_us += 10000;
+    host_adc_feed(feed, N_SAMPLES, 1);
+    n = loop_until_idle(ran, 32);
+    CHECK(n == 6 && ran[0] == TASK_CAPTURE && ran[3] == TASK_FLUSH && ran[4] == TASK_PRINT);
+    CHECK(loop_tasks[TASK_PRINT].runs == 1 && loop_tasks[TASK_PRINT].deferrals == 0);
+
+    fake_us += 50000;
+    host_adc_feed(feed, N_SAMPLES, 1);
+    loop_step();  // capture
+    fake_us += 10000;  // a slow capture leaves 40 ms to the next
+    loop_until_idle(ran, 32);
+    CHECK(loop_tasks[TASK_PRINT].runs == 1 && loop_tasks[TASK_PRINT].deferrals == 1);
+    CHECK(frame_stage == FRAME_IDLE);
+
+    // the next capture is due: it takes the samples the dump was waiting on
+    fake_us += 40000;
+    host_adc_feed(feed, N_SAMPLES, 1);
+    CHECK(loop_step() && loop_tasks[TASK_CAPTURE].runs == 4);
+
+    // without a deadline everything runs
+    continuous_mode = false;
+    should_print = false;
+    loop_until_idle(ran, 32);
+    CHECK(loop_tasks[TASK_PRINT].runs == 2);
+    CHECK(frame_stage == FRAME_IDLE);
+    capture_period_us = 0;
+}
+
+// Continuous captures back to back (no period, so no deadline) leave room
+// for every other task: each frame reaches the display, and the dump and
+// the UI still run.
+static void test_back_to_back(void) {
+    for (int i=0; i < N_SAMPLES; i++) { feed[i] = 128 + (i % 64) - 32; }
+    host_adc_feed(feed, N_SAMPLES, 1);
+    setup_loop(fake_now);
+    continuous_mode = true;
+    draw_frequency = true;
+    should_print = true;
+    capture_period_us = 0;
+    uint32_t frames = frame_count;
+    for (int i=0; i < 200; i++) {
+        loop_step();
+        fake_us += 1000;
+    }
+    const struct sched_task * t = loop_tasks;
+    CHECK(t[TASK_CAPTURE].runs > 10);
+    CHECK(t[TASK_FLUSH].runs + 1 >= t[TASK_CAPTURE].runs);
+    CHECK(frame_count - frames == t[TASK_FLUSH].runs);
+    CHECK(t[TASK_PRINT].runs + 1 >= t[TASK_CAPTURE].runs);
+    CHECK(t[TASK_UI].runs > 10);
+    continuous_mode = draw_frequency = should_print = false;
+}
+
+int main(void) {
+    check_setup();
+
+    test_policy();
+    test_loop();
+    test_back_to_back();
+
+    return check_done();
+}
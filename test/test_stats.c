@@ -0,0 +1,75 @@
+// Capture statistics against the stubbed ADC/DMA: mean, RMS, extremes, Vpp
+// and crest factor of known waveforms in calibrated volts, at 8 and 12 bits.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+#define CLOSE(a, b, tol) (fabs((a) - (b)) <= (tol))
+
+static uint8_t feed[N_SAMPLES];
+static uint16_t feed16[N_SAMPLES];
+
+static void capture8() {
+    host_adc_feed(feed, N_SAMPLES, 1);
+    mode = MODE_SCOPE;
+    do_capture();
+    measure_samples();
+}
+
+int main(void) {
+    check_setup();
+    const float lsb = cal_fullscale / 256;
+
+    // sine of 100 counts about 128: whole cycles, so the mean is exact
+    feed_sine(16. * SAMPLE_RATE / N_SAMPLES, 100);
+    mode = MODE_SCOPE;
+    do_capture();
+    measure_samples();
+    CHECK(stats.min == 28 && stats.max == 228);
+    CHECK(CLOSE(stats.mean, 128 * lsb, 1e-3));
+    CHECK(CLOSE(stats.rms, 100 / sqrt(2) * lsb, 2e-3));
+    CHECK(CLOSE(stats.vpp, 200 * lsb, 1e-5));
+    CHECK(CLOSE(stats.vmin, 28 * lsb, 1e-5) && CLOSE(stats.vmax, 228 * lsb, 1e-5));
+    CHECK(CLOSE(stats.crest, sqrt(2), 0.01));
+
+    // square wave: crest factor 1
+    for (int i=0; i < N_SAMPLES; i++) { feed[i] = (i / 64) % 2 ? 200 : 40; }
+    capture8();
+    CHECK(CLOSE(stats.mean, 120 * lsb, 1e-4));
+    CHECK(CLOSE(stats.rms, 80 * lsb, 1e-4));
+    CHECK(CLOSE(stats.crest, 1, 1e-3));
+
+    // DC with a calibration offset and gain
+    cal_offset = -1.65;
+    cal_fullscale = 6.6;
+    for (int i=0; i < N_SAMPLES; i++) { feed[i] = 64; }
+    capture8();
+    CHECK(CLOSE(stats.mean, -1.65 + 64 * 6.6 / 256, 1e-5));
+    CHECK(stats.rms == 0 && stats.vpp == 0 && stats.crest == 0);
+    cal_offset = 0;
+    cal_fullscale = 3.3;
+
+    // 12 bits, through the wide capture path
+    for (int i=0; i < N_SAMPLES; i++) { feed16[i] = lround(2048 + 1500 * sin(2 * M_PI * 8 * i / N_SAMPLES)); }
+    host_adc_feed(feed16, N_SAMPLES, 2);
+    mode = MODE_WIDE;
+    oversample = 1;
+    do_capture();
+    measure_samples();
+    CHECK(sample_bits == 12);
+    CHECK(stats.min == 548 && stats.max == 3548);
+    CHECK(CLOSE(stats.mean, 2048 * 3.3 / 4096, 1e-4));
+    CHECK(CLOSE(stats.rms, 1500 / sqrt(2) * 3.3 / 4096, 1e-4));
+
+    // the autoscale comes from the same pass
+    maxval_samples = -1;
+    update_maxval();
+    CHECK(maxval_samples == 3548 / 16.);
+    maxval_samples = 255.;
+
+    return check_done();
+}
@@ -0,0 +1,68 @@
+// THD, THD+N and SINAD from the Blackman-Harris windowed spectrum: a tone
+// with known harmonics and noise off the bin grid, the refined
+// fundamental, and harmonics only counted up to Nyquist.
+#include <math.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+
+#include "check.h"
+#include "spectro.h"
+
+#define MAX_HARMONICS 4
+
+// f0 at 100 counts with harmonic h at amp[h-2] counts, plus +-noise
+static void run_thd(double f0, const double * amp, int nh, int noise) {
+    double freq[MAX_HARMONICS], amps[MAX_HARMONICS], phase[MAX_HARMONICS];
+    for (int h=1; h <= nh; h++) {
+        freq[h-1] = h * f0;
+        amps[h-1] = h == 1 ? 100 : amp[h-2];
+        phase[h-1] = 0.7 * h;
+    }
+    feed_tones(N_SAMPLES, nh, freq, amps, phase, noise, 3);
+    mode = MODE_THD;
+    draw_frequency = true;
+    display_spacing = 1;
+    do_capture();
+    render_frame();
+}
+
+int main(void) {
+    check_setup();
+
+    // 2% and 1% harmonics and +-2 counts of noise.  The noise is uniform
+    // over 5 levels, 2 counts^2, plus 1/12 of rounding; the fundamental is
+    // 5000 counts^2 and the harmonics 2.5.
+    const double harm[3] = {2, 1, 0};
+    const double f0 = 1234.5;
+    run_thd(f0, harm, 4, 2);
+    const double expect_thd = sqrt(2.5 / 5000);
+    const double expect_thdn = sqrt((2.5 + 2 + 1./12) / 5000);
+    const double expect_sinad = 10 * log10((5000 + 2.5 + 2 + 1./12) / (2.5 + 2 + 1./12));
+    fprintf(stderr, "f0 %g Hz, THD %g, THD+N %g, SINAD %g dB, %d harmonics\n",
+            thd.freq, thd.thd, thd.thdn, thd.sinad, thd.harmonics);
+    CHECK(fabs(thd.freq - f0) < 0.5);
+    CHECK(fabs(thd.thd - expect_thd) / expect_thd < 0.1);
+    CHECK(fabs(thd.thdn - expect_thdn) / expect_thdn < 0.1);
+    CHECK(fabs(thd.sinad - expect_sinad) < 0.5);
+    CHECK(thd.harmonics == 10);
+
+    // a clean tone: only rounding, 1/12 counts^2, or 48 dB down
+    run_thd(f0, harm, 1, 0);
+    CHECK(thd.thd < 2e-3);
+    CHECK(fabs(thd.sinad - 10 * log10(5000 * 12)) < 1.5);
+
+    // at 60 kHz the 5th harmonic is past Nyquist (250 kHz), so 4 are counted
+    run_thd(60000, harm, 3, 0);
+    CHECK(fabs(thd.freq - 60000) < 0.5);
+    CHECK(thd.harmonics == 4);
+    CHECK(fabs(thd.thd - expect_thd) / expect_thd < 0.1);
+
+    // at 130 kHz even the 2nd is: no harmonics, and the 2nd's alias
+    // (240 kHz) counts as noise
+    run_thd(130000, harm, 2, 0);
+    CHECK(thd.harmonics == 0 && thd.thd == 0);
+    CHECK(thd.thdn > 0.015 && thd.thdn < 0.03);
+
+    return check_done();
+}
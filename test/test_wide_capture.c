@@ -0,0 +1,114 @@
+// 12 bit capture mode against the stubbed ADC/DMA: ping-pong DMA blocks,
+// packed storage, oversample-and-decimate, maxval scaling and the
+// print_samples dump.
+#include <stdio.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+
+#include "capture_file.h"
+#include "check.h"
+#include "spectro.h"
+
+static uint16_t feed[N_SAMPLES * 16];
+
+// what one decimated output sample should be, from raw conversions
+static uint16_t expected(int i) {
+    int shift = oversample >= 16 ? 2 : oversample >= 4 ? 1 : 0;
+    uint32_t acc = 0;
+    for (int j=0; j < oversample; j++) { acc += feed[i*oversample + j]; }
+    return (acc >> shift) >> (12 + shift - wide_sample_bits());
+}
+
+static void test_capture(int os) {
+    uint32_t rng = 1;
+    for (int i=0; i < N_SAMPLES * os; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        feed[i] = (i * 7 + (rng >> 29)) & 0xfff;
+    }
+    host_adc_feed(feed, N_SAMPLES * os, sizeof(feed[0]));
+
+    mode = MODE_WIDE;
+    oversample = os;
+    do_capture();
+
+    CHECK(sample_rate == (uint32_t)SAMPLE_RATE / os);
+    CHECK(sample_bits == wide_sample_bits());
+    int bad = 0;
+    for (int i=0; i < N_SAMPLES; i++) {
+        uint16_t want = expected(i);
+        if (wide_sample(i) != want || samples[i] != want >> (sample_bits - 8)) { bad++; }
+    }
+    if (bad) { fprintf(stderr, "oversample %d: %d of %d samples wrong\n", os, bad, N_SAMPLES); }
+    CHECK(bad == 0);
+}
+
+static void test_maxval(void) {
+    uint16_t maxval = 0;
+    for (int i=0; i < N_SAMPLES; i++) {
+        if (wide_sample(i) > maxval) { maxval = wide_sample(i); }
+    }
+    maxval_samples = -1;
+    update_maxval();
+    CHECK(maxval_samples == (float)maxval / (1 << (sample_bits - 8)));
+    maxval_samples = 255.;
+}
+
+static void test_print_roundtrip(void) {
+    char path[] = "/tmp/spectro_dumpXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    print_samples();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(fd);
+
+    capture cap;
+    CHECK(capture_import_dump(path, &cap) == 0);
+    unlink(path);
+    CHECK(cap.bit_depth == sample_bits);
+    CHECK(cap.bytes_per_sample == 2);
+    CHECK(cap.n_samples == N_SAMPLES);
+    CHECK(cap.sample_rate == sample_rate);
+    const uint16_t * vals = cap.data;
+    int bad = 0;
+    for (int i=0; i < N_SAMPLES; i++) {
+        if (vals[i] != wide_sample(i)) { bad++; }
+    }
+    CHECK(bad == 0);
+    capture_free(&cap);
+}
+
+static void test_8bit_unchanged(void) {
+    static uint8_t feed8[N_SAMPLES];
+    for (int i=0; i < N_SAMPLES; i++) { feed8[i] = i * 3; }
+    host_adc_feed(feed8, N_SAMPLES, 1);
+    mode = MODE_SCOPE;
+    do_capture();
+    CHECK(sample_bits == 8);
+    CHECK(sample_rate == SAMPLE_RATE);
+    int bad = 0;
+    for (int i=0; i < N_SAMPLES; i++) {
+        if (samples[i] != feed8[i]) { bad++; }
+    }
+    CHECK(bad == 0);
+}
+
+int main(void) {
+    check_setup();
+
+    int oversamples[3] = {1, 4, 16};
+    for (int i=0; i < 3; i++) {
+        test_capture(oversamples[i]);
+        test_maxval();
+        test_print_roundtrip();
+    }
+    test_8bit_unchanged();
+
+    return check_done();
+}